@@ -1,21 +1,169 @@
 #include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include "water_map.h"
+#include "thread_pool.h"
+#include "build_manifest.h"
 #include "log_macros.h"
 #include "log_stdout.h"
 #include "log_file.h"
 
+struct ZoneBuildResult
+{
+	std::string zone;
+	bool success;
+	bool skipped;
+	double seconds;
+};
+
 int main(int argc, char **argv) {
 	eqLogInit(EQEMU_LOG_LEVEL);
 	eqLogRegister(std::shared_ptr<EQEmu::Log::LogBase>(new EQEmu::Log::LogStdOut()));
 	eqLogRegister(std::shared_ptr<EQEmu::Log::LogBase>(new EQEmu::Log::LogFile("awater.log")));
 
-	for(int i = 1; i < argc; ++i) {
+	int i = 1;
+	size_t jobs = 1;
+	bool force = false;
+	bool dry_run = false;
+	std::string manifest_file = "awater_manifest.json";
+	for (; i < argc; ++i) {
+		if (strcmp(argv[i], "--Force") == 0) {
+			force = true;
+		}
+		else if (strcmp(argv[i], "--DryRun") == 0) {
+			dry_run = true;
+		}
+		else if (strcmp(argv[i], "--Manifest") == 0 && i + 1 < argc) {
+			manifest_file = argv[++i];
+		}
+		else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+			int n = atoi(argv[++i]);
+			jobs = n > 0 ? (size_t)n : EQEmu::ThreadPool::DefaultThreadCount();
+		}
+		else {
+			break;
+		}
+	}
+
+	std::vector<std::string> zones(argv + i, argv + argc);
+	std::vector<ZoneBuildResult> results(zones.size());
+	std::atomic<size_t> finished(0);
+
+	//bump when the water map written for the same inputs changes
+	const std::string tool_version = "1";
+
+	BuildManifest manifest;
+	manifest.Load(manifest_file);
+
+	auto build_zone = [&](size_t idx) {
+		auto &zone = zones[idx];
+		auto start = std::chrono::steady_clock::now();
+		std::string filename = zone + std::string(".wtr");
+
+		BuildManifestEntry entry;
+		entry.tool = "awater";
+		entry.tool_version = tool_version;
+		entry.options = "";
+		entry.AddInput(zone + ".eqg");
+		entry.AddInput(zone + ".zon");
+		entry.AddInput(zone + ".s3d");
+
+		results[idx].zone = zone;
+		results[idx].success = true;
+		results[idx].skipped = true;
+		results[idx].seconds = 0.0;
+		if (!force && manifest.IsUpToDate(filename, entry)) {
+			size_t done = ++finished;
+			eqLogMessage(LogInfo, "[%u/%u] %s is up to date", (uint32_t)done, (uint32_t)zones.size(), zone.c_str());
+			return;
+		}
+
+		results[idx].skipped = false;
+		if (dry_run) {
+			size_t done = ++finished;
+			eqLogMessage(LogInfo, "[%u/%u] %s would be rebuilt", (uint32_t)done, (uint32_t)zones.size(), zone.c_str());
+			return;
+		}
+
 		WaterMap m;
-		eqLogMessage(LogInfo, "Building water map for zone %s", argv[i]);
-		if(!m.BuildAndWrite(argv[i])) {
-			eqLogMessage(LogError, "Failed to build and write water map for zone: %s", argv[i]);
+		eqLogMessage(LogInfo, "Building water map for zone %s", zone.c_str());
+		bool success = m.BuildAndWrite(zone);
+		if(!success) {
+			eqLogMessage(LogError, "Failed to build and write water map for zone: %s", zone.c_str());
 		} else {
-			eqLogMessage(LogInfo, "Built and wrote water map for zone %s", argv[i]);
+			eqLogMessage(LogInfo, "Built and wrote water map for zone %s", zone.c_str());
+		}
+
+		if (success) {
+			manifest.Set(filename, entry);
+		}
+		else {
+			manifest.Remove(filename);
+		}
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		results[idx].success = success;
+		results[idx].seconds = elapsed.count();
+
+		size_t done = ++finished;
+		eqLogMessage(LogInfo, "[%u/%u] %s %s in %.2fs", (uint32_t)done, (uint32_t)zones.size(), zone.c_str(),
+			success ? "finished" : "failed", elapsed.count());
+	};
+
+	auto start = std::chrono::steady_clock::now();
+	if (jobs > 1 && zones.size() > 1) {
+		EQEmu::ThreadPool zone_pool(std::min(jobs, zones.size()));
+		std::vector<std::future<void>> pending;
+		for (size_t idx = 0; idx < zones.size(); ++idx) {
+			pending.push_back(zone_pool.Enqueue([&build_zone, idx]() { build_zone(idx); }));
+		}
+
+		for (auto &p : pending) {
+			p.get();
+		}
+	}
+	else {
+		for (size_t idx = 0; idx < zones.size(); ++idx) {
+			build_zone(idx);
+		}
+	}
+
+	if (!dry_run) {
+		manifest.Save(manifest_file);
+	}
+
+	std::chrono::duration<double> total = std::chrono::steady_clock::now() - start;
+	if (zones.size() > 1) {
+		uint32_t failed = 0;
+		uint32_t skipped = 0;
+		double zone_seconds = 0.0;
+		for (auto &r : results) {
+			if (r.skipped) {
+				++skipped;
+				continue;
+			}
+
+			if (dry_run) {
+				continue;
+			}
+
+			eqLogMessage(LogInfo, "%-24s %-8s %8.2fs", r.zone.c_str(), r.success ? "ok" : "failed", r.seconds);
+			zone_seconds += r.seconds;
+			if (!r.success) {
+				++failed;
+			}
+		}
+
+		uint32_t built = (uint32_t)zones.size() - failed - skipped;
+		if (dry_run) {
+			eqLogMessage(LogInfo, "%u of %u water maps would be rebuilt.", (uint32_t)zones.size() - skipped, (uint32_t)zones.size());
+		}
+		else {
+			eqLogMessage(LogInfo, "Built %u of %u water maps, %u up to date, in %.2fs wall time (%.2fs of zone time, %u jobs).", built,
+				(uint32_t)zones.size(), skipped, total.count(), zone_seconds, (uint32_t)jobs);
 		}
 	}
 
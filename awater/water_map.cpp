@@ -4,8 +4,9 @@
 #include "eqg_loader.h"
 #include "eqg_v4_loader.h"
 #include <string.h>
+#include <unordered_map>
 
-uint32_t BSPMarkRegion(std::shared_ptr<EQEmu::S3D::BSPTree> tree, uint32_t node_number, uint32_t region, int32_t region_type);
+void BSPMapRegions(EQEmu::S3D::BSPTree &tree, std::unordered_map<uint32_t, uint32_t> &region_leaves);
 
 WaterMap::WaterMap() {
 }
@@ -40,6 +41,8 @@ bool WaterMap::BuildAndWriteS3D(std::string zone_name) {
 
 	eqLogMessage(LogTrace, "Loaded %s.s3d.", zone_name.c_str());
 	std::shared_ptr<EQEmu::S3D::BSPTree> tree;
+	std::shared_ptr<EQEmu::S3D::BSPTree> mapped_tree;
+	std::unordered_map<uint32_t, uint32_t> region_leaves;
 	for(uint32_t i = 0; i < zone_frags.size(); ++i) {
 		if(zone_frags[i].type == 0x21) {
 			EQEmu::S3D::WLDFragment21 &frag = reinterpret_cast<EQEmu::S3D::WLDFragment21&>(zone_frags[i]);
@@ -101,8 +104,18 @@ bool WaterMap::BuildAndWriteS3D(std::string zone_name) {
 				}
 			}
 
+			//one walk of the tree finds every region's leaf, then each region is a lookup
+			if (mapped_tree != tree) {
+				BSPMapRegions(*tree, region_leaves);
+				mapped_tree = tree;
+			}
+
+			auto &nodes = tree->GetNodes();
 			for(size_t j = 0; j < regions.size(); ++j) {
-				BSPMarkRegion(tree, 1, regions[j] + 1, (int32_t)region_type);
+				auto iter = region_leaves.find(regions[j] + 1);
+				if (iter != region_leaves.end()) {
+					nodes[iter->second - 1].special = (int32_t)region_type;
+				}
 			}
 		}
 	}
@@ -525,30 +538,40 @@ bool WaterMap::BuildAndWriteEQG4(std::string zone_name) {
 	return false;
 }
 
-uint32_t BSPMarkRegion(std::shared_ptr<EQEmu::S3D::BSPTree> tree, uint32_t node_number, uint32_t region, int32_t region_type) {
-	if (node_number < 1) {
-		eqLogMessage(LogError, "BSPMarkRegion was passed a node < 1.");
-		return 0;
+//Leaf node number of each region. Walks left before right from the root like a search for a single region would, so
+//if a region is on more than one leaf it maps to the one that search would have found first.
+void BSPMapRegions(EQEmu::S3D::BSPTree &tree, std::unordered_map<uint32_t, uint32_t> &region_leaves) {
+	region_leaves.clear();
+
+	auto &nodes = tree.GetNodes();
+	if (nodes.empty()) {
+		return;
 	}
 
-	auto &nodes = tree->GetNodes();
-	if ((nodes[node_number - 1].left == 0) && (nodes[node_number - 1].right == 0))  {
-		if (nodes[node_number - 1].region == region) {
-			nodes[node_number - 1].special = region_type;
-			return node_number;
+	//a node reached a second time can't turn up a region any earlier than the first visit did
+	std::vector<bool> visited(nodes.size() + 1, false);
+	std::vector<uint32_t> stack;
+	stack.push_back(1);
+	while (!stack.empty()) {
+		uint32_t node_number = stack.back();
+		stack.pop_back();
+		if (node_number < 1 || node_number > nodes.size() || visited[node_number]) {
+			continue;
 		}
-	}
 
-	uint32_t ret_node = 0;
-	if (nodes[node_number - 1].left != 0) {
-		ret_node = BSPMarkRegion(tree, nodes[node_number - 1].left, region, region_type);
-		if(ret_node != 0)
-			return ret_node;
-	}
+		visited[node_number] = true;
+		auto &node = nodes[node_number - 1];
+		if (node.left == 0 && node.right == 0) {
+			region_leaves.insert(std::make_pair(node.region, node_number));
+			continue;
+		}
 
-	if (nodes[node_number - 1].right != 0) {
-		return BSPMarkRegion(tree, nodes[node_number - 1].right, region, region_type);
-	}
+		if (node.right != 0) {
+			stack.push_back(node.right);
+		}
 
-	return 0;
+		if (node.left != 0) {
+			stack.push_back(node.left);
+		}
+	}
 }
\ No newline at end of file
@@ -1,8 +1,26 @@
 #include "map.h"
+#include "zone_map.h"
+#include "floor_map.h"
+#include "thread_pool.h"
+#include "build_manifest.h"
+#include "string_util.h"
 #include "log_macros.h"
 #include "log_stdout.h"
 #include "log_file.h"
+#include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+struct ZoneBuildResult
+{
+	std::string zone;
+	bool success;
+	bool skipped;
+	double seconds;
+};
 
 int main(int argc, char **argv) {
 	eqLogInit(EQEMU_LOG_LEVEL);
@@ -11,25 +29,241 @@ int main(int argc, char **argv) {
 
 	int i = 1;
 	bool ignore_collide_tex = true;
-	if (argc > 2) {
-		if (strcmp(argv[1], "--IncludeCollideTex") == 0) {
+	float weld_epsilon = 0.0f;
+	int map_version = 2;
+	float simplify_error = 0.0f;
+	bool reorder = false;
+	bool bake_bvh = true;
+	float floor_cell_size = 0.0f;
+	size_t jobs = 1;
+	bool force = false;
+	bool dry_run = false;
+	std::string manifest_file = "azone_manifest.json";
+	for (; i < argc; ++i) {
+		if (strcmp(argv[i], "--IncludeCollideTex") == 0) {
 			ignore_collide_tex = false;
-			i = 2;
+		}
+		else if (strcmp(argv[i], "--WeldEpsilon") == 0 && i + 1 < argc) {
+			weld_epsilon = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--Reorder") == 0) {
+			reorder = true;
+		}
+		else if (strcmp(argv[i], "--NoBvh") == 0) {
+			bake_bvh = false;
+		}
+		else if (strcmp(argv[i], "--FloorMap") == 0 && i + 1 < argc) {
+			floor_cell_size = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--Simplify") == 0 && i + 1 < argc) {
+			simplify_error = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--MapVersion") == 0 && i + 1 < argc) {
+			map_version = atoi(argv[++i]);
+			if (map_version != 2 && map_version != 3) {
+				eqLogMessage(LogError, "Unsupported map version %s, only 2 and 3 can be written.", argv[i]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--Force") == 0) {
+			force = true;
+		}
+		else if (strcmp(argv[i], "--DryRun") == 0) {
+			dry_run = true;
+		}
+		else if (strcmp(argv[i], "--Manifest") == 0 && i + 1 < argc) {
+			manifest_file = argv[++i];
+		}
+		else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+			int n = atoi(argv[++i]);
+			jobs = n > 0 ? (size_t)n : EQEmu::ThreadPool::DefaultThreadCount();
+		}
+		else {
+			break;
 		}
 	}
 
-	for(; i < argc; ++i) {
+	std::vector<std::string> zones(argv + i, argv + argc);
+	std::vector<ZoneBuildResult> results(zones.size());
+	std::atomic<size_t> finished(0);
+
+	//bump when the map written for the same inputs and options changes
+	const std::string tool_version = "1";
+	const std::string options = EQEmu::StringFormat("IncludeCollideTex=%d WeldEpsilon=%g Simplify=%g Reorder=%d MapVersion=%d Bvh=%d FloorMap=%g",
+		ignore_collide_tex ? 0 : 1, weld_epsilon, simplify_error, reorder ? 1 : 0, map_version, bake_bvh ? 1 : 0, floor_cell_size);
+
+	BuildManifest manifest;
+	manifest.Load(manifest_file);
+
+	//welding runs on its own pool; zone jobs block on it but its workers never wait on anything themselves
+	EQEmu::ThreadPool weld_pool(EQEmu::ThreadPool::DefaultThreadCount());
+	auto build_zone = [&](size_t idx) {
+		auto &zone = zones[idx];
+		auto start = std::chrono::steady_clock::now();
+		std::string filename = zone + std::string(".map");
+		std::string bvh_filename = zone + std::string(".bvh");
+		std::string floor_filename = zone + std::string(".flr");
+		bool bake_floors = floor_cell_size > 0.0f;
+
+		BuildManifestEntry entry;
+		entry.tool = "azone";
+		entry.tool_version = tool_version;
+		entry.options = options;
+		entry.AddInput(zone + ".eqg");
+		entry.AddInput(zone + ".zon");
+		entry.AddInput(zone + ".s3d");
+		entry.AddInput(zone + "_obj.s3d");
+		entry.AddInput(zone + ".ignore");
+
+		results[idx].zone = zone;
+		results[idx].success = true;
+		results[idx].skipped = true;
+		results[idx].seconds = 0.0;
+		bool up_to_date = manifest.IsUpToDate(filename, entry) && (!bake_bvh || manifest.IsUpToDate(bvh_filename, entry)) &&
+			(!bake_floors || manifest.IsUpToDate(floor_filename, entry));
+		if (!force && up_to_date) {
+			size_t done = ++finished;
+			eqLogMessage(LogInfo, "[%u/%u] %s is up to date", (uint32_t)done, (uint32_t)zones.size(), zone.c_str());
+			return;
+		}
+
+		results[idx].skipped = false;
+		if (dry_run) {
+			size_t done = ++finished;
+			eqLogMessage(LogInfo, "[%u/%u] %s would be rebuilt", (uint32_t)done, (uint32_t)zones.size(), zone.c_str());
+			return;
+		}
+
 		Map m;
-		eqLogMessage(LogInfo, "Attempting to build map for zone: %s", argv[i]);
-		if(!m.Build(argv[i], ignore_collide_tex)) {
-			eqLogMessage(LogError, "Failed to build map for zone: %s", argv[i]);
+		m.SetWeldEpsilon(weld_epsilon);
+		m.SetSimplifyError(simplify_error);
+		m.SetReorder(reorder);
+		m.SetThreadPool(&weld_pool);
+
+		bool success = false;
+		eqLogMessage(LogInfo, "Attempting to build map for zone: %s", zone.c_str());
+		if(!m.Build(zone, ignore_collide_tex)) {
+			eqLogMessage(LogError, "Failed to build map for zone: %s", zone.c_str());
 		} else {
-			if(!m.Write(std::string(argv[i]) + std::string(".map"))) {
-				eqLogMessage(LogError, "Failed to write map for zone %s", argv[i]);
+			bool written = map_version == 3 ? m.WriteV3(filename) : m.Write(filename);
+			if(!written) {
+				eqLogMessage(LogError, "Failed to write map for zone %s", zone.c_str());
 			} else {
-				eqLogMessage(LogInfo, "Wrote map for zone: %s", argv[i]);
+				eqLogMessage(LogInfo, "Wrote map for zone: %s", zone.c_str());
+				success = true;
 			}
 		}
+
+		//baked from the map as written so the bvh matches exactly what RegisterMesh gets handed at load
+		ZoneMap zm;
+		if (success && (bake_bvh || bake_floors) && !zm.Load(filename)) {
+			eqLogMessage(LogError, "Failed to reload map for zone %s", zone.c_str());
+			success = false;
+		}
+
+		if (success && bake_bvh) {
+			EQPhysics physics;
+			physics.RegisterZoneMap(zm);
+			if(!physics.WriteBvhFile(bvh_filename)) {
+				eqLogMessage(LogError, "Failed to write bvh for zone %s", zone.c_str());
+				success = false;
+			} else {
+				eqLogMessage(LogInfo, "Wrote bvh for zone: %s", zone.c_str());
+			}
+		}
+
+		if (success && bake_floors) {
+			FloorMap floors;
+			if (!floors.Build(zm, floor_cell_size, &weld_pool) || !floors.Write(floor_filename)) {
+				eqLogMessage(LogError, "Failed to write floor map for zone %s", zone.c_str());
+				success = false;
+			} else {
+				eqLogMessage(LogInfo, "Wrote floor map for zone: %s (%u floors)", zone.c_str(), floors.GetFloorCount());
+			}
+		}
+
+		if (success) {
+			manifest.Set(filename, entry);
+			if (bake_bvh) {
+				manifest.Set(bvh_filename, entry);
+			}
+
+			if (bake_floors) {
+				manifest.Set(floor_filename, entry);
+			}
+			else {
+				//a floor map from an earlier build would no longer match the map just written
+				remove(floor_filename.c_str());
+				manifest.Remove(floor_filename);
+			}
+		}
+		else {
+			manifest.Remove(filename);
+			manifest.Remove(bvh_filename);
+			manifest.Remove(floor_filename);
+		}
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		results[idx].success = success;
+		results[idx].seconds = elapsed.count();
+
+		size_t done = ++finished;
+		eqLogMessage(LogInfo, "[%u/%u] %s %s in %.2fs", (uint32_t)done, (uint32_t)zones.size(), zone.c_str(),
+			success ? "finished" : "failed", elapsed.count());
+	};
+
+	auto start = std::chrono::steady_clock::now();
+	if (jobs > 1 && zones.size() > 1) {
+		EQEmu::ThreadPool zone_pool(std::min(jobs, zones.size()));
+		std::vector<std::future<void>> pending;
+		for (size_t idx = 0; idx < zones.size(); ++idx) {
+			pending.push_back(zone_pool.Enqueue([&build_zone, idx]() { build_zone(idx); }));
+		}
+
+		for (auto &p : pending) {
+			p.get();
+		}
+	}
+	else {
+		for (size_t idx = 0; idx < zones.size(); ++idx) {
+			build_zone(idx);
+		}
+	}
+
+	if (!dry_run) {
+		manifest.Save(manifest_file);
+	}
+
+	std::chrono::duration<double> total = std::chrono::steady_clock::now() - start;
+	if (zones.size() > 1) {
+		uint32_t failed = 0;
+		uint32_t skipped = 0;
+		double zone_seconds = 0.0;
+		for (auto &r : results) {
+			if (r.skipped) {
+				++skipped;
+				continue;
+			}
+
+			if (dry_run) {
+				continue;
+			}
+
+			eqLogMessage(LogInfo, "%-24s %-8s %8.2fs", r.zone.c_str(), r.success ? "ok" : "failed", r.seconds);
+			zone_seconds += r.seconds;
+			if (!r.success) {
+				++failed;
+			}
+		}
+
+		uint32_t built = (uint32_t)zones.size() - failed - skipped;
+		if (dry_run) {
+			eqLogMessage(LogInfo, "%u of %u zones would be rebuilt.", (uint32_t)zones.size() - skipped, (uint32_t)zones.size());
+		}
+		else {
+			eqLogMessage(LogInfo, "Built %u of %u zones, %u up to date, in %.2fs wall time (%.2fs of zone time, %u jobs).", built,
+				(uint32_t)zones.size(), skipped, total.count(), zone_seconds, (uint32_t)jobs);
+		}
 	}
 
 	return 0;
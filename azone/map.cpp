@@ -1,17 +1,37 @@
 #include "map.h"
-#include <sstream>
 #include <fstream>
 #include "compression.h"
+#include "vertex_welder.h"
+#include "mesh_simplifier.h"
+#include "mesh_order.h"
 #include "log_macros.h"
 #include <gtc/matrix_transform.hpp>
 
 Map::Map() {
+	weld_epsilon = 0.0f;
+	simplify_error = 0.0f;
+	reorder = false;
+	thread_pool = nullptr;
 }
 
 Map::~Map() {
 }
 
 bool Map::Build(std::string zone_name, bool ignore_collide_tex) {
+	if (!BuildGeometry(zone_name, ignore_collide_tex)) {
+		return false;
+	}
+
+	SimplifyMesh(collide_verts, collide_indices, "zone");
+	if (reorder) {
+		ReorderMeshMorton(collide_verts, collide_indices);
+		ReorderMeshMorton(non_collide_verts, non_collide_indices);
+	}
+
+	return true;
+}
+
+bool Map::BuildGeometry(std::string zone_name, bool ignore_collide_tex) {
 	LoadIgnore(zone_name);
 
 	eqLogMessage(LogTrace, "Attempting to load %s.eqg as a standard eqg.", zone_name.c_str());
@@ -51,6 +71,34 @@ bool Map::Build(std::string zone_name, bool ignore_collide_tex) {
 	return CompileS3D(zone_frags, zone_object_frags, object_frags, ignore_collide_tex);
 }
 
+#pragma pack(1)
+struct MapModelPoly
+{
+	uint32_t v1;
+	uint32_t v2;
+	uint32_t v3;
+	uint8_t vis;
+};
+
+struct MapPlaceable
+{
+	float x, y, z;
+	float x_rot, y_rot, z_rot;
+	float x_scale, y_scale, z_scale;
+};
+
+struct MapPlaceableGroup
+{
+	float x, y, z;
+	float x_rot, y_rot, z_rot;
+	float x_scale, y_scale, z_scale;
+	float x_tile, y_tile, z_tile;
+};
+#pragma pack()
+
+static_assert(sizeof(glm::vec3) == sizeof(float) * 3, "glm::vec3 must be tightly packed to be written as an array");
+static_assert(sizeof(MapModelPoly) == 13, "MapModelPoly must match the on disk poly layout");
+
 bool Map::Write(std::string filename) {
 	//if there are no verts and no terrain
 	if ((collide_verts.size() == 0 && collide_indices.size() == 0 && non_collide_verts.size() == 0 && non_collide_indices.size() == 0) && !terrain) {
@@ -58,21 +106,6 @@ bool Map::Write(std::string filename) {
 		return false;
 	}
 
-	FILE *f = fopen(filename.c_str(), "wb");
-
-	if(!f) {
-		eqLogMessage(LogError, "Failed to write %s because the file could not be opened to write.", filename.c_str());
-		return false;
-	}
-	
-	uint32_t version = 0x02000000;
-	if (fwrite(&version, sizeof(uint32_t), 1, f) != 1) {
-		eqLogMessage(LogError, "Failed to write %s because the version header could not be written.", filename.c_str());
-		fclose(f);
-		return false;
-	}
-	
-	std::stringstream ss(std::stringstream::in | std::stringstream::out | std::stringstream::binary);
 	uint32_t collide_vert_count = (uint32_t)collide_verts.size();
 	uint32_t collide_ind_count = (uint32_t)collide_indices.size();
 	uint32_t non_collide_vert_count = (uint32_t)non_collide_verts.size();
@@ -83,53 +116,107 @@ bool Map::Write(std::string filename) {
 	uint32_t tile_count = terrain ? (uint32_t)terrain->GetTiles().size() : 0;
 	uint32_t quads_per_tile = terrain ? terrain->GetQuadsPerTile() : 0;
 	float units_per_vertex = terrain ? terrain->GetUnitsPerVertex() : 0.0f;
-	
-	ss.write((const char*)&collide_vert_count, sizeof(uint32_t));
-	ss.write((const char*)&collide_ind_count, sizeof(uint32_t));
-	ss.write((const char*)&non_collide_vert_count, sizeof(uint32_t));
-	ss.write((const char*)&non_collide_ind_count, sizeof(uint32_t));
-	ss.write((const char*)&model_count, sizeof(uint32_t));
-	ss.write((const char*)&plac_count, sizeof(uint32_t));
-	ss.write((const char*)&plac_group_count, sizeof(uint32_t));
-	ss.write((const char*)&tile_count, sizeof(uint32_t));
-	ss.write((const char*)&quads_per_tile, sizeof(uint32_t));
-	ss.write((const char*)&units_per_vertex, sizeof(float));
-
-	for(uint32_t i = 0; i < collide_vert_count; ++i) {
-		auto vert = collide_verts[i];
-	
-		ss.write((const char*)&vert.x, sizeof(float));
-		ss.write((const char*)&vert.y, sizeof(float));
-		ss.write((const char*)&vert.z, sizeof(float));
+	uint32_t quad_count = (quads_per_tile * quads_per_tile);
+	uint32_t vert_count = ((quads_per_tile + 1) * (quads_per_tile + 1));
+
+	//work out the exact uncompressed size up front from the counts so the header can be written before the data
+	uint64_t uncompressed_size = sizeof(uint32_t) * 9 + sizeof(float);
+	uncompressed_size += (uint64_t)collide_vert_count * sizeof(glm::vec3) + (uint64_t)collide_ind_count * sizeof(uint32_t);
+	uncompressed_size += (uint64_t)non_collide_vert_count * sizeof(glm::vec3) + (uint64_t)non_collide_ind_count * sizeof(uint32_t);
+
+	for (auto &model : map_models) {
+		uncompressed_size += model.second->GetName().length() + 1 + sizeof(uint32_t) * 2;
+		uncompressed_size += model.second->GetVertices().size() * sizeof(glm::vec3) + model.second->GetPolygons().size() * sizeof(MapModelPoly);
 	}
-	
-	for (uint32_t i = 0; i < collide_ind_count; ++i) {
-		uint32_t ind = collide_indices[i];
-	
-		ss.write((const char*)&ind, sizeof(uint32_t));
+
+	for (auto &model : map_eqg_models) {
+		uncompressed_size += model.second->GetName().length() + 1 + sizeof(uint32_t) * 2;
+		uncompressed_size += model.second->GetVertices().size() * sizeof(glm::vec3) + model.second->GetPolygons().size() * sizeof(MapModelPoly);
 	}
-	
-	for(uint32_t i = 0; i < non_collide_vert_count; ++i) {
-		auto vert = non_collide_verts[i];
-	
-		ss.write((const char*)&vert.x, sizeof(float));
-		ss.write((const char*)&vert.y, sizeof(float));
-		ss.write((const char*)&vert.z, sizeof(float));
+
+	for (auto &plac : map_placeables) {
+		uncompressed_size += plac->GetFileName().length() + 1 + sizeof(MapPlaceable);
+	}
+
+	for (auto &gp : map_group_placeables) {
+		uncompressed_size += sizeof(MapPlaceableGroup) + sizeof(uint32_t);
+		for (auto &plac : gp->GetPlaceables()) {
+			uncompressed_size += plac->GetFileName().length() + 1 + sizeof(MapPlaceable);
+		}
+	}
+
+	if (terrain) {
+		auto &tiles = terrain->GetTiles();
+		for (uint32_t i = 0; i < tile_count; ++i) {
+			if (tiles[i]->IsFlat()) {
+				uncompressed_size += sizeof(bool) + sizeof(float) * 3;
+			}
+			else {
+				if (tiles[i]->GetFlags().size() < quad_count || tiles[i]->GetFloats().size() < vert_count) {
+					eqLogMessage(LogError, "Failed to write %s because terrain tile %u is missing height or flag data.", filename.c_str(), i);
+					return false;
+				}
+
+				uncompressed_size += sizeof(bool) + sizeof(float) * 2 + quad_count * sizeof(uint8_t) + vert_count * sizeof(float);
+			}
+		}
+	}
+
+	if (uncompressed_size > 0xFFFFFFFFULL) {
+		eqLogMessage(LogError, "Failed to write %s because the map is too large for the v2 format.", filename.c_str());
+		return false;
+	}
+
+	FILE *f = fopen(filename.c_str(), "wb");
+
+	if(!f) {
+		eqLogMessage(LogError, "Failed to write %s because the file could not be opened to write.", filename.c_str());
+		return false;
 	}
 	
-	for (uint32_t i = 0; i < non_collide_ind_count; ++i) {
-		uint32_t ind = non_collide_indices[i];
-	
-		ss.write((const char*)&ind, sizeof(uint32_t));
+	uint32_t version = 0x02000000;
+	if (fwrite(&version, sizeof(uint32_t), 1, f) != 1) {
+		eqLogMessage(LogError, "Failed to write %s because the version header could not be written.", filename.c_str());
+		fclose(f);
+		return false;
 	}
 
-	auto model_iter = map_models.begin();
-	while(model_iter != map_models.end()) {
-		uint8_t null = 0;
+	//compressed size isn't known until the stream is finished, it gets patched in at the end
+	uint32_t out_size = 0;
+	if (fwrite(&out_size, sizeof(uint32_t), 1, f) != 1) {
+		eqLogMessage(LogError, "Failed to write %s because the compressed size header could not be written.", filename.c_str());
+		fclose(f);
+		return false;
+	}
 
-		ss.write(model_iter->second->GetName().c_str(), model_iter->second->GetName().length());
-		ss.write((const char*)&null, sizeof(uint8_t));
+	uint32_t expected_size = (uint32_t)uncompressed_size;
+	if (fwrite(&expected_size, sizeof(uint32_t), 1, f) != 1) {
+		eqLogMessage(LogError, "Failed to write %s because the uncompressed size header could not be written.", filename.c_str());
+		fclose(f);
+		return false;
+	}
 
+	EQEmu::DeflateFileWriter out(f, expected_size);
+	out.Write(collide_vert_count);
+	out.Write(collide_ind_count);
+	out.Write(non_collide_vert_count);
+	out.Write(non_collide_ind_count);
+	out.Write(model_count);
+	out.Write(plac_count);
+	out.Write(plac_group_count);
+	out.Write(tile_count);
+	out.Write(quads_per_tile);
+	out.Write(units_per_vertex);
+
+	out.WriteArray(collide_verts);
+	out.WriteArray(collide_indices);
+	out.WriteArray(non_collide_verts);
+	out.WriteArray(non_collide_indices);
+
+	std::vector<glm::vec3> model_verts;
+	std::vector<MapModelPoly> model_polys;
+	auto model_iter = map_models.begin();
+	while(model_iter != map_models.end()) {
 		auto &verts = model_iter->second->GetVertices();
 		auto &polys = model_iter->second->GetPolygons();
 		uint32_t vert_count = (uint32_t)verts.size();
@@ -141,23 +228,14 @@ bool Map::Write(std::string filename) {
 			eqLogMessage(LogTrace, "Texture set for model %s with flag %u", model_iter->second->GetName().c_str(), set->GetFlags());
 		} 
 
-		ss.write((const char*)&vert_count, sizeof(uint32_t));
-		ss.write((const char*)&poly_count, sizeof(uint32_t));
+		model_verts.resize(vert_count);
 		for(uint32_t i = 0; i < vert_count; ++i) {
-			auto &vert = verts[i];
-			float x = vert.pos.x;
-			float y = vert.pos.y;
-			float z = vert.pos.z;
-			ss.write((const char*)&x, sizeof(float));
-			ss.write((const char*)&y, sizeof(float));
-			ss.write((const char*)&z, sizeof(float));
+			model_verts[i] = verts[i].pos;
 		}
 
+		model_polys.resize(poly_count);
 		for (uint32_t i = 0; i < poly_count; ++i) {
 			auto &poly = polys[i];
-			uint32_t v1 = poly.verts[0];
-			uint32_t v2 = poly.verts[1];
-			uint32_t v3 = poly.verts[2];
 			uint8_t vis = poly.flags == 0x10 ? 0 : 1;
 			
 			if (poly.tex < textureSet.size()) {
@@ -168,201 +246,142 @@ bool Map::Write(std::string filename) {
 				}
 			}
 
-			ss.write((const char*)&v1, sizeof(uint32_t));
-			ss.write((const char*)&v2, sizeof(uint32_t));
-			ss.write((const char*)&v3, sizeof(uint32_t));
-			ss.write((const char*)&vis, sizeof(uint8_t));
+			model_polys[i].v1 = poly.verts[0];
+			model_polys[i].v2 = poly.verts[1];
+			model_polys[i].v3 = poly.verts[2];
+			model_polys[i].vis = vis;
 		}
 
+		out.Write(model_iter->second->GetName().c_str(), model_iter->second->GetName().length() + 1);
+		out.Write(vert_count);
+		out.Write(poly_count);
+		out.WriteArray(model_verts);
+		out.WriteArray(model_polys);
+
 		++model_iter;
 	}
 
 	auto eqg_model_iter = map_eqg_models.begin();
 	while (eqg_model_iter != map_eqg_models.end()) {
-		uint8_t null = 0;
-
-		ss.write(eqg_model_iter->second->GetName().c_str(), eqg_model_iter->second->GetName().length());
-		ss.write((const char*)&null, sizeof(uint8_t));
-
 		auto &verts = eqg_model_iter->second->GetVertices();
 		auto &polys = eqg_model_iter->second->GetPolygons();
 		uint32_t vert_count = (uint32_t)verts.size();
 		uint32_t poly_count = (uint32_t)polys.size();
 
-		ss.write((const char*)&vert_count, sizeof(uint32_t));
-		ss.write((const char*)&poly_count, sizeof(uint32_t));
+		model_verts.resize(vert_count);
 		for (uint32_t i = 0; i < vert_count; ++i) {
-			auto &vert = verts[i];
-			float x = vert.pos.x;
-			float y = vert.pos.y;
-			float z = vert.pos.z;
-			ss.write((const char*)&x, sizeof(float));
-			ss.write((const char*)&y, sizeof(float));
-			ss.write((const char*)&z, sizeof(float));
+			model_verts[i] = verts[i].pos;
 		}
 
+		model_polys.resize(poly_count);
 		for (uint32_t i = 0; i < poly_count; ++i) {
 			auto &poly = polys[i];
-			uint32_t v1 = poly.verts[0];
-			uint32_t v2 = poly.verts[1];
-			uint32_t v3 = poly.verts[2];
-
-			uint8_t vis = 1;
-			if (poly.flags & 0x01)
-				vis = 0;
-
-			ss.write((const char*)&v1, sizeof(uint32_t));
-			ss.write((const char*)&v2, sizeof(uint32_t));
-			ss.write((const char*)&v3, sizeof(uint32_t));
-			ss.write((const char*)&vis, sizeof(uint8_t));
+			model_polys[i].v1 = poly.verts[0];
+			model_polys[i].v2 = poly.verts[1];
+			model_polys[i].v3 = poly.verts[2];
+			model_polys[i].vis = (poly.flags & 0x01) ? 0 : 1;
 		}
 
+		out.Write(eqg_model_iter->second->GetName().c_str(), eqg_model_iter->second->GetName().length() + 1);
+		out.Write(vert_count);
+		out.Write(poly_count);
+		out.WriteArray(model_verts);
+		out.WriteArray(model_polys);
+
 		++eqg_model_iter;
 	}
 
 	for (uint32_t i = 0; i < plac_count; ++i) {
 		auto &plac = map_placeables[i];
-		uint8_t null = 0;
-		float x = plac->GetX();
-		float y = plac->GetY();
-		float z = plac->GetZ();
-		float x_rot = plac->GetRotateX();
-		float y_rot = plac->GetRotateY();
-		float z_rot = plac->GetRotateZ();
-		float x_scale = plac->GetScaleX();
-		float y_scale = plac->GetScaleY();
-		float z_scale = plac->GetScaleZ();
-
-		ss.write(plac->GetFileName().c_str(), plac->GetFileName().length());
-		ss.write((const char*)&null, sizeof(uint8_t));
-		ss.write((const char*)&x, sizeof(float));
-		ss.write((const char*)&y, sizeof(float));
-		ss.write((const char*)&z, sizeof(float));
-		ss.write((const char*)&x_rot, sizeof(float));
-		ss.write((const char*)&y_rot, sizeof(float));
-		ss.write((const char*)&z_rot, sizeof(float));
-		ss.write((const char*)&x_scale, sizeof(float));
-		ss.write((const char*)&y_scale, sizeof(float));
-		ss.write((const char*)&z_scale, sizeof(float));
+		MapPlaceable p;
+		p.x = plac->GetX();
+		p.y = plac->GetY();
+		p.z = plac->GetZ();
+		p.x_rot = plac->GetRotateX();
+		p.y_rot = plac->GetRotateY();
+		p.z_rot = plac->GetRotateZ();
+		p.x_scale = plac->GetScaleX();
+		p.y_scale = plac->GetScaleY();
+		p.z_scale = plac->GetScaleZ();
+
+		out.Write(plac->GetFileName().c_str(), plac->GetFileName().length() + 1);
+		out.Write(p);
 	}
 
 	for (uint32_t i = 0; i < plac_group_count; ++i) {
 		auto &gp = map_group_placeables[i];
-		uint8_t null = 0;
-		float x = gp->GetX();
-		float y = gp->GetY();
-		float z = gp->GetZ();
-		float x_rot = gp->GetRotationX();
-		float y_rot = gp->GetRotationY();
-		float z_rot = gp->GetRotationZ();
-		float x_scale = gp->GetScaleX();
-		float y_scale = gp->GetScaleY();
-		float z_scale = gp->GetScaleZ();
-		float x_tile = gp->GetTileX();
-		float y_tile = gp->GetTileY();
-		float z_tile = gp->GetTileZ();
-
-		ss.write((const char*)&x, sizeof(float));
-		ss.write((const char*)&y, sizeof(float));
-		ss.write((const char*)&z, sizeof(float));
-		ss.write((const char*)&x_rot, sizeof(float));
-		ss.write((const char*)&y_rot, sizeof(float));
-		ss.write((const char*)&z_rot, sizeof(float));
-		ss.write((const char*)&x_scale, sizeof(float));
-		ss.write((const char*)&y_scale, sizeof(float));
-		ss.write((const char*)&z_scale, sizeof(float));
-		ss.write((const char*)&x_tile, sizeof(float));
-		ss.write((const char*)&y_tile, sizeof(float));
-		ss.write((const char*)&z_tile, sizeof(float));
+		MapPlaceableGroup g;
+		g.x = gp->GetX();
+		g.y = gp->GetY();
+		g.z = gp->GetZ();
+		g.x_rot = gp->GetRotationX();
+		g.y_rot = gp->GetRotationY();
+		g.z_rot = gp->GetRotationZ();
+		g.x_scale = gp->GetScaleX();
+		g.y_scale = gp->GetScaleY();
+		g.z_scale = gp->GetScaleZ();
+		g.x_tile = gp->GetTileX();
+		g.y_tile = gp->GetTileY();
+		g.z_tile = gp->GetTileZ();
 
 		auto &placs = gp->GetPlaceables();
 		uint32_t plac_count = (uint32_t)placs.size();
-		ss.write((const char*)&plac_count, sizeof(uint32_t));
+		out.Write(g);
+		out.Write(plac_count);
 		
 		for (uint32_t j = 0; j < plac_count; ++j) {
 			auto &plac = placs[j];
-			float x = plac->GetX();
-			float y = plac->GetY();
-			float z = plac->GetZ();
-			float x_rot = plac->GetRotateX();
-			float y_rot = plac->GetRotateY();
-			float z_rot = plac->GetRotateZ();
-			float x_scale = plac->GetScaleX();
-			float y_scale = plac->GetScaleY();
-			float z_scale = plac->GetScaleZ();
-
-			ss.write(plac->GetFileName().c_str(), plac->GetFileName().length());
-			ss.write((const char*)&null, sizeof(uint8_t));
-			ss.write((const char*)&x, sizeof(float));
-			ss.write((const char*)&y, sizeof(float));
-			ss.write((const char*)&z, sizeof(float));
-			ss.write((const char*)&x_rot, sizeof(float));
-			ss.write((const char*)&y_rot, sizeof(float));
-			ss.write((const char*)&z_rot, sizeof(float));
-			ss.write((const char*)&x_scale, sizeof(float));
-			ss.write((const char*)&y_scale, sizeof(float));
-			ss.write((const char*)&z_scale, sizeof(float));
+			MapPlaceable p;
+			p.x = plac->GetX();
+			p.y = plac->GetY();
+			p.z = plac->GetZ();
+			p.x_rot = plac->GetRotateX();
+			p.y_rot = plac->GetRotateY();
+			p.z_rot = plac->GetRotateZ();
+			p.x_scale = plac->GetScaleX();
+			p.y_scale = plac->GetScaleY();
+			p.z_scale = plac->GetScaleZ();
+
+			out.Write(plac->GetFileName().c_str(), plac->GetFileName().length() + 1);
+			out.Write(p);
 		}
 	}
 
 	if(terrain) {
-		uint32_t quad_count = (quads_per_tile * quads_per_tile);
-		uint32_t vert_count = ((quads_per_tile + 1) * (quads_per_tile + 1));
 		auto &tiles = terrain->GetTiles();
 		for (uint32_t i = 0; i < tile_count; ++i) {
-			if(tiles[i]->IsFlat()) {
-				bool flat = true;
-				float x = tiles[i]->GetX();
-				float y = tiles[i]->GetY();
+			bool flat = tiles[i]->IsFlat();
+			float x = tiles[i]->GetX();
+			float y = tiles[i]->GetY();
+			out.Write(flat);
+			out.Write(x);
+			out.Write(y);
+
+			if(flat) {
 				float z = tiles[i]->GetFloats()[0];
-				ss.write((const char*)&flat, sizeof(bool));
-				ss.write((const char*)&x, sizeof(float));
-				ss.write((const char*)&y, sizeof(float));
-				ss.write((const char*)&z, sizeof(float));
+				out.Write(z);
 			} else {
-				bool flat = false;
-				float x = tiles[i]->GetX();
-				float y = tiles[i]->GetY();
-				ss.write((const char*)&flat, sizeof(bool));
-				ss.write((const char*)&x, sizeof(float));
-				ss.write((const char*)&y, sizeof(float));
-
-				auto &flags = tiles[i]->GetFlags();
-				for(uint32_t j = 0; j < quad_count; ++j) {
-					uint8_t f = flags[j];
-					ss.write((const char*)&f, sizeof(uint8_t));
-				}
-
-				auto &floats = tiles[i]->GetFloats();
-				for (uint32_t j = 0; j < vert_count; ++j) {
-					float f = floats[j];
-					ss.write((const char*)&f, sizeof(float));
-				}
+				out.Write(&tiles[i]->GetFlags()[0], quad_count * sizeof(uint8_t));
+				out.Write(&tiles[i]->GetFloats()[0], vert_count * sizeof(float));
 			}
 		}
 	}
-	
-	std::vector<char> buffer;
-	uint32_t buffer_len = (uint32_t)(ss.str().length() + 128);
-	buffer.resize(buffer_len);
 
-	uint32_t out_size = EQEmu::DeflateData(ss.str().c_str(), (uint32_t)ss.str().length(), &buffer[0], buffer_len);
-	if (fwrite(&out_size, sizeof(uint32_t), 1, f) != 1) {
-		eqLogMessage(LogError, "Failed to write %s because the compressed size header could not be written.", filename.c_str());
+	if (!out.Finish()) {
+		eqLogMessage(LogError, "Failed to write %s because the compressed data could not be written.", filename.c_str());
 		fclose(f);
 		return false;
 	}
-	
-	uint32_t uncompressed_size = (uint32_t)ss.str().length();
-	if (fwrite(&uncompressed_size, sizeof(uint32_t), 1, f) != 1) {
-		eqLogMessage(LogError, "Failed to write %s because the uncompressed size header could not be written.", filename.c_str());
+
+	if (out.GetUncompressedSize() != expected_size) {
+		eqLogMessage(LogError, "Failed to write %s because %u bytes were written but %u were expected.", filename.c_str(), out.GetUncompressedSize(), expected_size);
 		fclose(f);
 		return false;
 	}
 
-
-	if (fwrite(&buffer[0], out_size, 1, f) != 1) {
-		eqLogMessage(LogError, "Failed to write %s because the compressed data could not be written.", filename.c_str());
+	out_size = out.GetCompressedSize();
+	if (fseek(f, sizeof(uint32_t), SEEK_SET) != 0 || fwrite(&out_size, sizeof(uint32_t), 1, f) != 1) {
+		eqLogMessage(LogError, "Failed to write %s because the compressed size header could not be written.", filename.c_str());
 		fclose(f);
 		return false;
 	}
@@ -445,10 +464,8 @@ bool Map::CompileS3D(
 	collide_indices.clear();
 	non_collide_verts.clear();
 	non_collide_indices.clear();
-	current_collide_index = 0;
-	current_non_collide_index = 0;
-	collide_vert_to_index.clear();
-	non_collide_vert_to_index.clear();
+	collide_faces.clear();
+	non_collide_faces.clear();
 	map_models.clear();
 	map_eqg_models.clear();
 	map_placeables.clear();
@@ -630,6 +647,7 @@ bool Map::CompileS3D(
 		}
 	}
 
+	WeldFaces();
 	return true;
 }
 
@@ -644,10 +662,8 @@ bool Map::CompileEQG(
 	collide_indices.clear();
 	non_collide_verts.clear();
 	non_collide_indices.clear();
-	current_collide_index = 0;
-	current_non_collide_index = 0;
-	collide_vert_to_index.clear();
-	non_collide_vert_to_index.clear();
+	collide_faces.clear();
+	non_collide_faces.clear();
 	map_models.clear();
 	map_eqg_models.clear();
 	map_placeables.clear();
@@ -733,6 +749,7 @@ bool Map::CompileEQG(
 		}
 	}
 
+	WeldFaces();
 	return true;
 }
 
@@ -742,10 +759,8 @@ bool Map::CompileEQGv4()
 	collide_indices.clear();
 	non_collide_verts.clear();
 	non_collide_indices.clear();
-	current_collide_index = 0;
-	current_non_collide_index = 0;
-	collide_vert_to_index.clear();
-	non_collide_vert_to_index.clear();
+	collide_faces.clear();
+	non_collide_faces.clear();
 	map_models.clear();
 	map_eqg_models.clear();
 	map_placeables.clear();
@@ -780,35 +795,22 @@ bool Map::CompileEQGv4()
 				float QuadVertex4Y = QuadVertex3Y;
 				float QuadVertex4Z = QuadVertex1Z;
 
-				uint32_t current_vert = (uint32_t)non_collide_verts.size() + 3;
-				non_collide_verts.push_back(glm::vec3(QuadVertex1X, QuadVertex1Y, QuadVertex1Z));
-				non_collide_verts.push_back(glm::vec3(QuadVertex2X, QuadVertex2Y, QuadVertex2Z));
-				non_collide_verts.push_back(glm::vec3(QuadVertex3X, QuadVertex3Y, QuadVertex3Z));
-				non_collide_verts.push_back(glm::vec3(QuadVertex4X, QuadVertex4Y, QuadVertex4Z));
-				
-				non_collide_indices.push_back(current_vert);
-				non_collide_indices.push_back(current_vert - 2);
-				non_collide_indices.push_back(current_vert - 1);
+				glm::vec3 v1(QuadVertex1X, QuadVertex1Y, QuadVertex1Z);
+				glm::vec3 v2(QuadVertex2X, QuadVertex2Y, QuadVertex2Z);
+				glm::vec3 v3(QuadVertex3X, QuadVertex3Y, QuadVertex3Z);
+				glm::vec3 v4(QuadVertex4X, QuadVertex4Y, QuadVertex4Z);
 
-				non_collide_indices.push_back(current_vert);
-				non_collide_indices.push_back(current_vert - 3);
-				non_collide_indices.push_back(current_vert - 2);
+				AddFace(v4, v2, v3, false);
+				AddFace(v4, v1, v2, false);
 			}
 		} else {
-			uint32_t id = (uint32_t)non_collide_verts.size();
-
-			non_collide_verts.push_back(glm::vec3(sheet->GetMinY(), sheet->GetMinX(), sheet->GetZHeight()));
-			non_collide_verts.push_back(glm::vec3(sheet->GetMinY(), sheet->GetMaxX(), sheet->GetZHeight()));
-			non_collide_verts.push_back(glm::vec3(sheet->GetMaxY(), sheet->GetMinX(), sheet->GetZHeight()));
-			non_collide_verts.push_back(glm::vec3(sheet->GetMaxY(), sheet->GetMaxX(), sheet->GetZHeight()));
-
-			non_collide_indices.push_back(id);
-			non_collide_indices.push_back(id + 1);
-			non_collide_indices.push_back(id + 2);
+			glm::vec3 v1(sheet->GetMinY(), sheet->GetMinX(), sheet->GetZHeight());
+			glm::vec3 v2(sheet->GetMinY(), sheet->GetMaxX(), sheet->GetZHeight());
+			glm::vec3 v3(sheet->GetMaxY(), sheet->GetMinX(), sheet->GetZHeight());
+			glm::vec3 v4(sheet->GetMaxY(), sheet->GetMaxX(), sheet->GetZHeight());
 
-			non_collide_indices.push_back(id + 1);
-			non_collide_indices.push_back(id + 3);
-			non_collide_indices.push_back(id + 2);
+			AddFace(v1, v2, v3, false);
+			AddFace(v2, v4, v3, false);
 		}
 	}
 
@@ -865,6 +867,7 @@ bool Map::CompileEQGv4()
 		map_group_placeables.push_back(pgs[i]);
 	}
 
+	WeldFaces();
 	return true;
 }
 
@@ -883,92 +886,37 @@ void Map::LoadIgnore(std::string zone_name)
 }
 
 void Map::AddFace(glm::vec3 &v1, glm::vec3 &v2, glm::vec3 &v3, bool collidable) {
-	if (!collidable) {
-		std::tuple<float, float, float> tt = std::make_tuple(v1.x, v1.y, v1.z);
-		auto iter = non_collide_vert_to_index.find(tt);
-		if (iter == non_collide_vert_to_index.end()) {
-			non_collide_vert_to_index[tt] = current_non_collide_index;
-			non_collide_verts.push_back(v1);
-			non_collide_indices.push_back(current_non_collide_index);
-
-			++current_non_collide_index;
-		}
-		else {
-			uint32_t t_idx = iter->second;
-			non_collide_indices.push_back(t_idx);
-		}
+	std::vector<glm::vec3> &faces = collidable ? collide_faces : non_collide_faces;
+	faces.push_back(v1);
+	faces.push_back(v2);
+	faces.push_back(v3);
+}
 
-		tt = std::make_tuple(v2.x, v2.y, v2.z);
-		iter = non_collide_vert_to_index.find(tt);
-		if (iter == non_collide_vert_to_index.end()) {
-			non_collide_vert_to_index[tt] = current_non_collide_index;
-			non_collide_verts.push_back(v2);
-			non_collide_indices.push_back(current_non_collide_index);
+void Map::WeldFaces() {
+	VertexWelder::WeldSoup(collide_faces, weld_epsilon, thread_pool, collide_verts, collide_indices);
+	eqLogMessage(LogTrace, "Welded %u collidable face verts into %u verts.", (uint32_t)collide_faces.size(), (uint32_t)collide_verts.size());
 
-			++current_non_collide_index;
-		}
-		else {
-			uint32_t t_idx = iter->second;
-			non_collide_indices.push_back(t_idx);
-		}
+	VertexWelder::WeldSoup(non_collide_faces, weld_epsilon, thread_pool, non_collide_verts, non_collide_indices);
+	eqLogMessage(LogTrace, "Welded %u non-collidable face verts into %u verts.", (uint32_t)non_collide_faces.size(), (uint32_t)non_collide_verts.size());
 
-		tt = std::make_tuple(v3.x, v3.y, v3.z);
-		iter = non_collide_vert_to_index.find(tt);
-		if (iter == non_collide_vert_to_index.end()) {
-			non_collide_vert_to_index[tt] = current_non_collide_index;
-			non_collide_verts.push_back(v3);
-			non_collide_indices.push_back(current_non_collide_index);
+	collide_faces.clear();
+	collide_faces.shrink_to_fit();
+	non_collide_faces.clear();
+	non_collide_faces.shrink_to_fit();
+}
 
-			++current_non_collide_index;
-		}
-		else {
-			uint32_t t_idx = iter->second;
-			non_collide_indices.push_back(t_idx);
-		}
+void Map::SimplifyMesh(std::vector<glm::vec3> &verts, std::vector<uint32_t> &inds, const char *name) {
+	if (simplify_error <= 0.0f || inds.empty()) {
+		return;
 	}
-	else {
-		std::tuple<float, float, float> tt = std::make_tuple(v1.x, v1.y, v1.z);
-		auto iter = collide_vert_to_index.find(tt);
-		if (iter == collide_vert_to_index.end()) {
-			collide_vert_to_index[tt] = current_collide_index;
-			collide_verts.push_back(v1);
-			collide_indices.push_back(current_collide_index);
-
-			++current_collide_index;
-		}
-		else {
-			uint32_t t_idx = iter->second;
-			collide_indices.push_back(t_idx);
-		}
 
-		tt = std::make_tuple(v2.x, v2.y, v2.z);
-		iter = collide_vert_to_index.find(tt);
-		if (iter == collide_vert_to_index.end()) {
-			collide_vert_to_index[tt] = current_collide_index;
-			collide_verts.push_back(v2);
-			collide_indices.push_back(current_collide_index);
+	MeshSimplifier simplifier(simplify_error);
+	simplifier.Simplify(verts, inds);
 
-			++current_collide_index;
-		}
-		else {
-			uint32_t t_idx = iter->second;
-			collide_indices.push_back(t_idx);
-		}
-
-		tt = std::make_tuple(v3.x, v3.y, v3.z);
-		iter = collide_vert_to_index.find(tt);
-		if (iter == collide_vert_to_index.end()) {
-			collide_vert_to_index[tt] = current_collide_index;
-			collide_verts.push_back(v3);
-			collide_indices.push_back(current_collide_index);
-
-			++current_collide_index;
-		}
-		else {
-			uint32_t t_idx = iter->second;
-			collide_indices.push_back(t_idx);
-		}
-	}
+	uint32_t before = simplifier.GetTrianglesBefore();
+	uint32_t after = simplifier.GetTrianglesAfter();
+	eqLogMessage(LogInfo, "Simplified %s collision mesh from %u to %u triangles (%.1f%%).", name, before, after,
+		before > 0 ? 100.0f * (float)after / (float)before : 100.0f);
 }
 
 void Map::RotateVertex(glm::vec3 &v, float rx, float ry, float rz) {
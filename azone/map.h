@@ -5,12 +5,12 @@
 #include <vector>
 #include <string>
 #include <map>
-#include <tuple>
 #define GLM_FORCE_RADIANS
 #include <glm.hpp>
 #include "s3d_loader.h"
 #include "eqg_loader.h"
 #include "eqg_v4_loader.h"
+#include "thread_pool.h"
 
 class Map
 {
@@ -20,7 +20,14 @@ public:
 	
 	bool Build(std::string zone_name, bool ignore_collide_tex);
 	bool Write(std::string filename);
+	bool WriteV3(std::string filename);
+
+	void SetWeldEpsilon(float epsilon) { weld_epsilon = epsilon; }
+	void SetThreadPool(EQEmu::ThreadPool *pool) { thread_pool = pool; }
+	void SetSimplifyError(float error) { simplify_error = error; }
+	void SetReorder(bool value) { reorder = value; }
 private:
+	bool BuildGeometry(std::string zone_name, bool ignore_collide_tex);
 	void TraverseBone(std::shared_ptr<EQEmu::S3D::SkeletonTrack::Bone> bone, glm::vec3 parent_trans, glm::vec3 parent_rot, glm::vec3 parent_scale);
 
 	bool CompileS3D(
@@ -38,7 +45,10 @@ private:
 	bool CompileEQGv4();
 	void LoadIgnore(std::string zone_name);
 
+	void BakeTerrain(std::vector<glm::vec3> &verts, std::vector<uint32_t> &inds);
 	void AddFace(glm::vec3 &v1, glm::vec3 &v2, glm::vec3 &v3, bool collidable);
+	void WeldFaces();
+	void SimplifyMesh(std::vector<glm::vec3> &verts, std::vector<uint32_t> &inds, const char *name);
 
 	void RotateVertex(glm::vec3 &v, float rx, float ry, float rz);
 	void ScaleVertex(glm::vec3 &v, float sx, float sy, float sz);
@@ -50,11 +60,12 @@ private:
 	std::vector<glm::vec3> non_collide_verts;
 	std::vector<uint32_t> non_collide_indices;
 
-	uint32_t current_collide_index;
-	uint32_t current_non_collide_index;
-
-	std::map<std::tuple<float, float, float>, uint32_t> collide_vert_to_index;
-	std::map<std::tuple<float, float, float>, uint32_t> non_collide_vert_to_index;
+	std::vector<glm::vec3> collide_faces;
+	std::vector<glm::vec3> non_collide_faces;
+	float weld_epsilon;
+	float simplify_error;
+	bool reorder;
+	EQEmu::ThreadPool *thread_pool;
 
 	std::shared_ptr<EQEmu::EQG::Terrain> terrain;
 	std::map<std::string, std::shared_ptr<EQEmu::S3D::Geometry>> map_models;
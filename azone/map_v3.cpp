@@ -0,0 +1,561 @@
+#include "map.h"
+#include "vertex_welder.h"
+#include "mesh_order.h"
+#include "zone_map_structs.h"
+#include "eq_math.h"
+#include "log_macros.h"
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+static const float MapV3DefaultTileSize = 256.0f;
+static const uint32_t MapV3MaxTilesPerAxis = 1024;
+
+struct MapV3PendingSection
+{
+	uint32_t type;
+	uint32_t element_size;
+	const void *data;
+	uint64_t count;
+};
+
+static glm::vec3 BakedToMapSpace(const glm::vec3 &v) {
+	return glm::vec3(v.x, v.z, v.y);
+}
+
+//(x, y, z) -> (y, z, x): the x/y swap the v2 loader applies to placeables followed by the y/z swap it applies to everything
+static glm::mat4 PlaceableToMapSpace() {
+	glm::mat4 m(0.0f);
+	m[1][0] = 1.0f;
+	m[2][1] = 1.0f;
+	m[0][2] = 1.0f;
+	m[3][3] = 1.0f;
+	return m;
+}
+
+static void StoreTransform(const glm::mat4 &m, float *out) {
+	for (int r = 0; r < 3; ++r) {
+		for (int c = 0; c < 4; ++c) {
+			out[r * 4 + c] = m[c][r];
+		}
+	}
+}
+
+static void ExpandBounds(const glm::vec3 &v, glm::vec3 &min, glm::vec3 &max, bool clip_low_y) {
+	if (v.x < min.x) {
+		min.x = v.x;
+	}
+
+	if (v.y < min.y && (!clip_low_y || v.y > -15000)) {
+		min.y = v.y;
+	}
+
+	if (v.z < min.z) {
+		min.z = v.z;
+	}
+
+	if (v.x > max.x) {
+		max.x = v.x;
+	}
+
+	if (v.y > max.y) {
+		max.y = v.y;
+	}
+
+	if (v.z > max.z) {
+		max.z = v.z;
+	}
+}
+
+static uint64_t AlignSection(uint64_t v) {
+	return (v + EQEmu::MapV3Alignment - 1) & ~((uint64_t)EQEmu::MapV3Alignment - 1);
+}
+
+void Map::BakeTerrain(std::vector<glm::vec3> &verts, std::vector<uint32_t> &inds) {
+	if (!terrain) {
+		return;
+	}
+
+	uint32_t quads_per_tile = terrain->GetQuadsPerTile();
+	float units_per_vertex = terrain->GetUnitsPerVertex();
+	uint32_t quad_count = (quads_per_tile * quads_per_tile);
+	uint32_t vert_count = ((quads_per_tile + 1) * (quads_per_tile + 1));
+
+	//one welder over every tile so neighbouring tiles share their edge verts
+	VertexWelder welder;
+	uint32_t base = (uint32_t)verts.size();
+	auto &tiles = terrain->GetTiles();
+	for (size_t i = 0; i < tiles.size(); ++i) {
+		auto &tile = tiles[i];
+		float x = tile->GetX();
+		float y = tile->GetY();
+
+		if (tile->IsFlat()) {
+			float z = tile->GetFloats()[0];
+			float extent = quads_per_tile * units_per_vertex;
+			uint32_t i1 = base + welder.Weld(glm::vec3(x, y, z));
+			uint32_t i2 = base + welder.Weld(glm::vec3(x + extent, y, z));
+			uint32_t i3 = base + welder.Weld(glm::vec3(x + extent, y + extent, z));
+			uint32_t i4 = base + welder.Weld(glm::vec3(x, y + extent, z));
+
+			inds.push_back(i4);
+			inds.push_back(i3);
+			inds.push_back(i2);
+
+			inds.push_back(i2);
+			inds.push_back(i1);
+			inds.push_back(i4);
+			continue;
+		}
+
+		auto &flags = tile->GetFlags();
+		auto &floats = tile->GetFloats();
+		if (flags.size() < quad_count || floats.size() < vert_count) {
+			continue;
+		}
+
+		//same triangulation the v2 loader does at load time
+		int row_number = -1;
+		for (uint32_t quad = 0; quad < quad_count; ++quad) {
+			if ((quad % quads_per_tile) == 0) {
+				++row_number;
+			}
+
+			if (flags[quad] & 0x01)
+				continue;
+
+			glm::vec3 v1(x + (row_number * units_per_vertex), y + (quad % quads_per_tile) * units_per_vertex, floats[quad + row_number]);
+			glm::vec3 v2(v1.x + units_per_vertex, v1.y, floats[quad + row_number + quads_per_tile + 1]);
+			glm::vec3 v3(v1.x + units_per_vertex, v1.y + units_per_vertex, floats[quad + row_number + quads_per_tile + 2]);
+			glm::vec3 v4(v1.x, v1.y + units_per_vertex, floats[quad + row_number + 1]);
+
+			uint32_t i1 = base + welder.Weld(v1);
+			uint32_t i2 = base + welder.Weld(v2);
+			uint32_t i3 = base + welder.Weld(v3);
+			uint32_t i4 = base + welder.Weld(v4);
+
+			inds.push_back(i4);
+			inds.push_back(i3);
+			inds.push_back(i2);
+
+			inds.push_back(i2);
+			inds.push_back(i1);
+			inds.push_back(i4);
+		}
+	}
+
+	auto &welded = welder.GetVerts();
+	verts.insert(verts.end(), welded.begin(), welded.end());
+}
+
+bool Map::WriteV3(std::string filename) {
+	if ((collide_verts.size() == 0 && collide_indices.size() == 0 && non_collide_verts.size() == 0 && non_collide_indices.size() == 0) && !terrain) {
+		eqLogMessage(LogError, "Failed to write %s because the map to build has no information to write.", filename.c_str());
+		return false;
+	}
+
+	EQEmu::map_v3_header header;
+	memset(&header, 0, sizeof(header));
+	header.version = EQEmu::MapV3Version;
+	memcpy(header.magic, MAP_V3_MAGIC, sizeof(header.magic));
+	header.header_size = sizeof(EQEmu::map_v3_header);
+	header.tile_size = MapV3DefaultTileSize;
+
+	//baked geometry: the compiled zone mesh plus the terrain, moved into map space
+	std::vector<glm::vec3> baked_verts = collide_verts;
+	std::vector<uint32_t> baked_inds = collide_indices;
+	std::vector<glm::vec3> terrain_verts;
+	std::vector<uint32_t> terrain_inds;
+	BakeTerrain(terrain_verts, terrain_inds);
+	SimplifyMesh(terrain_verts, terrain_inds, "terrain");
+
+	uint32_t terrain_base = (uint32_t)baked_verts.size();
+	baked_verts.insert(baked_verts.end(), terrain_verts.begin(), terrain_verts.end());
+	for (auto idx : terrain_inds) {
+		baked_inds.push_back(terrain_base + idx);
+	}
+
+	if (reorder && !terrain_inds.empty()) {
+		ReorderMeshMorton(baked_verts, baked_inds);
+	}
+
+	for (auto &v : baked_verts) {
+		v = BakedToMapSpace(v);
+	}
+
+	std::vector<glm::vec3> nc_verts(non_collide_verts.size());
+	for (size_t i = 0; i < non_collide_verts.size(); ++i) {
+		nc_verts[i] = BakedToMapSpace(non_collide_verts[i]);
+	}
+
+	//shared models
+	std::vector<EQEmu::map_v3_model> models;
+	std::vector<glm::vec3> model_verts;
+	std::vector<EQEmu::map_v3_poly> model_polys;
+	std::vector<char> strings;
+	std::map<std::string, uint32_t> model_index;
+
+	auto add_model = [&](const std::string &name, const std::vector<glm::vec3> &verts, std::vector<EQEmu::map_v3_poly> &polys) {
+		EQEmu::map_v3_model model;
+		memset(&model, 0, sizeof(model));
+		model.name_offset = (uint32_t)strings.size();
+		model.name_length = (uint32_t)name.length();
+		strings.insert(strings.end(), name.begin(), name.end());
+		strings.push_back(0);
+
+		model.first_vert = (uint32_t)model_verts.size();
+		model.vert_count = (uint32_t)verts.size();
+		model_verts.insert(model_verts.end(), verts.begin(), verts.end());
+
+		std::stable_partition(polys.begin(), polys.end(), [](const EQEmu::map_v3_poly &p) { return (p.flags & EQEmu::MapV3PolyCollidable) != 0; });
+		model.first_poly = (uint32_t)model_polys.size();
+		model.poly_count = (uint32_t)polys.size();
+		for (auto &p : polys) {
+			if (p.flags & EQEmu::MapV3PolyCollidable) {
+				++model.collide_poly_count;
+			}
+		}
+
+		model_polys.insert(model_polys.end(), polys.begin(), polys.end());
+
+		glm::vec3 min(FLT_MAX);
+		glm::vec3 max(-FLT_MAX);
+		for (auto &v : verts) {
+			min = glm::min(min, v);
+			max = glm::max(max, v);
+		}
+
+		if (verts.empty()) {
+			min = max = glm::vec3(0.0f);
+		}
+
+		model.min[0] = min.x;
+		model.min[1] = min.y;
+		model.min[2] = min.z;
+		model.max[0] = max.x;
+		model.max[1] = max.y;
+		model.max[2] = max.z;
+
+		model_index[name] = (uint32_t)models.size();
+		models.push_back(model);
+	};
+
+	std::vector<glm::vec3> verts;
+	std::vector<EQEmu::map_v3_poly> polys;
+	for (auto &iter : map_models) {
+		auto &model = iter.second;
+		auto textureSet = model->GetTextureBrushSet()->GetTextureSet();
+
+		verts.resize(model->GetVertices().size());
+		for (size_t i = 0; i < verts.size(); ++i) {
+			verts[i] = model->GetVertices()[i].pos;
+		}
+
+		polys.resize(model->GetPolygons().size());
+		for (size_t i = 0; i < polys.size(); ++i) {
+			auto &poly = model->GetPolygons()[i];
+			bool vis = poly.flags != 0x10;
+			if (poly.tex < textureSet.size() && textureSet[poly.tex]->GetFlags() == 1) {
+				vis = false;
+			}
+
+			polys[i].v1 = poly.verts[0];
+			polys[i].v2 = poly.verts[1];
+			polys[i].v3 = poly.verts[2];
+			polys[i].flags = vis ? EQEmu::MapV3PolyCollidable : 0;
+		}
+
+		add_model(model->GetName(), verts, polys);
+	}
+
+	for (auto &iter : map_eqg_models) {
+		auto &model = iter.second;
+
+		verts.resize(model->GetVertices().size());
+		for (size_t i = 0; i < verts.size(); ++i) {
+			verts[i] = model->GetVertices()[i].pos;
+		}
+
+		polys.resize(model->GetPolygons().size());
+		for (size_t i = 0; i < polys.size(); ++i) {
+			auto &poly = model->GetPolygons()[i];
+			polys[i].v1 = poly.verts[0];
+			polys[i].v2 = poly.verts[1];
+			polys[i].v3 = poly.verts[2];
+			polys[i].flags = (poly.flags & 0x01) ? 0 : EQEmu::MapV3PolyCollidable;
+		}
+
+		add_model(model->GetName(), verts, polys);
+	}
+
+	for (auto &model : models) {
+		for (uint32_t i = 0; i < model.poly_count; ++i) {
+			auto &poly = model_polys[model.first_poly + i];
+			if (poly.v1 >= model.vert_count || poly.v2 >= model.vert_count || poly.v3 >= model.vert_count) {
+				eqLogMessage(LogError, "Failed to write %s because model %s has a poly referencing a missing vertex.", filename.c_str(), &strings[model.name_offset]);
+				return false;
+			}
+		}
+	}
+
+	//placements, with the whole v2 load time transform chain folded into one matrix each
+	std::vector<EQEmu::map_v3_instance> instances;
+	glm::mat4 to_map_space = PlaceableToMapSpace();
+	auto add_instance = [&](const std::string &name, const glm::mat4 &transform) {
+		auto iter = model_index.find(name);
+		if (iter == model_index.end()) {
+			return;
+		}
+
+		EQEmu::map_v3_instance inst;
+		memset(&inst, 0, sizeof(inst));
+		inst.model = iter->second;
+		StoreTransform(to_map_space * transform, inst.transform);
+		instances.push_back(inst);
+	};
+
+	for (auto &plac : map_placeables) {
+		glm::mat4 transform = CreateTranslateMatrix(plac->GetX(), plac->GetY(), plac->GetZ()) *
+			CreateScaleMatrix(plac->GetScaleX(), plac->GetScaleY(), plac->GetScaleZ()) *
+			CreateRotateMatrix(plac->GetRotateX(), plac->GetRotateY(), plac->GetRotateZ());
+
+		add_instance(plac->GetFileName(), transform);
+	}
+
+	for (auto &gp : map_group_placeables) {
+		float x_rot = gp->GetRotationX() * 3.14159f / 180.0f;
+		float y_rot = gp->GetRotationY() * 3.14159f / 180.0f;
+		float z_rot = gp->GetRotationZ() * 3.14159f / 180.0f;
+
+		for (auto &plac : gp->GetPlaceables()) {
+			glm::vec3 p(plac->GetX(), plac->GetY(), plac->GetZ());
+			float p_x_rot = plac->GetRotateX() * 3.14159f / 180;
+			float p_y_rot = plac->GetRotateY() * 3.14159f / 180;
+			float p_z_rot = plac->GetRotateZ() * 3.14159f / 180;
+
+			glm::vec4 correction = CreateRotateMatrix(x_rot, 0.0f, 0.0f) * glm::vec4(p, 1.0f);
+
+			glm::mat4 transform = CreateScaleMatrix(plac->GetScaleX(), plac->GetScaleY(), plac->GetScaleZ());
+			transform = CreateTranslateMatrix(p.x, p.y, p.z) * transform;
+			transform = CreateRotateMatrix(x_rot, 0.0f, 0.0f) * transform;
+			transform = CreateRotateMatrix(0.0f, y_rot, 0.0f) * transform;
+			transform = CreateTranslateMatrix(-correction.x, -correction.y, -correction.z) * transform;
+			transform = CreateRotateMatrix(p_x_rot, 0.0f, 0.0f) * transform;
+			transform = CreateRotateMatrix(0.0f, -p_y_rot, 0.0f) * transform;
+			transform = CreateRotateMatrix(0.0f, 0.0f, p_z_rot) * transform;
+			transform = CreateTranslateMatrix(correction.x, correction.y, correction.z) * transform;
+			transform = CreateRotateMatrix(0.0f, 0.0f, z_rot) * transform;
+			transform = CreateScaleMatrix(gp->GetScaleX(), gp->GetScaleY(), gp->GetScaleZ()) * transform;
+			transform = CreateTranslateMatrix(gp->GetTileX(), gp->GetTileY(), gp->GetTileZ()) * transform;
+			transform = CreateTranslateMatrix(gp->GetX(), gp->GetY(), gp->GetZ()) * transform;
+
+			add_instance(plac->GetFileName(), transform);
+		}
+	}
+
+	//bounds the way the v2 loader computes them, including the instanced triangles
+	glm::vec3 collide_min(0.0f);
+	glm::vec3 collide_max(0.0f);
+	glm::vec3 nc_min(0.0f);
+	glm::vec3 nc_max(0.0f);
+	for (auto &v : baked_verts) {
+		ExpandBounds(v, collide_min, collide_max, true);
+	}
+
+	for (auto &v : nc_verts) {
+		ExpandBounds(v, nc_min, nc_max, false);
+	}
+
+	for (auto &inst : instances) {
+		auto &model = models[inst.model];
+		const float *t = inst.transform;
+		for (uint32_t i = 0; i < model.poly_count; ++i) {
+			auto &poly = model_polys[model.first_poly + i];
+			bool collidable = (poly.flags & EQEmu::MapV3PolyCollidable) != 0;
+			uint32_t poly_verts[3] = { poly.v1, poly.v2, poly.v3 };
+			for (int j = 0; j < 3; ++j) {
+				const glm::vec3 &m = model_verts[model.first_vert + poly_verts[j]];
+				glm::vec3 v(t[0] * m.x + t[1] * m.y + t[2] * m.z + t[3],
+					t[4] * m.x + t[5] * m.y + t[6] * m.z + t[7],
+					t[8] * m.x + t[9] * m.y + t[10] * m.z + t[11]);
+
+				if (collidable) {
+					ExpandBounds(v, collide_min, collide_max, true);
+				}
+				else {
+					ExpandBounds(v, nc_min, nc_max, false);
+				}
+			}
+		}
+	}
+
+	header.collide_min[0] = collide_min.x;
+	header.collide_min[1] = collide_min.y;
+	header.collide_min[2] = collide_min.z;
+	header.collide_max[0] = collide_max.x;
+	header.collide_max[1] = collide_max.y;
+	header.collide_max[2] = collide_max.z;
+	header.non_collide_min[0] = nc_min.x;
+	header.non_collide_min[1] = nc_min.y;
+	header.non_collide_min[2] = nc_min.z;
+	header.non_collide_max[0] = nc_max.x;
+	header.non_collide_max[1] = nc_max.y;
+	header.non_collide_max[2] = nc_max.z;
+
+	//spatial tiles over the baked triangles on the xz plane, each tile's triangles end up contiguous
+	std::vector<EQEmu::map_v3_tile> tiles;
+	std::vector<uint32_t> tiled_inds;
+	uint32_t baked_tri_count = (uint32_t)(baked_inds.size() / 3);
+	if (baked_tri_count > 0) {
+		glm::vec3 min(FLT_MAX);
+		glm::vec3 max(-FLT_MAX);
+		for (auto &v : baked_verts) {
+			min = glm::min(min, v);
+			max = glm::max(max, v);
+		}
+
+		float tile_size = MapV3DefaultTileSize;
+		float extent = std::max(max.x - min.x, max.z - min.z);
+		if (extent / tile_size > (float)MapV3MaxTilesPerAxis) {
+			tile_size = extent / (float)MapV3MaxTilesPerAxis;
+		}
+
+		uint32_t count_x = std::max(1u, (uint32_t)ceilf((max.x - min.x) / tile_size));
+		uint32_t count_z = std::max(1u, (uint32_t)ceilf((max.z - min.z) / tile_size));
+		count_x = std::min(count_x, MapV3MaxTilesPerAxis);
+		count_z = std::min(count_z, MapV3MaxTilesPerAxis);
+
+		header.tile_size = tile_size;
+		header.tile_count_x = count_x;
+		header.tile_count_z = count_z;
+		header.tile_origin_x = min.x;
+		header.tile_origin_z = min.z;
+
+		std::vector<uint32_t> tri_tile(baked_tri_count);
+		std::vector<uint32_t> tile_counts(count_x * count_z, 0);
+		for (uint32_t i = 0; i < baked_tri_count; ++i) {
+			glm::vec3 centroid = (baked_verts[baked_inds[i * 3]] + baked_verts[baked_inds[i * 3 + 1]] + baked_verts[baked_inds[i * 3 + 2]]) / 3.0f;
+			uint32_t tx = std::min(count_x - 1, (uint32_t)std::max(0.0f, (centroid.x - min.x) / tile_size));
+			uint32_t tz = std::min(count_z - 1, (uint32_t)std::max(0.0f, (centroid.z - min.z) / tile_size));
+			tri_tile[i] = tz * count_x + tx;
+			tile_counts[tri_tile[i]]++;
+		}
+
+		tiles.resize(count_x * count_z);
+		uint32_t first_tri = 0;
+		for (size_t i = 0; i < tiles.size(); ++i) {
+			memset(&tiles[i], 0, sizeof(EQEmu::map_v3_tile));
+			tiles[i].first_index = first_tri * 3;
+			tiles[i].index_count = tile_counts[i] * 3;
+			tiles[i].min[0] = tiles[i].min[1] = tiles[i].min[2] = FLT_MAX;
+			tiles[i].max[0] = tiles[i].max[1] = tiles[i].max[2] = -FLT_MAX;
+			first_tri += tile_counts[i];
+		}
+
+		tiled_inds.resize(baked_inds.size());
+		std::vector<uint32_t> tile_fill(tiles.size(), 0);
+		for (uint32_t i = 0; i < baked_tri_count; ++i) {
+			auto &tile = tiles[tri_tile[i]];
+			uint32_t dest = tile.first_index + tile_fill[tri_tile[i]] * 3;
+			tile_fill[tri_tile[i]]++;
+
+			for (int j = 0; j < 3; ++j) {
+				uint32_t idx = baked_inds[i * 3 + j];
+				const glm::vec3 &v = baked_verts[idx];
+				tiled_inds[dest + j] = idx;
+				tile.min[0] = std::min(tile.min[0], v.x);
+				tile.min[1] = std::min(tile.min[1], v.y);
+				tile.min[2] = std::min(tile.min[2], v.z);
+				tile.max[0] = std::max(tile.max[0], v.x);
+				tile.max[1] = std::max(tile.max[1], v.y);
+				tile.max[2] = std::max(tile.max[2], v.z);
+			}
+		}
+
+		for (auto &tile : tiles) {
+			if (tile.index_count == 0) {
+				tile.min[0] = tile.min[1] = tile.min[2] = 0.0f;
+				tile.max[0] = tile.max[1] = tile.max[2] = 0.0f;
+			}
+		}
+	}
+
+	std::vector<MapV3PendingSection> sections;
+	auto add_section = [&](uint32_t type, uint32_t element_size, const void *data, size_t count) {
+		MapV3PendingSection s;
+		s.type = type;
+		s.element_size = element_size;
+		s.data = count > 0 ? data : nullptr;
+		s.count = count;
+		sections.push_back(s);
+	};
+
+	add_section(EQEmu::MapV3SectionCollideVerts, sizeof(glm::vec3), baked_verts.data(), baked_verts.size());
+	add_section(EQEmu::MapV3SectionCollideIndices, sizeof(uint32_t), tiled_inds.data(), tiled_inds.size());
+	add_section(EQEmu::MapV3SectionNonCollideVerts, sizeof(glm::vec3), nc_verts.data(), nc_verts.size());
+	add_section(EQEmu::MapV3SectionNonCollideIndices, sizeof(uint32_t), non_collide_indices.data(), non_collide_indices.size());
+	add_section(EQEmu::MapV3SectionTiles, sizeof(EQEmu::map_v3_tile), tiles.data(), tiles.size());
+	add_section(EQEmu::MapV3SectionModels, sizeof(EQEmu::map_v3_model), models.data(), models.size());
+	add_section(EQEmu::MapV3SectionModelVerts, sizeof(glm::vec3), model_verts.data(), model_verts.size());
+	add_section(EQEmu::MapV3SectionModelPolys, sizeof(EQEmu::map_v3_poly), model_polys.data(), model_polys.size());
+	add_section(EQEmu::MapV3SectionInstances, sizeof(EQEmu::map_v3_instance), instances.data(), instances.size());
+	add_section(EQEmu::MapV3SectionStrings, sizeof(char), strings.data(), strings.size());
+
+	std::vector<EQEmu::map_v3_section> table(sections.size());
+	header.section_count = (uint32_t)sections.size();
+	header.section_table_offset = sizeof(EQEmu::map_v3_header);
+	uint64_t offset = AlignSection(header.section_table_offset + sizeof(EQEmu::map_v3_section) * sections.size());
+	for (size_t i = 0; i < sections.size(); ++i) {
+		memset(&table[i], 0, sizeof(EQEmu::map_v3_section));
+		table[i].type = sections[i].type;
+		table[i].element_size = sections[i].element_size;
+		table[i].offset = offset;
+		table[i].count = sections[i].count;
+		table[i].size = sections[i].count * sections[i].element_size;
+		offset = AlignSection(offset + table[i].size);
+	}
+	header.file_size = offset;
+
+	FILE *f = fopen(filename.c_str(), "wb");
+	if (!f) {
+		eqLogMessage(LogError, "Failed to write %s because the file could not be opened to write.", filename.c_str());
+		return false;
+	}
+
+	if (fwrite(&header, sizeof(header), 1, f) != 1 || fwrite(&table[0], sizeof(EQEmu::map_v3_section), table.size(), f) != table.size()) {
+		eqLogMessage(LogError, "Failed to write %s because the header could not be written.", filename.c_str());
+		fclose(f);
+		return false;
+	}
+
+	static const char padding[EQEmu::MapV3Alignment] = { 0 };
+	uint64_t written = header.section_table_offset + sizeof(EQEmu::map_v3_section) * table.size();
+	for (size_t i = 0; i < sections.size(); ++i) {
+		size_t pad = (size_t)(table[i].offset - written);
+		if (pad > 0 && fwrite(padding, pad, 1, f) != 1) {
+			eqLogMessage(LogError, "Failed to write %s because section padding could not be written.", filename.c_str());
+			fclose(f);
+			return false;
+		}
+
+		if (table[i].size > 0 && fwrite(sections[i].data, (size_t)table[i].size, 1, f) != 1) {
+			eqLogMessage(LogError, "Failed to write %s because section %u could not be written.", filename.c_str(), table[i].type);
+			fclose(f);
+			return false;
+		}
+
+		written = table[i].offset + table[i].size;
+	}
+
+	size_t pad = (size_t)(header.file_size - written);
+	if (pad > 0 && fwrite(padding, pad, 1, f) != 1) {
+		eqLogMessage(LogError, "Failed to write %s because section padding could not be written.", filename.c_str());
+		fclose(f);
+		return false;
+	}
+
+	fclose(f);
+	eqLogMessage(LogTrace, "Wrote v3 map %s with %u models, %u instances and %u tiles.", filename.c_str(), (uint32_t)models.size(), (uint32_t)instances.size(), (uint32_t)tiles.size());
+	return true;
+}
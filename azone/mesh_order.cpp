@@ -0,0 +1,67 @@
+#include "mesh_order.h"
+#include <algorithm>
+#include <float.h>
+
+static uint64_t MortonSpread(uint32_t v) {
+	uint64_t x = v & 0x1FFFFF;
+	x = (x | (x << 32)) & 0x1F00000000FFFFULL;
+	x = (x | (x << 16)) & 0x1F0000FF0000FFULL;
+	x = (x | (x << 8)) & 0x100F00F00F00F00FULL;
+	x = (x | (x << 4)) & 0x10C30C30C30C30C3ULL;
+	x = (x | (x << 2)) & 0x1249249249249249ULL;
+	return x;
+}
+
+uint64_t MortonEncode(uint32_t x, uint32_t y, uint32_t z) {
+	return MortonSpread(x) | (MortonSpread(y) << 1) | (MortonSpread(z) << 2);
+}
+
+void ReorderMeshMorton(std::vector<glm::vec3> &verts, std::vector<uint32_t> &inds) {
+	size_t tri_count = inds.size() / 3;
+	if (tri_count == 0) {
+		return;
+	}
+
+	glm::vec3 min(FLT_MAX);
+	glm::vec3 max(-FLT_MAX);
+	for (size_t i = 0; i < tri_count * 3; ++i) {
+		min = glm::min(min, verts[inds[i]]);
+		max = glm::max(max, verts[inds[i]]);
+	}
+
+	//one scale for all three axes keeps the cells cubic so long thin zones don't get stretched codes
+	const float grid = (float)0x1FFFFF;
+	glm::vec3 extent = max - min;
+	float longest = std::max(extent.x, std::max(extent.y, extent.z));
+	float scale = longest > 0.0f ? grid / longest : 0.0f;
+
+	std::vector<std::pair<uint64_t, uint32_t>> keys(tri_count);
+	for (size_t i = 0; i < tri_count; ++i) {
+		glm::vec3 centroid = (verts[inds[i * 3]] + verts[inds[i * 3 + 1]] + verts[inds[i * 3 + 2]]) / 3.0f;
+		glm::vec3 cell = glm::clamp((centroid - min) * scale, glm::vec3(0.0f), glm::vec3(grid));
+		keys[i].first = MortonEncode((uint32_t)cell.x, (uint32_t)cell.y, (uint32_t)cell.z);
+		keys[i].second = (uint32_t)i;
+	}
+
+	std::sort(keys.begin(), keys.end());
+
+	std::vector<uint32_t> remap(verts.size(), 0xFFFFFFFF);
+	std::vector<glm::vec3> out_verts;
+	std::vector<uint32_t> out_inds(tri_count * 3);
+	out_verts.reserve(verts.size());
+	for (size_t i = 0; i < tri_count; ++i) {
+		uint32_t tri = keys[i].second;
+		for (int j = 0; j < 3; ++j) {
+			uint32_t v = inds[tri * 3 + j];
+			if (remap[v] == 0xFFFFFFFF) {
+				remap[v] = (uint32_t)out_verts.size();
+				out_verts.push_back(verts[v]);
+			}
+
+			out_inds[i * 3 + j] = remap[v];
+		}
+	}
+
+	verts.swap(out_verts);
+	inds.swap(out_inds);
+}
@@ -0,0 +1,17 @@
+#ifndef EQEMU_MESH_ORDER_H
+#define EQEMU_MESH_ORDER_H
+
+#include <stdint.h>
+#include <vector>
+#define GLM_FORCE_RADIANS
+#include <glm.hpp>
+
+//Interleaves the low 21 bits of x, y and z into a 63 bit Morton code
+uint64_t MortonEncode(uint32_t x, uint32_t y, uint32_t z);
+
+//Sorts triangles along a Morton curve through their centroids and then renumbers vertices in first-use
+//order, so triangles that are close in space are close in memory and so are the vertices they use.
+//Triangles with equal codes keep their relative order. Unreferenced vertices are dropped.
+void ReorderMeshMorton(std::vector<glm::vec3> &verts, std::vector<uint32_t> &inds);
+
+#endif
@@ -0,0 +1,397 @@
+#include "mesh_simplifier.h"
+#include <algorithm>
+#include <unordered_map>
+
+static const double SimplifyMinNormalDot = 0.5;
+static const double SimplifyMinArea = 1e-8;
+static const size_t SimplifyMaxValence = 24;
+
+static uint64_t EdgeKey(uint32_t a, uint32_t b) {
+	if (a > b) {
+		std::swap(a, b);
+	}
+
+	return ((uint64_t)a << 32) | b;
+}
+
+MeshSimplifier::MeshSimplifier(float max_error, float walkable_normal_z) {
+	this->max_error = max_error;
+	this->walkable_normal_z = walkable_normal_z;
+	tris_before = 0;
+	tris_after = 0;
+}
+
+MeshSimplifier::~MeshSimplifier() {
+}
+
+glm::dvec3 MeshSimplifier::TriangleNormal(uint32_t tri, uint32_t replace_from, uint32_t replace_to) const {
+	glm::dvec3 p[3];
+	for (int i = 0; i < 3; ++i) {
+		uint32_t v = tris[tri * 3 + i];
+		p[i] = positions[v == replace_from ? replace_to : v];
+	}
+
+	return glm::cross(p[1] - p[0], p[2] - p[0]);
+}
+
+bool MeshSimplifier::IsWalkable(const glm::dvec3 &normal) const {
+	double len = glm::length(normal);
+	if (len < SimplifyMinArea) {
+		return false;
+	}
+
+	return normal.z / len >= walkable_normal_z;
+}
+
+double MeshSimplifier::Cost(uint32_t from, uint32_t to) const {
+	const Quadric &q = quadrics[from];
+	const glm::dvec3 &v = positions[to];
+	return q.a2 * v.x * v.x + 2.0 * q.ab * v.x * v.y + 2.0 * q.ac * v.x * v.z + 2.0 * q.ad * v.x +
+		q.b2 * v.y * v.y + 2.0 * q.bc * v.y * v.z + 2.0 * q.bd * v.y +
+		q.c2 * v.z * v.z + 2.0 * q.cd * v.z + q.d2;
+}
+
+bool MeshSimplifier::CanCollapse(uint32_t from, uint32_t to) const {
+	if (!vert_alive[from] || !vert_alive[to] || vert_locked[from]) {
+		return false;
+	}
+
+	//flat runs would otherwise all fan into whichever vertex wins the first tie, which makes slivers and
+	//turns every later check on that vertex into a scan of hundreds of triangles
+	if (vert_tris[from].size() + vert_tris[to].size() > SimplifyMaxValence + 2) {
+		return false;
+	}
+
+	//the only verts allowed to neighbour both ends are the ones opposite the shared edge, anything else
+	//would pinch the surface into a non-manifold fan after the collapse
+	std::vector<uint32_t> from_ring;
+	std::vector<uint32_t> opposite;
+	for (auto t : vert_tris[from]) {
+		bool shared = false;
+		for (int i = 0; i < 3; ++i) {
+			if (tris[t * 3 + i] == to) {
+				shared = true;
+			}
+		}
+
+		for (int i = 0; i < 3; ++i) {
+			uint32_t v = tris[t * 3 + i];
+			if (v != from && v != to) {
+				from_ring.push_back(v);
+				if (shared) {
+					opposite.push_back(v);
+				}
+			}
+		}
+	}
+
+	if (opposite.empty()) {
+		return false;
+	}
+
+	std::sort(from_ring.begin(), from_ring.end());
+	from_ring.erase(std::unique(from_ring.begin(), from_ring.end()), from_ring.end());
+	std::sort(opposite.begin(), opposite.end());
+	opposite.erase(std::unique(opposite.begin(), opposite.end()), opposite.end());
+
+	for (auto t : vert_tris[to]) {
+		for (int i = 0; i < 3; ++i) {
+			uint32_t v = tris[t * 3 + i];
+			if (v != from && v != to && std::binary_search(from_ring.begin(), from_ring.end(), v) &&
+				!std::binary_search(opposite.begin(), opposite.end(), v)) {
+				return false;
+			}
+		}
+	}
+
+	for (auto t : vert_tris[from]) {
+		bool shared = false;
+		for (int i = 0; i < 3; ++i) {
+			if (tris[t * 3 + i] == to) {
+				shared = true;
+			}
+		}
+
+		if (shared) {
+			continue;
+		}
+
+		glm::dvec3 before = TriangleNormal(t, from, from);
+		glm::dvec3 after = TriangleNormal(t, from, to);
+		double before_len = glm::length(before);
+		double after_len = glm::length(after);
+		if (after_len < SimplifyMinArea) {
+			return false;
+		}
+
+		if (before_len >= SimplifyMinArea && glm::dot(before, after) < SimplifyMinNormalDot * before_len * after_len) {
+			return false;
+		}
+
+		if (IsWalkable(after) != tri_walkable[t]) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void MeshSimplifier::DoCollapse(uint32_t from, uint32_t to) {
+	for (auto t : vert_tris[from]) {
+		bool shared = false;
+		for (int i = 0; i < 3; ++i) {
+			if (tris[t * 3 + i] == to) {
+				shared = true;
+			}
+		}
+
+		if (shared) {
+			tri_alive[t] = false;
+			for (int i = 0; i < 3; ++i) {
+				uint32_t v = tris[t * 3 + i];
+				if (v == from) {
+					continue;
+				}
+
+				auto &list = vert_tris[v];
+				list.erase(std::remove(list.begin(), list.end(), t), list.end());
+			}
+
+			continue;
+		}
+
+		for (int i = 0; i < 3; ++i) {
+			if (tris[t * 3 + i] == from) {
+				tris[t * 3 + i] = to;
+			}
+		}
+
+		vert_tris[to].push_back(t);
+	}
+
+	Quadric &qf = quadrics[from];
+	Quadric &qt = quadrics[to];
+	qt.a2 += qf.a2;
+	qt.ab += qf.ab;
+	qt.ac += qf.ac;
+	qt.ad += qf.ad;
+	qt.b2 += qf.b2;
+	qt.bc += qf.bc;
+	qt.bd += qf.bd;
+	qt.c2 += qf.c2;
+	qt.cd += qf.cd;
+	qt.d2 += qf.d2;
+
+	vert_alive[from] = false;
+	vert_tris[from].clear();
+	vert_tris[from].shrink_to_fit();
+	vert_stamp[to]++;
+}
+
+void MeshSimplifier::QueueCollapses(uint32_t v) {
+	double limit = (double)max_error * (double)max_error;
+	std::vector<uint32_t> ring;
+	for (auto t : vert_tris[v]) {
+		for (int i = 0; i < 3; ++i) {
+			if (tris[t * 3 + i] != v) {
+				ring.push_back(tris[t * 3 + i]);
+			}
+		}
+	}
+
+	std::sort(ring.begin(), ring.end());
+	ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+
+	for (auto w : ring) {
+		if (!vert_locked[v]) {
+			double cost = Cost(v, w);
+			if (cost <= limit) {
+				Collapse c = { cost, v, w, vert_stamp[v] };
+				heap.push_back(c);
+				std::push_heap(heap.begin(), heap.end());
+			}
+		}
+
+		if (!vert_locked[w]) {
+			double cost = Cost(w, v);
+			if (cost <= limit) {
+				Collapse c = { cost, w, v, vert_stamp[w] };
+				heap.push_back(c);
+				std::push_heap(heap.begin(), heap.end());
+			}
+		}
+	}
+}
+
+void MeshSimplifier::Simplify(std::vector<glm::vec3> &verts, std::vector<uint32_t> &inds) {
+	tris_before = (uint32_t)(inds.size() / 3);
+	tris_after = tris_before;
+	if (tris_before == 0 || max_error < 0.0f) {
+		return;
+	}
+
+	positions.resize(verts.size());
+	for (size_t i = 0; i < verts.size(); ++i) {
+		positions[i] = glm::dvec3(verts[i]);
+	}
+
+	//faces that already repeat a vertex have no area to collide with and no adjacency worth keeping
+	tris.clear();
+	tris.reserve(tris_before * 3);
+	for (uint32_t i = 0; i < tris_before; ++i) {
+		uint32_t a = inds[i * 3];
+		uint32_t b = inds[i * 3 + 1];
+		uint32_t c = inds[i * 3 + 2];
+		if (a == b || b == c || a == c) {
+			continue;
+		}
+
+		tris.push_back(a);
+		tris.push_back(b);
+		tris.push_back(c);
+	}
+
+	uint32_t tri_count = (uint32_t)(tris.size() / 3);
+	tri_alive.assign(tri_count, true);
+	tri_walkable.resize(tri_count);
+	vert_tris.assign(verts.size(), std::vector<uint32_t>());
+	quadrics.assign(verts.size(), Quadric());
+	vert_locked.assign(verts.size(), false);
+	vert_alive.assign(verts.size(), true);
+	vert_stamp.assign(verts.size(), 0);
+	heap.clear();
+
+	std::vector<uint8_t> vert_class(verts.size(), 0);
+	std::unordered_map<uint64_t, uint32_t> edge_use;
+	edge_use.reserve(tri_count * 3);
+	for (uint32_t t = 0; t < tri_count; ++t) {
+		glm::dvec3 n = TriangleNormal(t, 0xFFFFFFFF, 0xFFFFFFFF);
+		tri_walkable[t] = IsWalkable(n);
+
+		double len = glm::length(n);
+		Quadric q = Quadric();
+		if (len >= SimplifyMinArea) {
+			n /= len;
+			double d = -glm::dot(n, positions[tris[t * 3]]);
+			q.a2 = n.x * n.x;
+			q.ab = n.x * n.y;
+			q.ac = n.x * n.z;
+			q.ad = n.x * d;
+			q.b2 = n.y * n.y;
+			q.bc = n.y * n.z;
+			q.bd = n.y * d;
+			q.c2 = n.z * n.z;
+			q.cd = n.z * d;
+			q.d2 = d * d;
+		}
+
+		for (int i = 0; i < 3; ++i) {
+			uint32_t v = tris[t * 3 + i];
+			vert_tris[v].push_back(t);
+			vert_class[v] |= tri_walkable[t] ? 1 : 2;
+
+			Quadric &vq = quadrics[v];
+			vq.a2 += q.a2;
+			vq.ab += q.ab;
+			vq.ac += q.ac;
+			vq.ad += q.ad;
+			vq.b2 += q.b2;
+			vq.bc += q.bc;
+			vq.bd += q.bd;
+			vq.c2 += q.c2;
+			vq.cd += q.cd;
+			vq.d2 += q.d2;
+
+			edge_use[EdgeKey(v, tris[t * 3 + (i + 1) % 3])]++;
+		}
+	}
+
+	//open and non-manifold edges outline holes, ledges and overlapping geometry; walkable/non-walkable
+	//seams are where floors meet walls. Everything on either stays exactly where it is.
+	for (auto &e : edge_use) {
+		if (e.second != 2) {
+			vert_locked[(uint32_t)(e.first >> 32)] = true;
+			vert_locked[(uint32_t)(e.first & 0xFFFFFFFF)] = true;
+		}
+	}
+
+	for (size_t v = 0; v < verts.size(); ++v) {
+		if (vert_class[v] == 3) {
+			vert_locked[v] = true;
+		}
+	}
+
+	double limit = (double)max_error * (double)max_error;
+	for (uint32_t v = 0; v < (uint32_t)verts.size(); ++v) {
+		if (vert_locked[v] || vert_tris[v].empty()) {
+			continue;
+		}
+
+		std::vector<uint32_t> ring;
+		for (auto t : vert_tris[v]) {
+			for (int i = 0; i < 3; ++i) {
+				if (tris[t * 3 + i] != v) {
+					ring.push_back(tris[t * 3 + i]);
+				}
+			}
+		}
+
+		std::sort(ring.begin(), ring.end());
+		ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+		for (auto w : ring) {
+			double cost = Cost(v, w);
+			if (cost <= limit) {
+				Collapse c = { cost, v, w, vert_stamp[v] };
+				heap.push_back(c);
+			}
+		}
+	}
+
+	std::make_heap(heap.begin(), heap.end());
+	while (!heap.empty()) {
+		std::pop_heap(heap.begin(), heap.end());
+		Collapse c = heap.back();
+		heap.pop_back();
+
+		if (c.stamp != vert_stamp[c.from] || !CanCollapse(c.from, c.to)) {
+			continue;
+		}
+
+		DoCollapse(c.from, c.to);
+		QueueCollapses(c.to);
+	}
+
+	std::vector<uint32_t> remap(verts.size(), 0xFFFFFFFF);
+	std::vector<glm::vec3> out_verts;
+	std::vector<uint32_t> out_inds;
+	for (uint32_t t = 0; t < tri_count; ++t) {
+		if (!tri_alive[t]) {
+			continue;
+		}
+
+		for (int i = 0; i < 3; ++i) {
+			uint32_t v = tris[t * 3 + i];
+			if (remap[v] == 0xFFFFFFFF) {
+				remap[v] = (uint32_t)out_verts.size();
+				out_verts.push_back(verts[v]);
+			}
+
+			out_inds.push_back(remap[v]);
+		}
+	}
+
+	verts.swap(out_verts);
+	inds.swap(out_inds);
+	tris_after = (uint32_t)(inds.size() / 3);
+
+	positions.clear();
+	tris.clear();
+	tri_alive.clear();
+	tri_walkable.clear();
+	vert_tris.clear();
+	quadrics.clear();
+	vert_locked.clear();
+	vert_alive.clear();
+	vert_stamp.clear();
+	heap.clear();
+}
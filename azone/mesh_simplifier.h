@@ -0,0 +1,67 @@
+#ifndef EQEMU_MESH_SIMPLIFIER_H
+#define EQEMU_MESH_SIMPLIFIER_H
+
+#include <stdint.h>
+#include <vector>
+#define GLM_FORCE_RADIANS
+#include <glm.hpp>
+
+//Reduces an indexed collision mesh with quadric error half-edge collapses.
+//A collapse moves one vertex onto a neighbouring vertex, so no new positions are ever made up; coplanar
+//runs cost nothing to merge and anything else is only collapsed while the summed squared distance to the
+//original planes stays under max_error squared.
+//Never collapsed: vertices on open or non-manifold edges, vertices shared between walkable and
+//non-walkable triangles, collapses that flip or degenerate a triangle or change whether it is walkable.
+//Expects z up, which is how azone builds its geometry.
+class MeshSimplifier
+{
+public:
+	MeshSimplifier(float max_error, float walkable_normal_z = 0.7071f);
+	~MeshSimplifier();
+
+	//Simplifies in place, unused vertices are dropped and the rest keep their first-use order.
+	void Simplify(std::vector<glm::vec3> &verts, std::vector<uint32_t> &inds);
+
+	uint32_t GetTrianglesBefore() const { return tris_before; }
+	uint32_t GetTrianglesAfter() const { return tris_after; }
+private:
+	struct Quadric
+	{
+		double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+	};
+
+	struct Collapse
+	{
+		double cost;
+		uint32_t from;
+		uint32_t to;
+		uint32_t stamp;
+
+		bool operator<(const Collapse &o) const { return cost > o.cost; }
+	};
+
+	glm::dvec3 TriangleNormal(uint32_t tri, uint32_t replace_from, uint32_t replace_to) const;
+	bool IsWalkable(const glm::dvec3 &normal) const;
+	double Cost(uint32_t from, uint32_t to) const;
+	bool CanCollapse(uint32_t from, uint32_t to) const;
+	void DoCollapse(uint32_t from, uint32_t to);
+	void QueueCollapses(uint32_t v);
+
+	float max_error;
+	float walkable_normal_z;
+	uint32_t tris_before;
+	uint32_t tris_after;
+
+	std::vector<glm::dvec3> positions;
+	std::vector<uint32_t> tris;
+	std::vector<bool> tri_alive;
+	std::vector<bool> tri_walkable;
+	std::vector<std::vector<uint32_t>> vert_tris;
+	std::vector<Quadric> quadrics;
+	std::vector<bool> vert_locked;
+	std::vector<bool> vert_alive;
+	std::vector<uint32_t> vert_stamp;
+	std::vector<Collapse> heap;
+};
+
+#endif
@@ -0,0 +1,240 @@
+#include "vertex_welder.h"
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+static const uint32_t WeldInvalidIndex = 0xFFFFFFFF;
+static const int64_t WeldMaxCellCoord = (int64_t)1 << 40;
+static const size_t WeldMinFacesPerChunk = 16384;
+
+VertexWelder::VertexWelder(float epsilon) {
+	this->epsilon = epsilon > 0.0f ? epsilon : 0.0f;
+	inv_cell_size = this->epsilon > 0.0f ? 1.0f / (this->epsilon * 2.0f) : 0.0f;
+}
+
+VertexWelder::~VertexWelder() {
+}
+
+void VertexWelder::Reserve(size_t vert_count) {
+	verts.reserve(vert_count);
+	next_in_cell.reserve(vert_count);
+	cells.reserve(vert_count);
+}
+
+void VertexWelder::Clear() {
+	verts.clear();
+	next_in_cell.clear();
+	cells.clear();
+}
+
+uint32_t VertexWelder::Weld(const glm::vec3 &v) {
+	uint32_t idx = Find(v);
+	if (idx != WeldInvalidIndex) {
+		return idx;
+	}
+
+	uint64_t key;
+	if (epsilon > 0.0f) {
+		key = CellKey(CellCoord(v.x), CellCoord(v.y), CellCoord(v.z));
+	}
+	else {
+		key = ExactKey(v);
+	}
+
+	idx = (uint32_t)verts.size();
+	verts.push_back(v);
+
+	auto iter = cells.find(key);
+	if (iter == cells.end()) {
+		next_in_cell.push_back(WeldInvalidIndex);
+		cells[key] = idx;
+	}
+	else {
+		next_in_cell.push_back(iter->second);
+		iter->second = idx;
+	}
+
+	return idx;
+}
+
+uint32_t VertexWelder::Find(const glm::vec3 &v) const {
+	if (epsilon == 0.0f) {
+		auto iter = cells.find(ExactKey(v));
+		if (iter == cells.end()) {
+			return WeldInvalidIndex;
+		}
+
+		for (uint32_t i = iter->second; i != WeldInvalidIndex; i = next_in_cell[i]) {
+			if (verts[i] == v) {
+				return i;
+			}
+		}
+
+		return WeldInvalidIndex;
+	}
+
+	//cells are twice epsilon wide so the search box around v touches at most two cells per axis
+	float eps_sq = epsilon * epsilon;
+	uint32_t best = WeldInvalidIndex;
+	int64_t min_x = CellCoord(v.x - epsilon);
+	int64_t max_x = CellCoord(v.x + epsilon);
+	int64_t min_y = CellCoord(v.y - epsilon);
+	int64_t max_y = CellCoord(v.y + epsilon);
+	int64_t min_z = CellCoord(v.z - epsilon);
+	int64_t max_z = CellCoord(v.z + epsilon);
+	for (int64_t x = min_x; x <= max_x; ++x) {
+		for (int64_t y = min_y; y <= max_y; ++y) {
+			for (int64_t z = min_z; z <= max_z; ++z) {
+				auto iter = cells.find(CellKey(x, y, z));
+				if (iter == cells.end()) {
+					continue;
+				}
+
+				for (uint32_t i = iter->second; i != WeldInvalidIndex; i = next_in_cell[i]) {
+					glm::vec3 d = verts[i] - v;
+					if ((d.x * d.x + d.y * d.y + d.z * d.z) <= eps_sq && i < best) {
+						best = i;
+					}
+				}
+			}
+		}
+	}
+
+	return best;
+}
+
+uint64_t VertexWelder::ExactKey(const glm::vec3 &v) const {
+	//adding zero folds -0.0 into 0.0 so both hash the same, matching how they compare
+	float f[3] = { v.x + 0.0f, v.y + 0.0f, v.z + 0.0f };
+	uint32_t bits[3];
+	memcpy(bits, f, sizeof(bits));
+
+	return CellKey(bits[0], bits[1], bits[2]);
+}
+
+uint64_t VertexWelder::CellKey(int64_t x, int64_t y, int64_t z) const {
+	uint64_t h = (uint64_t)x * 0x9E3779B97F4A7C15ULL;
+	h ^= (uint64_t)y * 0xC2B2AE3D27D4EB4FULL + (h << 6) + (h >> 2);
+	h ^= (uint64_t)z * 0x165667B19E3779F9ULL + (h << 6) + (h >> 2);
+	return h;
+}
+
+int64_t VertexWelder::CellCoord(float v) const {
+	float c = floorf(v * inv_cell_size);
+	if (c > (float)WeldMaxCellCoord) {
+		return WeldMaxCellCoord;
+	}
+
+	if (c < -(float)WeldMaxCellCoord) {
+		return -WeldMaxCellCoord;
+	}
+
+	return (int64_t)c;
+}
+
+void VertexWelder::WeldSoup(const std::vector<glm::vec3> &soup, float epsilon, EQEmu::ThreadPool *pool,
+	std::vector<glm::vec3> &out_verts, std::vector<uint32_t> &out_inds)
+{
+	out_verts.clear();
+	out_inds.clear();
+
+	//only exact welds are chunked: with an epsilon a vertex snaps to whatever its own chunk saw first, so the result
+	//would change with the chunk count and neighbouring chunks could leave a vertex split
+	size_t face_count = soup.size() / 3;
+	size_t chunk_count = 1;
+	if (pool && pool->Size() > 1 && epsilon <= 0.0f) {
+		chunk_count = std::min(pool->Size(), face_count / WeldMinFacesPerChunk);
+	}
+
+	out_inds.reserve(face_count * 3);
+	if (chunk_count <= 1) {
+		VertexWelder welder(epsilon);
+		welder.Reserve(face_count * 3);
+		for (size_t i = 0; i < face_count * 3; ++i) {
+			out_inds.push_back(welder.Weld(soup[i]));
+		}
+
+		out_verts = std::move(welder.verts);
+		DropDegenerateFaces(out_verts, out_inds);
+		return;
+	}
+
+	std::vector<VertexWelder> welders(chunk_count, VertexWelder(epsilon));
+	std::vector<std::vector<uint32_t>> chunk_inds(chunk_count);
+	size_t faces_per_chunk = (face_count + chunk_count - 1) / chunk_count;
+	pool->ParallelFor(chunk_count, [&](size_t begin, size_t end) {
+		for (size_t c = begin; c < end; ++c) {
+			size_t first = std::min(face_count, c * faces_per_chunk) * 3;
+			size_t last = std::min(face_count, (c + 1) * faces_per_chunk) * 3;
+
+			welders[c].Reserve(last - first);
+			chunk_inds[c].reserve(last - first);
+			for (size_t i = first; i < last; ++i) {
+				chunk_inds[c].push_back(welders[c].Weld(soup[i]));
+			}
+		}
+	});
+
+	//merging the chunks in order keeps the first-use vertex order of a sequential weld
+	size_t unique_count = 0;
+	for (auto &w : welders) {
+		unique_count += w.verts.size();
+	}
+
+	VertexWelder merged(epsilon);
+	merged.Reserve(unique_count);
+	std::vector<uint32_t> remap;
+	for (size_t c = 0; c < chunk_count; ++c) {
+		auto &local_verts = welders[c].verts;
+		remap.resize(local_verts.size());
+		for (size_t i = 0; i < local_verts.size(); ++i) {
+			remap[i] = merged.Weld(local_verts[i]);
+		}
+
+		for (auto idx : chunk_inds[c]) {
+			out_inds.push_back(remap[idx]);
+		}
+
+		welders[c].Clear();
+	}
+
+	out_verts = std::move(merged.verts);
+	DropDegenerateFaces(out_verts, out_inds);
+}
+
+void VertexWelder::DropDegenerateFaces(std::vector<glm::vec3> &verts, std::vector<uint32_t> &inds) {
+	size_t kept = 0;
+	for (size_t i = 0; i + 2 < inds.size(); i += 3) {
+		uint32_t a = inds[i];
+		uint32_t b = inds[i + 1];
+		uint32_t c = inds[i + 2];
+		if (a == b || b == c || a == c) {
+			continue;
+		}
+
+		inds[kept++] = a;
+		inds[kept++] = b;
+		inds[kept++] = c;
+	}
+
+	if (kept == inds.size()) {
+		return;
+	}
+
+	inds.resize(kept);
+
+	//a vertex only the dropped faces used goes too, the rest keep their first-use order
+	std::vector<uint32_t> remap(verts.size(), WeldInvalidIndex);
+	std::vector<glm::vec3> used;
+	used.reserve(verts.size());
+	for (auto &idx : inds) {
+		if (remap[idx] == WeldInvalidIndex) {
+			remap[idx] = (uint32_t)used.size();
+			used.push_back(verts[idx]);
+		}
+
+		idx = remap[idx];
+	}
+
+	verts = std::move(used);
+}
@@ -0,0 +1,46 @@
+#ifndef EQEMU_VERTEX_WELDER_H
+#define EQEMU_VERTEX_WELDER_H
+
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+#define GLM_FORCE_RADIANS
+#include <glm.hpp>
+#include "thread_pool.h"
+
+//Deduplicates vertices through a spatial hash.
+//With an epsilon of 0 only bit-identical positions are merged, otherwise any vertex within epsilon of an
+//already welded vertex reuses that vertex's index.
+class VertexWelder
+{
+public:
+	VertexWelder(float epsilon = 0.0f);
+	~VertexWelder();
+
+	void Reserve(size_t vert_count);
+	void Clear();
+	uint32_t Weld(const glm::vec3 &v);
+
+	float GetEpsilon() const { return epsilon; }
+	const std::vector<glm::vec3> &GetVerts() const { return verts; }
+
+	//Welds a triangle soup (three verts per face) into an indexed mesh and drops faces that collapsed to a line or point.
+	//With an epsilon of 0 and a pool the soup is welded in chunks in parallel and the chunks are merged afterwards;
+	//epsilon welds always run in order so the result doesn't depend on the pool. Vertices keep first-use order.
+	static void WeldSoup(const std::vector<glm::vec3> &soup, float epsilon, EQEmu::ThreadPool *pool,
+		std::vector<glm::vec3> &out_verts, std::vector<uint32_t> &out_inds);
+private:
+	static void DropDegenerateFaces(std::vector<glm::vec3> &verts, std::vector<uint32_t> &inds);
+	uint32_t Find(const glm::vec3 &v) const;
+	uint64_t ExactKey(const glm::vec3 &v) const;
+	uint64_t CellKey(int64_t x, int64_t y, int64_t z) const;
+	int64_t CellCoord(float v) const;
+
+	float epsilon;
+	float inv_cell_size;
+	std::vector<glm::vec3> verts;
+	std::vector<uint32_t> next_in_cell;
+	std::unordered_map<uint64_t, uint32_t> cells;
+};
+
+#endif
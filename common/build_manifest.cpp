@@ -0,0 +1,143 @@
+#include "build_manifest.h"
+#include "fnv_hash.h"
+#include "log_macros.h"
+#include <json.hpp>
+#include <fstream>
+#include <mutex>
+#include <stdio.h>
+#include <inttypes.h>
+
+using json = nlohmann::json;
+
+static const int BuildManifestVersion = 1;
+
+static json EntryToJson(const BuildManifestEntry &entry) {
+	json obj;
+	obj["tool"] = entry.tool;
+	obj["tool_version"] = entry.tool_version;
+	obj["options"] = entry.options;
+
+	json inputs = json::object();
+	for (auto &input : entry.inputs) {
+		inputs[input.first] = input.second;
+	}
+
+	obj["inputs"] = inputs;
+	return obj;
+}
+
+void BuildManifestEntry::AddInput(const std::string &filename) {
+	uint64_t hash;
+	if (!EQEmu::FNV1a64File(filename, hash)) {
+		inputs.push_back(std::make_pair(filename, std::string()));
+		return;
+	}
+
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%016" PRIx64, hash);
+	inputs.push_back(std::make_pair(filename, std::string(buffer)));
+}
+
+struct BuildManifest::Implementation {
+	json outputs;
+	std::mutex lock;
+};
+
+BuildManifest::BuildManifest() {
+	mImpl = new Implementation();
+	mImpl->outputs = json::object();
+}
+
+BuildManifest::~BuildManifest() {
+	delete mImpl;
+}
+
+bool BuildManifest::Load(const std::string &filename) {
+	std::lock_guard<std::mutex> lock(mImpl->lock);
+	mImpl->outputs = json::object();
+
+	std::ifstream ifs;
+	ifs.open(filename, std::ifstream::in);
+	if (!ifs.good()) {
+		return false;
+	}
+
+	try {
+		json obj;
+		ifs >> obj;
+
+		if (!obj.is_object() || obj["version"] != BuildManifestVersion || !obj["outputs"].is_object()) {
+			eqLogMessage(LogWarn, "Ignoring build manifest %s because it is from an unknown version.", filename.c_str());
+			return false;
+		}
+
+		mImpl->outputs = obj["outputs"];
+	}
+	catch (std::exception &ex) {
+		eqLogMessage(LogWarn, "Ignoring build manifest %s because it could not be parsed: %s", filename.c_str(), ex.what());
+		return false;
+	}
+
+	return true;
+}
+
+bool BuildManifest::Save(const std::string &filename) {
+	std::lock_guard<std::mutex> lock(mImpl->lock);
+
+	json obj;
+	obj["version"] = BuildManifestVersion;
+	obj["outputs"] = mImpl->outputs;
+
+	//write then rename so an interrupted save never leaves a truncated manifest behind
+	std::string temp_filename = filename + ".tmp";
+	{
+		std::ofstream ofs;
+		ofs.open(temp_filename, std::ofstream::out | std::ofstream::trunc);
+		if (!ofs.good()) {
+			eqLogMessage(LogError, "Failed to write build manifest %s.", temp_filename.c_str());
+			return false;
+		}
+
+		ofs << obj.dump(1, '\t');
+		if (!ofs.good()) {
+			eqLogMessage(LogError, "Failed to write build manifest %s.", temp_filename.c_str());
+			return false;
+		}
+	}
+
+	remove(filename.c_str());
+	if (rename(temp_filename.c_str(), filename.c_str()) != 0) {
+		eqLogMessage(LogError, "Failed to move build manifest %s into place.", filename.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool BuildManifest::IsUpToDate(const std::string &output, const BuildManifestEntry &entry) {
+	FILE *f = fopen(output.c_str(), "rb");
+	if (!f) {
+		return false;
+	}
+	fclose(f);
+
+	json current = EntryToJson(entry);
+	std::lock_guard<std::mutex> lock(mImpl->lock);
+	auto iter = mImpl->outputs.find(output);
+	if (iter == mImpl->outputs.end()) {
+		return false;
+	}
+
+	return *iter == current;
+}
+
+void BuildManifest::Set(const std::string &output, const BuildManifestEntry &entry) {
+	json current = EntryToJson(entry);
+	std::lock_guard<std::mutex> lock(mImpl->lock);
+	mImpl->outputs[output] = current;
+}
+
+void BuildManifest::Remove(const std::string &output) {
+	std::lock_guard<std::mutex> lock(mImpl->lock);
+	mImpl->outputs.erase(output);
+}
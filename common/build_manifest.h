@@ -0,0 +1,42 @@
+#ifndef EQEMU_COMMON_BUILD_MANIFEST_H
+#define EQEMU_COMMON_BUILD_MANIFEST_H
+
+#include <string>
+#include <vector>
+#include <utility>
+
+//What one output file was built from: the tool, its settings and a content hash of every input.
+//Inputs that don't exist are recorded too so an archive appearing later still triggers a rebuild.
+struct BuildManifestEntry
+{
+	std::string tool;
+	std::string tool_version;
+	std::string options;
+	std::vector<std::pair<std::string, std::string>> inputs;
+
+	void AddInput(const std::string &filename);
+};
+
+//Json file of BuildManifestEntry records keyed by output file name.
+//Safe to query and update from several build threads at once.
+class BuildManifest {
+public:
+	BuildManifest();
+	~BuildManifest();
+
+	bool Load(const std::string &filename);
+	bool Save(const std::string &filename);
+
+	bool IsUpToDate(const std::string &output, const BuildManifestEntry &entry);
+	void Set(const std::string &output, const BuildManifestEntry &entry);
+	void Remove(const std::string &output);
+
+private:
+	BuildManifest(const BuildManifest&);
+	BuildManifest& operator=(const BuildManifest&);
+
+	struct Implementation;
+	Implementation *mImpl;
+};
+
+#endif
@@ -1,6 +1,7 @@
 #include "compression.h"
 #include <zlib.h>
 #include <string.h>
+#include <vector>
 
 uint32_t EQEmu::DeflateData(const char *buffer, uint32_t len, char *out_buffer, uint32_t out_len_max) {
 	z_stream zstream;
@@ -63,3 +64,118 @@ uint32_t EQEmu::InflateData(const char* buffer, uint32_t len, char* out_buffer,
 		return 0;
 	}
 }
+
+struct EQEmu::DeflateFileWriter::impl
+{
+	FILE *f;
+	z_stream zstream;
+	bool initialized;
+	bool failed;
+	std::vector<char> in_buffer;
+	std::vector<char> out_buffer;
+	size_t in_used;
+	uint32_t compressed_size;
+	uint32_t uncompressed_size;
+};
+
+EQEmu::DeflateFileWriter::DeflateFileWriter(FILE *f, uint32_t expected_size, uint32_t chunk_size) {
+	imp = new impl;
+	imp->f = f;
+	imp->failed = false;
+	imp->in_used = 0;
+	imp->compressed_size = 0;
+	imp->uncompressed_size = 0;
+
+	if (chunk_size == 0) {
+		chunk_size = 262144;
+	}
+
+	//no point staging more than we are told will ever be written
+	uint32_t in_size = expected_size > 0 && expected_size < chunk_size ? expected_size : chunk_size;
+	imp->in_buffer.resize(in_size);
+	imp->out_buffer.resize(chunk_size);
+
+	memset(&imp->zstream, 0, sizeof(imp->zstream));
+	imp->zstream.zalloc = Z_NULL;
+	imp->zstream.zfree = Z_NULL;
+	imp->zstream.opaque = Z_NULL;
+	imp->initialized = deflateInit(&imp->zstream, Z_DEFAULT_COMPRESSION) == Z_OK;
+	if (!imp->initialized) {
+		imp->failed = true;
+	}
+}
+
+EQEmu::DeflateFileWriter::~DeflateFileWriter() {
+	if (imp->initialized) {
+		deflateEnd(&imp->zstream);
+	}
+
+	delete imp;
+}
+
+bool EQEmu::DeflateFileWriter::Write(const void *data, size_t len) {
+	if (imp->failed) {
+		return false;
+	}
+
+	const char *src = reinterpret_cast<const char*>(data);
+	imp->uncompressed_size += (uint32_t)len;
+	while (len > 0) {
+		size_t space = imp->in_buffer.size() - imp->in_used;
+		size_t count = len < space ? len : space;
+		memcpy(&imp->in_buffer[imp->in_used], src, count);
+		imp->in_used += count;
+		src += count;
+		len -= count;
+
+		if (imp->in_used == imp->in_buffer.size() && !Deflate(false)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool EQEmu::DeflateFileWriter::Finish() {
+	if (imp->failed) {
+		return false;
+	}
+
+	return Deflate(true);
+}
+
+uint32_t EQEmu::DeflateFileWriter::GetCompressedSize() const {
+	return imp->compressed_size;
+}
+
+uint32_t EQEmu::DeflateFileWriter::GetUncompressedSize() const {
+	return imp->uncompressed_size;
+}
+
+bool EQEmu::DeflateFileWriter::Deflate(bool finish) {
+	imp->zstream.next_in = reinterpret_cast<unsigned char*>(imp->in_used > 0 ? &imp->in_buffer[0] : nullptr);
+	imp->zstream.avail_in = (uInt)imp->in_used;
+
+	int flush = finish ? Z_FINISH : Z_NO_FLUSH;
+	int zerror;
+	do {
+		imp->zstream.next_out = reinterpret_cast<unsigned char*>(&imp->out_buffer[0]);
+		imp->zstream.avail_out = (uInt)imp->out_buffer.size();
+		zerror = deflate(&imp->zstream, flush);
+		if (zerror == Z_STREAM_ERROR) {
+			imp->failed = true;
+			return false;
+		}
+
+		size_t have = imp->out_buffer.size() - imp->zstream.avail_out;
+		if (have > 0 && fwrite(&imp->out_buffer[0], have, 1, imp->f) != 1) {
+			imp->failed = true;
+			return false;
+		}
+
+		imp->compressed_size += (uint32_t)have;
+	} while (imp->zstream.avail_out == 0 || (finish && zerror != Z_STREAM_END));
+
+	imp->in_used = 0;
+	return true;
+}
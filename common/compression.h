@@ -2,6 +2,8 @@
 #define EQEMU_COMMON_COMPRESSION_H
 
 #include <stdint.h>
+#include <stdio.h>
+#include <vector>
 
 namespace EQEmu
 {
@@ -9,6 +11,43 @@ namespace EQEmu
 uint32_t DeflateData(const char *buffer, uint32_t len, char *out_buffer, uint32_t out_len_max);
 uint32_t InflateData(const char* buffer, uint32_t len, char* out_buffer, uint32_t out_len_max);
 
+//Deflates everything written to it straight into an open file in fixed size chunks,
+//so only one chunk of raw and one chunk of compressed data are ever held in memory.
+class DeflateFileWriter
+{
+public:
+	DeflateFileWriter(FILE *f, uint32_t expected_size, uint32_t chunk_size = 262144);
+	~DeflateFileWriter();
+
+	bool Write(const void *data, size_t len);
+	bool Finish();
+
+	template<typename T>
+	bool Write(const T &v) {
+		return Write(&v, sizeof(T));
+	}
+
+	template<typename T>
+	bool WriteArray(const std::vector<T> &v) {
+		if (v.empty()) {
+			return true;
+		}
+
+		return Write(&v[0], v.size() * sizeof(T));
+	}
+
+	uint32_t GetCompressedSize() const;
+	uint32_t GetUncompressedSize() const;
+private:
+	DeflateFileWriter(const DeflateFileWriter &s);
+	const DeflateFileWriter &operator=(const DeflateFileWriter &s);
+
+	bool Deflate(bool finish);
+
+	struct impl;
+	impl *imp;
+};
+
 }
 
-#endif
\ No newline at end of file
+#endif
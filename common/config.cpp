@@ -34,3 +34,15 @@ const std::string Config::GetPath(const std::string &type, const std::string &de
 	
 	return defaultValue;
 }
+
+float Config::GetFloat(const std::string &section, const std::string &name, float defaultValue) {
+	auto values = mImpl->obj[section];
+	if (values.is_object()) {
+		auto value = values[name];
+		if (value.is_number()) {
+			return value;
+		}
+	}
+
+	return defaultValue;
+}
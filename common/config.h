@@ -13,6 +13,7 @@ public:
 	}
 
 	const std::string GetPath(const std::string &type, const std::string &defaultValue);
+	float GetFloat(const std::string &section, const std::string &name, float defaultValue);
 
 private:
 	Config();
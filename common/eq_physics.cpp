@@ -1,33 +1,361 @@
 #include <vector>
 #include <memory>
 #include <map>
+#include <deque>
+#include <unordered_map>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
 
 #include <btBulletDynamicsCommon.h>
+#include <LinearMath/btAabbUtil2.h>
 
 #include "log_macros.h"
+#include "fnv_hash.h"
+#include "thread_pool.h"
+#include "static_bvh.h"
+#include "floor_map.h"
+#include "eq_physics_snapshot.h"
+#include "eq_physics_stats.h"
+#include "los_cache.h"
+#include "water_map_v1.h"
+#include "water_map_columns.h"
 #include "eq_physics.h"
+#include "zone_map.h"
 
-struct btMeshInfo
+//Sidecar written by WriteBvhFile: a header, an entry table, then each BVH exactly as serializeInPlace left it.
+//Entries are keyed by a hash of the source geometry rather than a name so a stale file can never be matched
+//to a different mesh. The serialized BVH is a raw image of Bullet's structures so the file is only good
+//for the same Bullet version, scalar size, pointer size and byte order that wrote it.
+const char BvhFileMagic[8] = { 'E', 'Q', 'E', 'M', 'U', 'B', 'V', 'H' };
+const uint32_t BvhFileVersion = 1;
+const uint32_t BvhFileByteOrder = 0x01020304;
+
+struct bvh_file_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t bullet_version;
+	uint32_t scalar_size;
+	uint32_t pointer_size;
+	uint32_t entry_count;
+};
+
+struct bvh_file_entry
+{
+	uint64_t fingerprint;
+	uint64_t data_offset;
+	uint64_t data_size;
+	float aabb_min[3];
+	float aabb_max[3];
+};
+
+static uint64_t MeshFingerprint(const glm::vec3 *verts, uint32_t vert_count, const uint32_t *inds, uint32_t tri_count, uint32_t index_stride) {
+	uint64_t counts[2] = { vert_count, (uint64_t)tri_count * 3 };
+	uint64_t hash = EQEmu::FNV1a64(counts, sizeof(counts));
+	hash = EQEmu::FNV1a64(verts, vert_count * sizeof(glm::vec3), hash);
+	if (index_stride == sizeof(uint32_t) * 3) {
+		return EQEmu::FNV1a64(inds, tri_count * sizeof(uint32_t) * 3, hash);
+	}
+
+	const char *tri = (const char*)inds;
+	for (uint32_t i = 0; i < tri_count; ++i) {
+		hash = EQEmu::FNV1a64(tri, sizeof(uint32_t) * 3, hash);
+		tri += index_stride;
+	}
+
+	return hash;
+}
+
+static void FillBvhHeader(bvh_file_header &header, uint32_t entry_count) {
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BvhFileMagic, sizeof(header.magic));
+	header.version = BvhFileVersion;
+	header.byte_order = BvhFileByteOrder;
+	header.bullet_version = BT_BULLET_VERSION;
+	header.scalar_size = sizeof(btScalar);
+	header.pointer_size = sizeof(void*);
+	header.entry_count = entry_count;
+}
+
+//A BVH deserialized in place lives inside its own aligned load buffer
+struct btBvhBufferDeleter
 {
-	btMeshInfo(btTriangleMesh* mesh_in, btBvhTriangleMeshShape* mesh_shape_in, btRigidBody* rb_in) {
-		mesh.reset(mesh_in);
-		mesh_shape.reset(mesh_shape_in);
-		rb.reset(rb_in);
+	void operator()(btOptimizedBvh *bvh) const {
+		bvh->~btOptimizedBvh();
+		btAlignedFree(bvh);
 	}
+};
 
-	std::unique_ptr<btTriangleMesh> mesh;
+struct btMeshInfo
+{
+	btMeshInfo() : fingerprint(0), static_world(false), handle(EQPhysicsInvalidHandle), flag(0), model(nullptr) { }
+
+	//declaration order matters, the shapes have to go before the bvh they point at and all of them before the mesh
+	//mesh is either a btTriangleMesh holding its own copy or an array pointing at the caller's buffers; instances of
+	//a registered model have no mesh of their own and only a scaled shape wrapping the model's
+	std::unique_ptr<btTriangleIndexVertexArray> mesh;
+	std::unique_ptr<btOptimizedBvh, btBvhBufferDeleter> bvh;
 	std::unique_ptr<btBvhTriangleMeshShape> mesh_shape;
+	std::unique_ptr<btScaledBvhTriangleMeshShape> scaled_shape;
 	std::unique_ptr<btRigidBody> rb;
+	uint64_t fingerprint;
+	ZoneMapMeshView view;
+	//collidable geometry from RegisterZoneMap, answered by the static bvh instead when that engine is on
+	bool static_world;
+	//registered entities only, models have neither
+	EQPhysicsHandle handle;
+	std::string ident;
+	int flag;
+	//the model an instance's scaled shape wraps
+	btMeshInfo *model;
+	//the mesh in its own space for snapshots, built on the first publish that needs it
+	std::shared_ptr<const StaticBvh> query_bvh;
+};
+
+//Handles are a slot index under an 8 bit generation that's bumped whenever the slot is freed, generation 0 is never
+//used so no handle is ever EQPhysicsInvalidHandle. A slot whose generation would wrap is retired instead of reused, so
+//no handle is ever handed out twice.
+const uint32_t HandleIndexBits = 24;
+const uint32_t HandleIndexMask = (1u << HandleIndexBits) - 1;
+const uint32_t HandleMaxGeneration = 0xFFFFFFFFu >> HandleIndexBits;
+
+struct btMeshSlot
+{
+	std::unique_ptr<btMeshInfo> info;
+	uint32_t generation;
+};
+
+//A file written by WriteBvhFile with its entry table read once, so registering many meshes from it is a seek and a
+//read each rather than a scan of the whole table per mesh
+struct BvhFileReader
+{
+	BvhFileReader() : file(nullptr) { }
+	~BvhFileReader() { Close(); }
+
+	//Remembers filename even when it can't be used so a caller can tell it was already tried
+	bool Open(const std::string &filename) {
+		Close();
+		this->filename = filename;
+		file = fopen(filename.c_str(), "rb");
+		if (!file) {
+			return false;
+		}
+
+		bvh_file_header header;
+		bvh_file_header expected;
+		FillBvhHeader(expected, 0);
+		if (fread(&header, sizeof(header), 1, file) != 1) {
+			Close();
+			return false;
+		}
+
+		expected.entry_count = header.entry_count;
+		if (memcmp(&header, &expected, sizeof(header)) != 0) {
+			eqLogMessage(LogWarn, "BVH file %s was written by an incompatible build, ignoring it.", filename.c_str());
+			Close();
+			return false;
+		}
+
+		std::vector<bvh_file_entry> table(header.entry_count);
+		if (!table.empty() && fread(&table[0], sizeof(bvh_file_entry), table.size(), file) != table.size()) {
+			Close();
+			return false;
+		}
+
+		entries.reserve(table.size());
+		for (auto &entry : table) {
+			entries.insert(std::make_pair(entry.fingerprint, entry));
+		}
+
+		return true;
+	}
+
+	void Close() {
+		if (file) {
+			fclose(file);
+			file = nullptr;
+		}
+
+		entries.clear();
+	}
+
+	//Deserializes the entry for fingerprint; nullptr if there isn't a usable one
+	btOptimizedBvh *Load(uint64_t fingerprint, btVector3 &aabb_min, btVector3 &aabb_max) {
+		if (!file) {
+			return nullptr;
+		}
+
+		auto iter = entries.find(fingerprint);
+		if (iter == entries.end()) {
+			eqLogMessage(LogWarn, "BVH file %s has no entry for this mesh, it is probably older than the map.", filename.c_str());
+			return nullptr;
+		}
+
+		const bvh_file_entry &entry = iter->second;
+		if (entry.data_size == 0 || entry.data_size > 0xFFFFFFFFULL || fseek(file, (long)entry.data_offset, SEEK_SET) != 0) {
+			return nullptr;
+		}
+
+		void *buffer = btAlignedAlloc((size_t)entry.data_size, 16);
+		if (fread(buffer, (size_t)entry.data_size, 1, file) != 1) {
+			btAlignedFree(buffer);
+			return nullptr;
+		}
+
+		btOptimizedBvh *bvh = btOptimizedBvh::deSerializeInPlace(buffer, (unsigned int)entry.data_size, false);
+		if (!bvh) {
+			btAlignedFree(buffer);
+			return nullptr;
+		}
+
+		aabb_min.setValue(entry.aabb_min[0], entry.aabb_min[1], entry.aabb_min[2]);
+		aabb_max.setValue(entry.aabb_max[0], entry.aabb_max[1], entry.aabb_max[2]);
+		return bvh;
+	}
+
+	std::string filename;
+	FILE *file;
+	std::unordered_map<uint64_t, bvh_file_entry> entries;
+};
+
+//What a query runs against: Bullet's world, optionally with the static zone collision taken out and answered by the static bvh
+struct RayCaster
+{
+	const btCollisionWorld *world;
+	//single queries go through the world's rayTest and convexSweepTest, batches walk the dbvt themselves
+	bool broadphase;
+	const btDbvtBroadphase *dbvt;
+	const StaticBvh *static_bvh;
+	const btCollisionObject *static_body;
+	const std::vector<const btCollisionObject*> *static_bodies;
+	const FloorMap *floor_map;
+	bool verify_floors;
+	EQPhysicsStats *stats;
+	//set for batches, each range records into its own and merges once at the end
+	EQPhysicsStatsBatch *batch_stats;
 };
 
 struct EQPhysics::impl {
 	std::unique_ptr<WaterMap> water_map;
+	std::unique_ptr<FloorMap> floor_map;
+	bool verify_floors;
 	std::unique_ptr<btBroadphaseInterface> collision_broadphase;
 	std::unique_ptr<btDefaultCollisionConfiguration> collision_config;
 	std::unique_ptr<btCollisionDispatcher> collision_dispatch;
 	std::unique_ptr<btSequentialImpulseConstraintSolver> collision_solver;
 	std::unique_ptr<btDiscreteDynamicsWorld> collision_world;
-	std::unique_ptr<std::map<std::string, btMeshInfo>> entity_info;
+	EQEmu::ThreadPool *thread_pool;
+	EQPhysicsQueryEngine query_engine;
+	const ZoneMap *zone_map;
+	std::shared_ptr<StaticBvh> static_bvh;
+	const btCollisionObject *static_body;
+	//the body behind each of the static bvh's ranges, in AddCollidable's order
+	std::vector<const btCollisionObject*> static_bodies;
+	std::unique_ptr<std::map<std::string, btMeshInfo>> models;
+	std::vector<btMeshSlot> entity_slots;
+	//oldest freed first, so a slot sits out as long as possible before its next generation
+	std::deque<uint32_t> free_slots;
+	std::unordered_map<std::string, EQPhysicsHandle> entity_handles;
+	EQPhysicsSnapshotDomain snapshots;
+	std::shared_ptr<const StaticBvh> snapshot_world;
+	uint64_t snapshot_version;
+	mutable EQPhysicsStats stats;
+	std::unique_ptr<LOSCache> los_cache;
+	//the file RegisterZoneMap is loading from, kept open for all of its meshes
+	BvhFileReader *bvh_reader;
+	//bumped on every change a cached LOS result could depend on
+	std::atomic<uint64_t> geometry_version;
+
+	btMeshInfo *FindEntity(EQPhysicsHandle handle) const {
+		uint32_t index = handle & HandleIndexMask;
+		if (index >= entity_slots.size() || entity_slots[index].generation != handle >> HandleIndexBits) {
+			return nullptr;
+		}
+
+		return entity_slots[index].info.get();
+	}
+
+	btMeshInfo *FindEntity(const std::string &ident) const {
+		auto iter = entity_handles.find(ident);
+		return iter != entity_handles.end() ? FindEntity(iter->second) : nullptr;
+	}
+
+	btMeshInfo *AddEntity(const std::string &ident) {
+		uint32_t index;
+		if (!free_slots.empty()) {
+			index = free_slots.front();
+			free_slots.pop_front();
+		}
+		else {
+			if (entity_slots.size() > HandleIndexMask) {
+				eqLogMessage(LogError, "Out of physics handles, can't register %s.", ident.c_str());
+				return nullptr;
+			}
+
+			index = (uint32_t)entity_slots.size();
+			entity_slots.push_back(btMeshSlot());
+			entity_slots.back().generation = 1;
+		}
+
+		btMeshSlot &slot = entity_slots[index];
+		slot.info.reset(new btMeshInfo());
+		slot.info->handle = (slot.generation << HandleIndexBits) | index;
+		slot.info->ident = ident;
+		entity_handles[ident] = slot.info->handle;
+		return slot.info.get();
+	}
+
+	void RemoveEntity(btMeshInfo &info) {
+		uint32_t index = info.handle & HandleIndexMask;
+		btMeshSlot &slot = entity_slots[index];
+		entity_handles.erase(info.ident);
+		slot.info.reset();
+		if (slot.generation < HandleMaxGeneration) {
+			++slot.generation;
+			free_slots.push_back(index);
+		}
+	}
+
+	bool ModelInUse(const btMeshInfo &model) const {
+		for (auto &slot : entity_slots) {
+			if (slot.info && slot.info->model == &model) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void CollectStaticBodies() {
+		static_bodies.clear();
+		btMeshInfo *info = FindEntity("CollideWorldMesh");
+		static_bodies.push_back(info ? info->rb.get() : nullptr);
+		for (uint32_t i = 0; i < zone_map->GetInstanceCount(); ++i) {
+			char ident[64];
+			snprintf(ident, sizeof(ident), "CollideWorldMesh:%u", i);
+			info = FindEntity(ident);
+			static_bodies.push_back(info ? info->rb.get() : nullptr);
+		}
+	}
+
+	RayCaster Caster(bool broadphase) const {
+		RayCaster caster;
+		caster.world = collision_world.get();
+		caster.broadphase = broadphase;
+		caster.dbvt = static_cast<const btDbvtBroadphase*>(collision_broadphase.get());
+		caster.static_bvh = static_bvh.get();
+		caster.static_body = static_body;
+		caster.static_bodies = &static_bodies;
+		caster.floor_map = floor_map.get();
+		caster.verify_floors = verify_floors;
+		caster.stats = &stats;
+		caster.batch_stats = nullptr;
+		return caster;
+	}
 };
 
 EQPhysics::EQPhysics() {
@@ -48,7 +376,15 @@ EQPhysics::EQPhysics() {
 
 	imp->collision_world->setGravity(btVector3(0, -9.8f, 0.0));
 
-	imp->entity_info.reset(new std::map<std::string, btMeshInfo>());
+	imp->verify_floors = true;
+	imp->snapshot_version = 0;
+	imp->geometry_version.store(1);
+	imp->thread_pool = nullptr;
+	imp->query_engine = QueryEngineBullet;
+	imp->zone_map = nullptr;
+	imp->static_body = nullptr;
+	imp->bvh_reader = nullptr;
+	imp->models.reset(new std::map<std::string, btMeshInfo>());
 }
 
 EQPhysics::~EQPhysics() {
@@ -80,11 +416,67 @@ WaterMap *EQPhysics::GetWaterMap()
 	return imp->water_map.get();
 }
 
-void EQPhysics::RegisterMesh(const std::string &ident, const std::vector<glm::vec3>& verts, const std::vector<unsigned int>& inds, const glm::vec3 &pos, EQPhysicsFlags flag) {
+bool EQPhysics::BakeWaterColumns(const ZoneMap &map, float cell_size) {
+	WaterMapColumns *columns = dynamic_cast<WaterMapColumns*>(imp->water_map.get());
+	WaterMap *exact = columns ? columns->GetExact() : imp->water_map.get();
+	if (!dynamic_cast<WaterMapV1*>(exact) || cell_size <= 0.0f) {
+		return false;
+	}
+
+	if (!columns) {
+		columns = new WaterMapColumns(imp->water_map.release());
+		imp->water_map.reset(columns);
+	}
+
+	//water maps are asked (pos.x, pos.z, pos.y) as their y, x, z
+	const glm::vec3 &min = map.GetCollidableMin();
+	const glm::vec3 &max = map.GetCollidableMax();
+	return columns->Build(glm::vec3(min.z, min.x, min.y), glm::vec3(max.z, max.x, max.y), cell_size, imp->thread_pool);
+}
+
+void EQPhysics::SetFloorMap(FloorMap *f, bool verify) {
+	imp->floor_map.reset(f);
+	imp->verify_floors = verify;
+}
+
+void EQPhysics::SetThreadPool(EQEmu::ThreadPool *pool) {
+	imp->thread_pool = pool;
+}
+
+void EQPhysics::SetQueryEngine(EQPhysicsQueryEngine engine) {
+	imp->query_engine = engine;
+	if (engine == QueryEngineStaticBvh) {
+		BuildStaticBvh();
+	}
+	else {
+		imp->static_bvh.reset();
+	}
+}
+
+EQPhysicsQueryEngine EQPhysics::GetQueryEngine() const {
+	return imp->query_engine;
+}
+
+void EQPhysics::BuildStaticBvh() {
+	imp->static_bvh.reset();
+	if (!imp->zone_map) {
+		return;
+	}
+
+	StaticBvh *bvh = new StaticBvh();
+	bvh->AddCollidable(*imp->zone_map);
+	bvh->Build();
+	imp->static_bvh.reset(bvh);
+	imp->CollectStaticBodies();
+	eqLogMessage(LogDebug, "Built static query bvh with %u triangles in %u nodes.", bvh->GetTriangleCount(), bvh->GetNodeCount());
+}
+
+EQPhysicsHandle EQPhysics::RegisterMesh(const std::string &ident, const std::vector<glm::vec3>& verts, const std::vector<unsigned int>& inds, const glm::vec3 &pos, EQPhysicsFlags flag,
+	const std::string &bvh_filename) {
 	UnregisterMesh(ident);
 
 	if (verts.size() == 0 || inds.size() == 0) {
-		return;
+		return EQPhysicsInvalidHandle;
 	}
 
 	btTriangleMesh *mesh = new btTriangleMesh();
@@ -102,96 +494,741 @@ void EQPhysics::RegisterMesh(const std::string &ident, const std::vector<glm::ve
 		mesh->addTriangle(v1, v2, v3);
 	}
 
-	btBvhTriangleMeshShape *mesh_shape = new btBvhTriangleMeshShape(mesh, true, true);
+	uint64_t fingerprint = MeshFingerprint(&verts[0], (uint32_t)verts.size(), &inds[0], (uint32_t)face_count, sizeof(uint32_t) * 3);
+	return AddMeshShape(ident, mesh, fingerprint, pos, flag, bvh_filename);
+}
+
+EQPhysicsHandle EQPhysics::RegisterMeshView(const std::string &ident, const ZoneMapMeshView &view, const glm::vec3 &pos, EQPhysicsFlags flag, const std::string &bvh_filename) {
+	UnregisterMesh(ident);
+
+	if (view.vert_count == 0 || view.tri_count == 0) {
+		return EQPhysicsInvalidHandle;
+	}
+
+	btIndexedMesh part;
+	part.m_numTriangles = (int)view.tri_count;
+	part.m_triangleIndexBase = (const unsigned char*)view.inds;
+	part.m_triangleIndexStride = (int)view.index_stride;
+	part.m_numVertices = (int)view.vert_count;
+	part.m_vertexBase = (const unsigned char*)view.verts;
+	part.m_vertexStride = sizeof(glm::vec3);
+	part.m_indexType = PHY_INTEGER;
+	part.m_vertexType = PHY_FLOAT;
+
+	btTriangleIndexVertexArray *mesh = new btTriangleIndexVertexArray();
+	mesh->addIndexedMesh(part, PHY_INTEGER);
+
+	uint64_t fingerprint = MeshFingerprint(view.verts, view.vert_count, view.inds, view.tri_count, view.index_stride);
+	return AddMeshShape(ident, mesh, fingerprint, pos, flag, bvh_filename);
+}
+
+EQPhysicsHandle EQPhysics::AddMeshShape(const std::string &ident, btTriangleIndexVertexArray *mesh, uint64_t fingerprint, const glm::vec3 &pos, EQPhysicsFlags flag,
+	const std::string &bvh_filename) {
+	btMeshInfo *info = imp->AddEntity(ident);
+	if (!info) {
+		delete mesh;
+		return EQPhysicsInvalidHandle;
+	}
+
+	CreateMeshShape(ident, mesh, fingerprint, bvh_filename, info);
 
 	btTransform origin_transform;
 	origin_transform.setIdentity();
 	origin_transform.setOrigin(btVector3(pos.x, pos.y, pos.z));
+	AddBody(*info, info->mesh_shape.get(), origin_transform, flag);
+	return info->handle;
+}
+
+void EQPhysics::CreateMeshShape(const std::string &ident, btTriangleIndexVertexArray *mesh, uint64_t fingerprint, const std::string &bvh_filename, btMeshInfo *info) {
+	btOptimizedBvh *bvh = nullptr;
+	if (!bvh_filename.empty()) {
+		BvhFileReader one_off;
+		BvhFileReader *reader = imp->bvh_reader;
+		if (!reader || reader->filename != bvh_filename) {
+			reader = &one_off;
+			reader->Open(bvh_filename);
+		}
+
+		btVector3 aabb_min;
+		btVector3 aabb_max;
+		bvh = reader->Load(fingerprint, aabb_min, aabb_max);
+		if (bvh) {
+			//the saved bounds are the ones the bvh was quantized against, setting them also skips the shape's pass over every vertex
+			mesh->setPremadeAabb(aabb_min, aabb_max);
+		}
+		else {
+			eqLogMessage(LogInfo, "No usable baked BVH for %s in %s, building one.", ident.c_str(), bvh_filename.c_str());
+		}
+	}
 
-	btDefaultMotionState* motionState = new btDefaultMotionState(origin_transform);
-	btRigidBody::btRigidBodyConstructionInfo rb_info(0.0f, motionState, mesh_shape, btVector3(0.0f, 0.0f, 0.0f));
+	btBvhTriangleMeshShape *mesh_shape = nullptr;
+	if (bvh) {
+		mesh_shape = new btBvhTriangleMeshShape(mesh, true, false);
+		mesh_shape->setOptimizedBvh(bvh);
+	}
+	else {
+		mesh_shape = new btBvhTriangleMeshShape(mesh, true, true);
+	}
+
+	info->mesh.reset(mesh);
+	info->bvh.reset(bvh);
+	info->mesh_shape.reset(mesh_shape);
+	info->fingerprint = fingerprint;
+}
+
+void EQPhysics::AddBody(btMeshInfo &info, btCollisionShape *shape, const btTransform &transform, EQPhysicsFlags flag) {
+	btDefaultMotionState* motionState = new btDefaultMotionState(transform);
+	btRigidBody::btRigidBodyConstructionInfo rb_info(0.0f, motionState, shape, btVector3(0.0f, 0.0f, 0.0f));
 	btRigidBody *rb = new btRigidBody(rb_info);
 
+	rb->setUserPointer(&info);
 	imp->collision_world->addRigidBody(rb, (short)flag, (short)flag);
-	imp->entity_info->insert(std::make_pair(ident, btMeshInfo(mesh, mesh_shape, rb)));
+	info.rb.reset(rb);
+	info.flag = flag;
+	imp->geometry_version.fetch_add(1);
 }
 
-void EQPhysics::UnregisterMesh(const std::string &ident) {
-	auto iter = imp->entity_info->find(ident);
-	if (iter != imp->entity_info->end()) {
-		for (int i = 0; i < imp->collision_world->getNumCollisionObjects(); ++i) {
-			btCollisionObject* obj = imp->collision_world->getCollisionObjectArray()[i];
-			btRigidBody* body = btRigidBody::upcast(obj);
-
-			if (body == iter->second.rb.get()) {
-				if (body && body->getMotionState()) {
-					delete body->getMotionState();
-				}
+bool EQPhysics::RegisterModel(const std::string &model, const ZoneMapMeshView &view, const std::string &bvh_filename) {
+	//instances hold the model's shape, it can't go while any of them are still registered
+	auto existing = imp->models->find(model);
+	if (existing != imp->models->end()) {
+		if (imp->ModelInUse(existing->second)) {
+			eqLogMessage(LogWarn, "Not replacing model %s, it still has instances.", model.c_str());
+			return false;
+		}
+
+		imp->models->erase(existing);
+	}
 
-				imp->collision_world->removeCollisionObject(obj);
+	if (view.vert_count == 0 || view.tri_count == 0) {
+		return false;
+	}
+
+	btIndexedMesh part;
+	part.m_numTriangles = (int)view.tri_count;
+	part.m_triangleIndexBase = (const unsigned char*)view.inds;
+	part.m_triangleIndexStride = (int)view.index_stride;
+	part.m_numVertices = (int)view.vert_count;
+	part.m_vertexBase = (const unsigned char*)view.verts;
+	part.m_vertexStride = sizeof(glm::vec3);
+	part.m_indexType = PHY_INTEGER;
+	part.m_vertexType = PHY_FLOAT;
+
+	btTriangleIndexVertexArray *mesh = new btTriangleIndexVertexArray();
+	mesh->addIndexedMesh(part, PHY_INTEGER);
+
+	btMeshInfo &info = (*imp->models)[model];
+	uint64_t fingerprint = MeshFingerprint(view.verts, view.vert_count, view.inds, view.tri_count, view.index_stride);
+	CreateMeshShape(model, mesh, fingerprint, bvh_filename, &info);
+	info.view = view;
+	return true;
+}
+
+EQPhysicsHandle EQPhysics::RegisterInstance(const std::string &ident, const std::string &model, const glm::mat4 &transform, EQPhysicsFlags flag) {
+	UnregisterMesh(ident);
+
+	auto iter = imp->models->find(model);
+	if (iter == imp->models->end()) {
+		return EQPhysicsInvalidHandle;
+	}
+
+	//a scaled bvh shape is rotation and translation around a per axis scale, so the 3x3 part has to split into R * S;
+	//that needs orthogonal columns and no mirroring, a mirrored shape would also face its triangles the wrong way for
+	//back face culled rays. Anything else is registered as a transformed copy so results match the flattened map.
+	glm::vec3 axis[3] = { glm::vec3(transform[0]), glm::vec3(transform[1]), glm::vec3(transform[2]) };
+	float scale[3] = { glm::length(axis[0]), glm::length(axis[1]), glm::length(axis[2]) };
+	bool decomposable = scale[0] > 0.0f && scale[1] > 0.0f && scale[2] > 0.0f &&
+		glm::dot(glm::cross(axis[0], axis[1]), axis[2]) > 0.0f;
+	for (int i = 0; decomposable && i < 3; ++i) {
+		int j = (i + 1) % 3;
+		if (fabs(glm::dot(axis[i], axis[j])) > 0.0001f * scale[i] * scale[j]) {
+			decomposable = false;
+		}
+	}
+
+	if (!decomposable) {
+		auto &view = iter->second.view;
+		std::vector<glm::vec3> verts;
+		std::vector<unsigned int> inds;
+		verts.reserve(view.tri_count * 3);
+		inds.reserve(view.tri_count * 3);
+		const char *tri = (const char*)view.inds;
+		for (uint32_t i = 0; i < view.tri_count; ++i) {
+			const uint32_t *idx = (const uint32_t*)tri;
+			for (int k = 0; k < 3; ++k) {
+				inds.push_back((unsigned int)verts.size());
+				verts.push_back(glm::vec3(transform * glm::vec4(view.verts[idx[k]], 1.0f)));
 			}
+			tri += view.index_stride;
 		}
 
-		imp->entity_info->erase(iter);
+		return RegisterMesh(ident, verts, inds, glm::vec3(0.0f), flag);
+	}
+
+	for (int i = 0; i < 3; ++i) {
+		axis[i] /= scale[i];
+	}
+
+	btTransform instance_transform;
+	instance_transform.setIdentity();
+	instance_transform.setBasis(btMatrix3x3(axis[0].x, axis[1].x, axis[2].x,
+		axis[0].y, axis[1].y, axis[2].y,
+		axis[0].z, axis[1].z, axis[2].z));
+	instance_transform.setOrigin(btVector3(transform[3].x, transform[3].y, transform[3].z));
+
+	btMeshInfo *info = imp->AddEntity(ident);
+	if (!info) {
+		return EQPhysicsInvalidHandle;
 	}
+
+	info->model = &iter->second;
+	info->scaled_shape.reset(new btScaledBvhTriangleMeshShape(iter->second.mesh_shape.get(), btVector3(scale[0], scale[1], scale[2])));
+	AddBody(*info, info->scaled_shape.get(), instance_transform, flag);
+	return info->handle;
 }
 
-void EQPhysics::MoveMesh(const std::string &ident, const glm::vec3 &pos) {
-	auto iter = imp->entity_info->find(ident);
-	if (iter != imp->entity_info->end()) {
-		auto body = iter->second.rb.get();
-		if (body && body->getMotionState()) {
-			auto ms = body->getMotionState();
+void EQPhysics::RegisterZoneMap(const ZoneMap &map, const std::string &bvh_filename) {
+	//a previous map's placed models use its models, which this one is about to replace
+	std::vector<EQPhysicsHandle> placed;
+	for (auto &slot : imp->entity_slots) {
+		if (slot.info && (slot.info->ident.compare(0, 17, "CollideWorldMesh:") == 0 ||
+			slot.info->ident.compare(0, 20, "NonCollideWorldMesh:") == 0)) {
+			placed.push_back(slot.info->handle);
+		}
+	}
+
+	for (auto handle : placed) {
+		UnregisterMesh(handle);
+	}
+
+	BvhFileReader reader;
+	if (!bvh_filename.empty()) {
+		reader.Open(bvh_filename);
+		imp->bvh_reader = &reader;
+	}
+
+	RegisterMeshView("CollideWorldMesh", map.GetStaticCollidableMesh(), glm::vec3(0.0f), CollidableWorld, bvh_filename);
+	RegisterMeshView("NonCollideWorldMesh", map.GetStaticNonCollidableMesh(), glm::vec3(0.0f), NonCollidableWorld, bvh_filename);
+	MarkStaticWorld("CollideWorldMesh");
+
+	for (uint32_t i = 0; i < map.GetModelCount(); ++i) {
+		char name[32];
+		snprintf(name, sizeof(name), "%u", i);
+		RegisterModel(std::string("c") + name, map.GetModelMesh(i, true), bvh_filename);
+		RegisterModel(std::string("n") + name, map.GetModelMesh(i, false), bvh_filename);
+	}
+
+	for (uint32_t i = 0; i < map.GetInstanceCount(); ++i) {
+		uint32_t model;
+		glm::mat4 transform;
+		if (!map.GetInstance(i, model, transform)) {
+			continue;
+		}
 
-			btTransform origin_transform;
-			origin_transform.setIdentity();
-			origin_transform.setOrigin(btVector3(pos.x, pos.y, pos.z));
+		char name[32];
+		snprintf(name, sizeof(name), "%u", model);
+		char ident[64];
+		snprintf(ident, sizeof(ident), "CollideWorldMesh:%u", i);
+		RegisterInstance(ident, std::string("c") + name, transform, CollidableWorld);
+		MarkStaticWorld(ident);
+		snprintf(ident, sizeof(ident), "NonCollideWorldMesh:%u", i);
+		RegisterInstance(ident, std::string("n") + name, transform, NonCollidableWorld);
+	}
+
+	imp->bvh_reader = nullptr;
+	imp->zone_map = &map;
+	if (imp->query_engine == QueryEngineStaticBvh) {
+		BuildStaticBvh();
+	}
+}
+
+void EQPhysics::MarkStaticWorld(const std::string &ident) {
+	btMeshInfo *info = imp->FindEntity(ident);
+	if (info) {
+		info->static_world = true;
+		if (!imp->static_body) {
+			imp->static_body = info->rb.get();
+		}
+	}
+}
+
+//the static bvh is a copy of the zone's collision, once part of that moves or goes away it can't be used
+void EQPhysics::DropStaticBvh(btMeshInfo &info) {
+	if (info.static_world) {
+		imp->static_bvh.reset();
+		imp->snapshot_world.reset();
+		imp->static_bodies.clear();
+		imp->zone_map = nullptr;
+	}
+}
+
+void EQPhysics::UnregisterMesh(const std::string &ident) {
+	auto iter = imp->entity_handles.find(ident);
+	if (iter != imp->entity_handles.end()) {
+		UnregisterMesh(iter->second);
+	}
+}
+
+void EQPhysics::UnregisterMesh(EQPhysicsHandle handle) {
+	btMeshInfo *info = imp->FindEntity(handle);
+	if (!info) {
+		return;
+	}
 
-			ms->setWorldTransform(origin_transform);
+	DropStaticBvh(*info);
+	btRigidBody *body = info->rb.get();
+	if (imp->static_body == body) {
+		imp->static_body = nullptr;
+	}
+
+	if (body) {
+		if (body->getMotionState()) {
+			delete body->getMotionState();
 		}
+
+		imp->collision_world->removeRigidBody(body);
 	}
+
+	imp->RemoveEntity(*info);
+	imp->geometry_version.fetch_add(1);
+}
+
+EQPhysicsHandle EQPhysics::GetHandle(const std::string &ident) const {
+	auto iter = imp->entity_handles.find(ident);
+	return iter != imp->entity_handles.end() ? iter->second : EQPhysicsInvalidHandle;
+}
+
+std::string EQPhysics::GetIdent(EQPhysicsHandle handle) const {
+	btMeshInfo *info = imp->FindEntity(handle);
+	return info ? info->ident : std::string();
+}
+
+void EQPhysics::MoveMesh(const std::string &ident, const glm::vec3 &pos) {
+	MoveMesh(GetHandle(ident), pos);
+}
+
+void EQPhysics::MoveMesh(EQPhysicsHandle handle, const glm::vec3 &pos) {
+	btMeshInfo *info = imp->FindEntity(handle);
+	if (!info || !info->rb) {
+		return;
+	}
+
+	DropStaticBvh(*info);
+	btRigidBody *body = info->rb.get();
+	//only the origin moves, an instance keeps its rotation
+	btTransform transform = body->getWorldTransform();
+	transform.setOrigin(btVector3(pos.x, pos.y, pos.z));
+
+	//nothing ever steps the world so the body's own transform is what queries see, and its broadphase bounds have to
+	//be refit by hand
+	body->setWorldTransform(transform);
+	if (body->getMotionState()) {
+		body->getMotionState()->setWorldTransform(transform);
+	}
+
+	imp->collision_world->updateSingleAabb(body);
+	imp->geometry_version.fetch_add(1);
 }
 
 void EQPhysics::Step()
 {
 }
 
-bool EQPhysics::CheckLOS(const glm::vec3 &src, const glm::vec3 &dest) const {
-	btVector3 src_bt(src.x, src.y, src.z);
-	btVector3 dest_bt(dest.x, dest.y, dest.z);
+//Copies a Bullet mesh into a bvh in the mesh's own space
+static std::shared_ptr<const StaticBvh> BuildQueryBvh(const btStridingMeshInterface &mesh) {
+	StaticBvh *bvh = new StaticBvh();
+	for (int part = 0; part < mesh.getNumSubParts(); ++part) {
+		const unsigned char *vertex_base;
+		const unsigned char *index_base;
+		int vert_count, vert_stride, index_stride, tri_count;
+		PHY_ScalarType vert_type, index_type;
+		mesh.getLockedReadOnlyVertexIndexBase(&vertex_base, vert_count, vert_type, vert_stride, &index_base, index_stride, tri_count, index_type, part);
+		if (vert_type == PHY_FLOAT && (index_type == PHY_INTEGER || index_type == PHY_SHORT)) {
+			std::vector<glm::vec3> verts(vert_count);
+			for (int i = 0; i < vert_count; ++i) {
+				const float *v = (const float*)(vertex_base + (size_t)i * vert_stride);
+				verts[i] = glm::vec3(v[0], v[1], v[2]);
+			}
+
+			std::vector<uint32_t> inds((size_t)tri_count * 3);
+			for (int i = 0; i < tri_count; ++i) {
+				const unsigned char *tri = index_base + (size_t)i * index_stride;
+				for (int k = 0; k < 3; ++k) {
+					inds[i * 3 + k] = index_type == PHY_INTEGER ? ((const uint32_t*)tri)[k] : ((const uint16_t*)tri)[k];
+				}
+			}
+
+			if (tri_count > 0) {
+				bvh->AddTriangles(&verts[0], &inds[0], (uint32_t)tri_count, sizeof(uint32_t) * 3, glm::mat4(1.0f));
+			}
+		}
+
+		mesh.unLockReadOnlyVertexBase(part);
+	}
+
+	bvh->Build();
+	return std::shared_ptr<const StaticBvh>(bvh);
+}
+
+static glm::mat4 ToMat4(const btTransform &transform) {
+	btScalar m[16];
+	transform.getOpenGLMatrix(m);
+	glm::mat4 out;
+	for (int c = 0; c < 4; ++c) {
+		for (int r = 0; r < 4; ++r) {
+			out[c][r] = (float)m[c * 4 + r];
+		}
+	}
+
+	return out;
+}
+
+void EQPhysics::PublishSnapshot() {
+	if (!imp->snapshot_world && imp->zone_map) {
+		if (imp->static_bvh) {
+			imp->snapshot_world = imp->static_bvh;
+		}
+		else {
+			StaticBvh *bvh = new StaticBvh();
+			bvh->AddCollidable(*imp->zone_map);
+			bvh->Build();
+			imp->snapshot_world.reset(bvh);
+			imp->CollectStaticBodies();
+		}
+	}
+
+	std::vector<EQPhysicsSnapshotEntity> entities;
+	for (auto &slot : imp->entity_slots) {
+		btMeshInfo *info = slot.info.get();
+		if (!info || !info->rb || (info->static_world && imp->snapshot_world)) {
+			continue;
+		}
+
+		btMeshInfo *source = info->model ? info->model : info;
+		if (!source->query_bvh) {
+			if (!source->mesh) {
+				continue;
+			}
+
+			source->query_bvh = BuildQueryBvh(*source->mesh);
+		}
+
+		if (source->query_bvh->GetTriangleCount() == 0) {
+			continue;
+		}
+
+		EQPhysicsSnapshotEntity e;
+		e.handle = info->handle;
+		e.flag = info->flag;
+		e.to_world = ToMat4(info->rb->getWorldTransform());
+		if (info->scaled_shape) {
+			const btVector3 &scale = info->scaled_shape->getLocalScaling();
+			e.to_world = e.to_world * glm::mat4(glm::vec4(scale.x(), 0.0f, 0.0f, 0.0f), glm::vec4(0.0f, scale.y(), 0.0f, 0.0f),
+				glm::vec4(0.0f, 0.0f, scale.z(), 0.0f), glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+		}
+
+		e.to_local = glm::inverse(e.to_world);
+		const btBroadphaseProxy *proxy = info->rb->getBroadphaseHandle();
+		e.min = glm::vec3(proxy->m_aabbMin.x(), proxy->m_aabbMin.y(), proxy->m_aabbMin.z());
+		e.max = glm::vec3(proxy->m_aabbMax.x(), proxy->m_aabbMax.y(), proxy->m_aabbMax.z());
+		e.bvh = source->query_bvh;
+		entities.push_back(e);
+	}
+
+	EQPhysicsHandle world_handle = imp->static_body ? ((const btMeshInfo*)imp->static_body->getUserPointer())->handle : EQPhysicsInvalidHandle;
+	std::vector<EQPhysicsHandle> world_handles;
+	for (auto body : imp->static_bodies) {
+		world_handles.push_back(body ? ((const btMeshInfo*)body->getUserPointer())->handle : EQPhysicsInvalidHandle);
+	}
+
+	imp->snapshots.Publish(new EQPhysicsSnapshot(++imp->snapshot_version, imp->snapshot_world, world_handle, world_handles, entities));
+}
+
+const EQPhysicsStats &EQPhysics::GetStats() const {
+	return imp->stats;
+}
 
-	btCollisionWorld::ClosestRayResultCallback los_hit(src_bt, dest_bt);
-	los_hit.m_collisionFilterGroup = (short)CollidableWorld;
-	los_hit.m_collisionFilterMask = (short)CollidableWorld;
+void EQPhysics::ResetStats() {
+	imp->stats.Reset();
+}
+
+void EQPhysics::EnableLOSCache(float cell_size, uint32_t entries) {
+	if (cell_size <= 0.0f || entries == 0) {
+		DisableLOSCache();
+		return;
+	}
 
-	imp->collision_world->rayTest(src_bt, dest_bt, los_hit);
+	imp->los_cache.reset(new LOSCache(cell_size, entries));
+}
+
+void EQPhysics::DisableLOSCache() {
+	imp->los_cache.reset();
+}
 
-	if(los_hit.hasHit()) {
+bool EQPhysics::GetLOSCacheStats(LOSCacheStats &out) const {
+	if (!imp->los_cache) {
+		memset(&out, 0, sizeof(out));
 		return false;
 	}
 
+	out = imp->los_cache->GetStats();
 	return true;
 }
 
-bool EQPhysics::GetRaycastClosestHit(const glm::vec3 & src, const glm::vec3 & dest, glm::vec3 &hit, std::string *name, int flag) const
+void EQPhysics::ResetLOSCacheStats() {
+	if (imp->los_cache) {
+		imp->los_cache->ResetStats();
+	}
+}
+
+uint64_t EQPhysics::GetGeometryVersion() const {
+	return imp->geometry_version.load();
+}
+
+EQPhysicsSnapshotRef EQPhysics::AcquireSnapshot() const {
+	return imp->snapshots.Acquire();
+}
+
+bool EQPhysics::WriteBvhFile(const std::string &filename) const {
+	std::vector<bvh_file_entry> entries;
+	std::vector<std::vector<char>> blobs;
+	std::vector<std::pair<const std::string*, const btMeshInfo*>> meshes;
+	for (auto iter = imp->models->begin(); iter != imp->models->end(); ++iter) {
+		meshes.push_back(std::make_pair(&iter->first, &iter->second));
+	}
+
+	for (auto &slot : imp->entity_slots) {
+		if (slot.info) {
+			meshes.push_back(std::make_pair(&slot.info->ident, (const btMeshInfo*)slot.info.get()));
+		}
+	}
+
+	for (auto &mesh : meshes) {
+		btBvhTriangleMeshShape *shape = mesh.second->mesh_shape.get();
+		btOptimizedBvh *bvh = shape ? shape->getOptimizedBvh() : nullptr;
+		if (!bvh) {
+			continue;
+		}
+
+		unsigned int size = bvh->calculateSerializeBufferSize();
+		void *buffer = btAlignedAlloc(size, 16);
+		if (!bvh->serializeInPlace(buffer, size, false)) {
+			eqLogMessage(LogError, "Failed to serialize BVH for %s.", mesh.first->c_str());
+			btAlignedFree(buffer);
+			return false;
+		}
+
+		blobs.push_back(std::vector<char>((char*)buffer, (char*)buffer + size));
+		btAlignedFree(buffer);
+
+		bvh_file_entry entry;
+		memset(&entry, 0, sizeof(entry));
+		entry.fingerprint = mesh.second->fingerprint;
+		entry.data_size = size;
+		for (int i = 0; i < 3; ++i) {
+			entry.aabb_min[i] = shape->getLocalAabbMin()[i];
+			entry.aabb_max[i] = shape->getLocalAabbMax()[i];
+		}
+		entries.push_back(entry);
+	}
+
+	uint64_t offset = sizeof(bvh_file_header) + entries.size() * sizeof(bvh_file_entry);
+	for (auto &entry : entries) {
+		entry.data_offset = (offset + 15) & ~(uint64_t)15;
+		offset = entry.data_offset + entry.data_size;
+	}
+
+	FILE *f = fopen(filename.c_str(), "wb");
+	if (!f) {
+		eqLogMessage(LogError, "Unable to open %s for writing.", filename.c_str());
+		return false;
+	}
+
+	bvh_file_header header;
+	FillBvhHeader(header, (uint32_t)entries.size());
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	if (ok && !entries.empty()) {
+		ok = fwrite(&entries[0], sizeof(bvh_file_entry), entries.size(), f) == entries.size();
+	}
+
+	const char pad[16] = { 0 };
+	uint64_t pos = sizeof(header) + entries.size() * sizeof(bvh_file_entry);
+	for (size_t i = 0; ok && i < entries.size(); ++i) {
+		if (entries[i].data_offset > pos) {
+			ok = fwrite(pad, (size_t)(entries[i].data_offset - pos), 1, f) == 1;
+		}
+
+		ok = ok && fwrite(&blobs[i][0], blobs[i].size(), 1, f) == 1;
+		pos = entries[i].data_offset + entries[i].data_size;
+	}
+
+	if (fclose(f) != 0) {
+		ok = false;
+	}
+
+	if (!ok) {
+		eqLogMessage(LogError, "Failed writing BVH file %s.", filename.c_str());
+		remove(filename.c_str());
+	}
+
+	return ok;
+}
+
+//Closest hit callback that can leave out the bodies the static bvh already covers. With any_hit set it's an occlusion
+//query instead: the first hit drops the closest fraction to zero, which stops Bullet testing further bodies and
+//rejects every remaining triangle at its first check.
+struct WorldRayCallback : public btCollisionWorld::ClosestRayResultCallback
 {
-	btVector3 src_bt(src.x, src.y, src.z);
-	btVector3 dest_bt(dest.x, dest.y, dest.z);
+	WorldRayCallback() : btCollisionWorld::ClosestRayResultCallback(btVector3(0.0f, 0.0f, 0.0f), btVector3(0.0f, 0.0f, 0.0f)), skip_static_world(false), any_hit(false) { }
 
-	btCollisionWorld::ClosestRayResultCallback ray_hit(src_bt, dest_bt);
-	ray_hit.m_collisionFilterGroup = flag;
-	ray_hit.m_collisionFilterMask = flag;
-	ray_hit.m_flags |= 1;
+	virtual btScalar addSingleResult(btCollisionWorld::LocalRayResult &ray_result, bool normal_in_world_space) {
+		if (any_hit) {
+			m_collisionObject = ray_result.m_collisionObject;
+			m_closestHitFraction = 0.0f;
+			return 0.0f;
+		}
 
-	imp->collision_world->rayTest(src_bt, dest_bt, ray_hit);
+		return btCollisionWorld::ClosestRayResultCallback::addSingleResult(ray_result, normal_in_world_space);
+	}
 
-	if (ray_hit.hasHit()) {
-		hit.x = ray_hit.m_hitPointWorld.x();
-		hit.y = ray_hit.m_hitPointWorld.y();
-		hit.z = ray_hit.m_hitPointWorld.z();
-		if (name) {
-			GetEntityHit(ray_hit.m_collisionObject, *name);
+	virtual bool needsCollision(btBroadphaseProxy *proxy) const {
+		if (skip_static_world) {
+			const btCollisionObject *obj = (const btCollisionObject*)proxy->m_clientObject;
+			const btMeshInfo *info = (const btMeshInfo*)obj->getUserPointer();
+			if (info && info->static_world) {
+				return false;
+			}
 		}
+
+		return btCollisionWorld::ClosestRayResultCallback::needsCollision(proxy);
+	}
+
+	bool skip_static_world;
+	bool any_hit;
+};
+
+static EQPhysicsHandle HandleOf(const btCollisionObject *obj) {
+	const btMeshInfo *info = obj ? (const btMeshInfo*)obj->getUserPointer() : nullptr;
+	return info ? info->handle : EQPhysicsInvalidHandle;
+}
+
+//the mesh a static bvh triangle came from, CollideWorldMesh or one of its instances
+static const btCollisionObject *StaticBody(const RayCaster &caster, uint32_t triangle) {
+	uint32_t range = caster.static_bvh->GetRange(triangle);
+	if (range < caster.static_bodies->size() && (*caster.static_bodies)[range]) {
+		return (*caster.static_bodies)[range];
+	}
+
+	return caster.static_body;
+}
+
+static bool UsesStaticBvh(const RayCaster &caster, const WorldRayCallback &cb) {
+	return caster.static_bvh && (cb.m_collisionFilterGroup & CollidableWorld) != 0 && (cb.m_collisionFilterMask & CollidableWorld) != 0;
+}
+
+//Tests the bodies whose leaves a ray reaches in the dbvt, the same per body test the broadphase's rayTest callback does
+struct BatchRayPolicy : public btDbvt::ICollide
+{
+	BatchRayPolicy(WorldRayCallback &cb) : cb(cb) {
+		from.setIdentity();
+		from.setOrigin(cb.m_rayFromWorld);
+		to.setIdentity();
+		to.setOrigin(cb.m_rayToWorld);
+	}
+
+	virtual void Process(const btDbvtNode *leaf) {
+		if (cb.any_hit && cb.hasHit()) {
+			return;
+		}
+
+		btBroadphaseProxy *proxy = (btBroadphaseProxy*)leaf->data;
+		if (!cb.needsCollision(proxy)) {
+			return;
+		}
+
+		//the tree only culls against the whole ray, this drops bodies past the closest hit so far
+		btScalar param = cb.m_closestHitFraction;
+		btVector3 box_normal;
+		if (!btRayAabb(cb.m_rayFromWorld, cb.m_rayToWorld, proxy->m_aabbMin, proxy->m_aabbMax, param, box_normal)) {
+			return;
+		}
+
+		btCollisionObject *obj = (btCollisionObject*)proxy->m_clientObject;
+		btCollisionWorld::rayTestSingle(from, to, obj, obj->getCollisionShape(), obj->getWorldTransform(), cb);
+	}
+
+	WorldRayCallback &cb;
+	btTransform from;
+	btTransform to;
+};
+
+//Batched queries can't go through the world's rayTest, the dbvt broadphase keeps one shared traversal stack in itself so
+//only one ray can be in it at a time. btDbvt's static rayTest keeps its stack local, so each ray walks both of the
+//broadphase's trees with its own policy; nothing writes the trees during a query.
+static void CastRay(const RayCaster &caster, WorldRayCallback &cb) {
+	cb.skip_static_world = UsesStaticBvh(caster, cb);
+	if (cb.skip_static_world) {
+		glm::vec3 from(cb.m_rayFromWorld.x(), cb.m_rayFromWorld.y(), cb.m_rayFromWorld.z());
+		glm::vec3 to(cb.m_rayToWorld.x(), cb.m_rayToWorld.y(), cb.m_rayToWorld.z());
+		StaticBvhHit hit;
+		if (cb.any_hit) {
+			if (caster.static_bvh->Occluded(from, to, (cb.m_flags & 1) != 0)) {
+				cb.m_closestHitFraction = 0.0f;
+				cb.m_collisionObject = caster.static_body;
+				return;
+			}
+		}
+		else if (caster.static_bvh->Raycast(from, to, (cb.m_flags & 1) != 0, cb.m_closestHitFraction, hit)) {
+			cb.m_closestHitFraction = hit.fraction;
+			cb.m_collisionObject = StaticBody(caster, hit.triangle);
+			cb.m_hitNormalWorld.setValue(hit.normal.x, hit.normal.y, hit.normal.z);
+			cb.m_hitPointWorld = cb.m_rayFromWorld.lerp(cb.m_rayToWorld, hit.fraction);
+		}
+	}
+
+	if (caster.broadphase) {
+		caster.world->rayTest(cb.m_rayFromWorld, cb.m_rayToWorld, cb);
+		return;
+	}
+
+	BatchRayPolicy policy(cb);
+	for (int i = 0; i < 2; ++i) {
+		if (caster.dbvt->m_sets[i].m_root && !(cb.any_hit && cb.hasHit())) {
+			btDbvt::rayTest(caster.dbvt->m_sets[i].m_root, cb.m_rayFromWorld, cb.m_rayToWorld, policy);
+		}
+	}
+}
+
+//Readies a callback for another ray so batches can keep one per worker
+static void ResetRayCallback(WorldRayCallback &cb, const btVector3 &from, const btVector3 &to, int flag, unsigned int flags, bool any_hit = false) {
+	cb.m_rayFromWorld = from;
+	cb.m_rayToWorld = to;
+	cb.m_closestHitFraction = 1.0f;
+	cb.m_collisionObject = nullptr;
+	cb.m_collisionFilterGroup = (short)flag;
+	cb.m_collisionFilterMask = (short)flag;
+	cb.m_flags = flags;
+	cb.any_hit = any_hit;
+}
+
+//untimed, CachedLOS records the stat so it covers cache hits as well
+static bool CastLOS(const RayCaster &caster, WorldRayCallback &cb, const glm::vec3 &src, const glm::vec3 &dest) {
+	ResetRayCallback(cb, btVector3(src.x, src.y, src.z), btVector3(dest.x, dest.y, dest.z), CollidableWorld, 0, true);
+	CastRay(caster, cb);
+	return !cb.hasHit();
+}
+
+static bool CastClosestHit(const RayCaster &caster, WorldRayCallback &cb, const glm::vec3 &src, const glm::vec3 &dest,
+	glm::vec3 &hit, int flag) {
+	EQPhysicsStatsScope stat(caster.stats, caster.batch_stats, QueryTypeClosestHit);
+	ResetRayCallback(cb, btVector3(src.x, src.y, src.z), btVector3(dest.x, dest.y, dest.z), flag, 1);
+	CastRay(caster, cb);
+
+	if (cb.hasHit()) {
+		stat.SetHit(true);
+		hit.x = cb.m_hitPointWorld.x();
+		hit.y = cb.m_hitPointWorld.y();
+		hit.z = cb.m_hitPointWorld.z();
 		return true;
 	}
 
@@ -201,25 +1238,58 @@ bool EQPhysics::GetRaycastClosestHit(const glm::vec3 & src, const glm::vec3 & de
 	return false;
 }
 
-float EQPhysics::FindBestFloor(const glm::vec3 &start, glm::vec3 *result, glm::vec3 *normal) const {
+static float CastBestFloor(const RayCaster &caster, WorldRayCallback &cb, const glm::vec3 &start,
+	glm::vec3 *result, glm::vec3 *normal) {
+	EQPhysicsStatsScope stat(caster.stats, caster.batch_stats, QueryTypeBestFloor);
 	btVector3 from(start.x, start.y + 1.0f, start.z);
 	btVector3 to(start.x, start.y - 3000.0f, start.z);
+	bool hit = false;
+
+	//a baked floor sampled at the cell centre can sit above the one under start on a slope, so it's looked up a cell
+	//higher and the short ray reaches two cells past it; anything closer than the baked floor is hit first regardless
+	float baked;
+	const FloorMap *floor_map = caster.floor_map;
+	if (floor_map && floor_map->FindFloor(start.x, from.y() + floor_map->GetCellSize(), start.z, baked) && baked >= to.y()) {
+		if (!caster.verify_floors && !normal) {
+			stat.SetHit(true);
+			if (result) {
+				*result = glm::vec3(start.x, baked, start.z);
+			}
 
-	btCollisionWorld::ClosestRayResultCallback hit_below(from, to);
-	hit_below.m_collisionFilterGroup = (short)CollidableWorld;
-	hit_below.m_collisionFilterMask = (short)CollidableWorld;
-	hit_below.m_flags |= 1;
+			return baked;
+		}
 
-	imp->collision_world->rayTest(from, to, hit_below);
+		btVector3 near_to(start.x, std::max(to.y(), std::min(baked, from.y()) - 2.0f * floor_map->GetCellSize()), start.z);
+		ResetRayCallback(cb, from, near_to, CollidableWorld, 1);
+		CastRay(caster, cb);
+		hit = cb.hasHit();
+		if (hit) {
+			to = near_to;
+		}
+	}
 
-	if(hit_below.hasHit()) {
+	if (!hit) {
+		ResetRayCallback(cb, from, to, CollidableWorld, 1);
+		CastRay(caster, cb);
+		hit = cb.hasHit();
+	}
+
+	if (!hit) {
+		to.setY(start.y + 3000.0f);
+		ResetRayCallback(cb, from, to, CollidableWorld, 0);
+		CastRay(caster, cb);
+		hit = cb.hasHit();
+	}
+
+	stat.SetHit(hit);
+	if(hit) {
 		if(normal) {
-			normal->x = hit_below.m_hitNormalWorld.getX();
-			normal->y = hit_below.m_hitNormalWorld.getY();
-			normal->z = hit_below.m_hitNormalWorld.getZ();
+			normal->x = cb.m_hitNormalWorld.getX();
+			normal->y = cb.m_hitNormalWorld.getY();
+			normal->z = cb.m_hitNormalWorld.getZ();
 		}
 
-		btVector3 p = from.lerp(to, hit_below.m_closestHitFraction);
+		btVector3 p = from.lerp(to, cb.m_closestHitFraction);
 
 		if(result) {
 			result->x = p.getX();
@@ -230,86 +1300,356 @@ float EQPhysics::FindBestFloor(const glm::vec3 &start, glm::vec3 *result, glm::v
 		return p.getY();
 	}
 
-	to.setY(start.y + 3000.0f);
-	btCollisionWorld::ClosestRayResultCallback hit_above(from, to);
-	hit_above.m_collisionFilterGroup = (short)CollidableWorld;
-	hit_above.m_collisionFilterMask = (short)CollidableWorld;
+	return -FLT_MAX;
+}
 
-	imp->collision_world->rayTest(from, to, hit_above);
+//Tests the bodies in the dbvt whose bounds, grown by the shape's own, the sweep passes through
+struct BatchSweepPolicy : public btDbvt::ICollide
+{
+	BatchSweepPolicy(const btConvexShape &shape, const btTransform &from, const btTransform &to, btCollisionWorld::ClosestConvexResultCallback &cb)
+		: shape(shape), from(from), to(to), cb(cb) {
+		btTransform identity;
+		identity.setIdentity();
+		shape.getAabb(identity, shape_min, shape_max);
+	}
 
-	if(hit_above.hasHit()) {
-		if(normal) {
-			normal->x = hit_above.m_hitNormalWorld.getX();
-			normal->y = hit_above.m_hitNormalWorld.getY();
-			normal->z = hit_above.m_hitNormalWorld.getZ();
+	virtual void Process(const btDbvtNode *leaf) {
+		btBroadphaseProxy *proxy = (btBroadphaseProxy*)leaf->data;
+		if (!cb.needsCollision(proxy)) {
+			return;
 		}
 
-		btVector3 p = from.lerp(to, hit_above.m_closestHitFraction);
+		btVector3 aabb_min = proxy->m_aabbMin;
+		btVector3 aabb_max = proxy->m_aabbMax;
+		AabbExpand(aabb_min, aabb_max, shape_min, shape_max);
 
-		if(result) {
-			result->x = p.getX();
-			result->y = p.getY();
-			result->z = p.getZ();
+		btScalar param = cb.m_closestHitFraction;
+		btVector3 box_normal;
+		if (!btRayAabb(from.getOrigin(), to.getOrigin(), aabb_min, aabb_max, param, box_normal)) {
+			return;
 		}
 
-		return p.getY();
+		btCollisionObject *obj = (btCollisionObject*)proxy->m_clientObject;
+		btCollisionWorld::objectQuerySingle(&shape, from, to, obj, obj->getCollisionShape(), obj->getWorldTransform(), cb, 0.0f);
 	}
 
-	return -FLT_MAX;
+	const btConvexShape &shape;
+	const btTransform &from;
+	const btTransform &to;
+	btCollisionWorld::ClosestConvexResultCallback &cb;
+	btVector3 shape_min;
+	btVector3 shape_max;
+};
+
+//Same split as CastRay: single queries go through the broadphase, batches collect the leaves the box around the whole
+//sweep overlaps, collideTV keeps its stack local too, and test those like convexSweepTest does.
+static bool CastSweep(const RayCaster &caster, const btConvexShape &shape, const glm::vec3 &src, const glm::vec3 &dest,
+	int flag, EQPhysicsRayHit &hit) {
+	EQPhysicsStatsScope stat(caster.stats, caster.batch_stats, QueryTypeSweep);
+	btTransform from;
+	from.setIdentity();
+	from.setOrigin(btVector3(src.x, src.y, src.z));
+
+	btTransform to;
+	to.setIdentity();
+	to.setOrigin(btVector3(dest.x, dest.y, dest.z));
+
+	btCollisionWorld::ClosestConvexResultCallback cb(from.getOrigin(), to.getOrigin());
+	cb.m_collisionFilterGroup = (short)flag;
+	cb.m_collisionFilterMask = (short)flag;
+
+	if (caster.broadphase) {
+		caster.world->convexSweepTest(&shape, from, to, cb);
+	}
+	else {
+		BatchSweepPolicy policy(shape, from, to, cb);
+		btVector3 sweep_min = from.getOrigin();
+		btVector3 sweep_max = from.getOrigin();
+		sweep_min.setMin(to.getOrigin());
+		sweep_max.setMax(to.getOrigin());
+		btDbvtVolume volume = btDbvtVolume::FromMM(sweep_min + policy.shape_min, sweep_max + policy.shape_max);
+		for (int i = 0; i < 2; ++i) {
+			if (caster.dbvt->m_sets[i].m_root) {
+				caster.dbvt->m_sets[i].collideTV(caster.dbvt->m_sets[i].m_root, volume, policy);
+			}
+		}
+	}
+
+	hit.hit = cb.hasHit();
+	stat.SetHit(hit.hit);
+	if (hit.hit) {
+		hit.point = glm::vec3(cb.m_hitPointWorld.x(), cb.m_hitPointWorld.y(), cb.m_hitPointWorld.z());
+		hit.normal = glm::vec3(cb.m_hitNormalWorld.x(), cb.m_hitNormalWorld.y(), cb.m_hitNormalWorld.z());
+		hit.fraction = cb.m_closestHitFraction;
+		hit.handle = HandleOf(cb.m_hitCollisionObject);
+	}
+	else {
+		hit.point = glm::vec3(0.0f);
+		hit.normal = glm::vec3(0.0f);
+		hit.fraction = 1.0f;
+		hit.handle = EQPhysicsInvalidHandle;
+	}
+
+	return hit.hit;
+}
+
+//Runs fn(begin, end) over the batch on the pool if there is one and the batch is worth splitting
+static void RunBatch(EQEmu::ThreadPool *pool, size_t count, const std::function<void(size_t, size_t)> &fn) {
+	if (pool && pool->Size() > 1 && count >= 64) {
+		pool->ParallelFor(count, fn);
+	}
+	else if (count > 0) {
+		fn(0, count);
+	}
+}
+
+//Goes through the LOS cache when one is enabled, the version is read before casting so a result that raced a change
+//is filed under the old version and never served after it
+static bool CachedLOS(LOSCache *cache, const std::atomic<uint64_t> &geometry_version, const RayCaster &caster, WorldRayCallback &cb,
+	const glm::vec3 &src, const glm::vec3 &dest) {
+	EQPhysicsStatsScope stat(caster.stats, caster.batch_stats, QueryTypeLOS);
+	bool los;
+	if (!cache) {
+		los = CastLOS(caster, cb, src, dest);
+	}
+	else {
+		uint64_t version = geometry_version.load();
+		if (!cache->Lookup(src, dest, version, los)) {
+			los = CastLOS(caster, cb, src, dest);
+			cache->Insert(src, dest, version, los);
+		}
+	}
+
+	stat.SetHit(!los);
+	return los;
+}
+
+bool EQPhysics::CheckLOS(const glm::vec3 &src, const glm::vec3 &dest) const {
+	WorldRayCallback los_hit;
+	return CachedLOS(imp->los_cache.get(), imp->geometry_version, imp->Caster(true), los_hit, src, dest);
+}
+
+bool EQPhysics::GetRaycastClosestHit(const glm::vec3 & src, const glm::vec3 & dest, glm::vec3 &hit, std::string *name, int flag) const
+{
+	WorldRayCallback ray_hit;
+	if (CastClosestHit(imp->Caster(true), ray_hit, src, dest, hit, flag)) {
+		if (name) {
+			GetEntityHit(ray_hit.m_collisionObject, *name);
+		}
+		return true;
+	}
+
+	return false;
+}
+
+float EQPhysics::FindBestFloor(const glm::vec3 &start, glm::vec3 *result, glm::vec3 *normal) const {
+	WorldRayCallback hit;
+	return CastBestFloor(imp->Caster(true), hit, start, result, normal);
+}
+
+void EQPhysics::CheckLOSBatch(const std::vector<EQPhysicsRay> &rays, std::vector<uint8_t> &los) const {
+	los.resize(rays.size());
+	RayCaster caster = imp->Caster(false);
+	RunBatch(imp->thread_pool, rays.size(), [&](size_t begin, size_t end) {
+		EQPhysicsStatsBatch stats(caster.stats);
+		RayCaster range_caster = caster;
+		range_caster.batch_stats = &stats;
+		WorldRayCallback cb;
+		for (size_t i = begin; i < end; ++i) {
+			los[i] = CachedLOS(imp->los_cache.get(), imp->geometry_version, range_caster, cb, rays[i].src, rays[i].dest) ? 1 : 0;
+		}
+	});
+}
+
+void EQPhysics::GetRaycastClosestHitBatch(const std::vector<EQPhysicsRay> &rays, std::vector<EQPhysicsRayHit> &hits, int flag) const {
+	hits.resize(rays.size());
+	RayCaster caster = imp->Caster(false);
+	RunBatch(imp->thread_pool, rays.size(), [&](size_t begin, size_t end) {
+		EQPhysicsStatsBatch stats(caster.stats);
+		RayCaster range_caster = caster;
+		range_caster.batch_stats = &stats;
+		WorldRayCallback cb;
+		for (size_t i = begin; i < end; ++i) {
+			auto &hit = hits[i];
+			hit.hit = CastClosestHit(range_caster, cb, rays[i].src, rays[i].dest, hit.point, flag);
+			if (hit.hit) {
+				hit.normal = glm::vec3(cb.m_hitNormalWorld.getX(), cb.m_hitNormalWorld.getY(), cb.m_hitNormalWorld.getZ());
+				hit.fraction = cb.m_closestHitFraction;
+				hit.handle = HandleOf(cb.m_collisionObject);
+			}
+			else {
+				hit.normal = glm::vec3(0.0f);
+				hit.fraction = 1.0f;
+				hit.handle = EQPhysicsInvalidHandle;
+			}
+		}
+	});
+}
+
+void EQPhysics::FindBestFloorBatch(const std::vector<glm::vec3> &starts, std::vector<float> &floors, std::vector<glm::vec3> *results, std::vector<glm::vec3> *normals) const {
+	floors.resize(starts.size());
+	if (results) {
+		results->resize(starts.size());
+	}
+
+	if (normals) {
+		normals->resize(starts.size());
+	}
+
+	RayCaster caster = imp->Caster(false);
+	RunBatch(imp->thread_pool, starts.size(), [&](size_t begin, size_t end) {
+		EQPhysicsStatsBatch stats(caster.stats);
+		RayCaster range_caster = caster;
+		range_caster.batch_stats = &stats;
+		WorldRayCallback cb;
+		for (size_t i = begin; i < end; ++i) {
+			floors[i] = CastBestFloor(range_caster, cb, starts[i], results ? &(*results)[i] : nullptr, normals ? &(*normals)[i] : nullptr);
+		}
+	});
+}
+
+bool EQPhysics::SweepSphere(const glm::vec3 &src, const glm::vec3 &dest, float radius, EQPhysicsRayHit &hit, int flag) const {
+	btSphereShape shape(radius);
+	return CastSweep(imp->Caster(true), shape, src, dest, flag, hit);
+}
+
+bool EQPhysics::SweepCapsule(const glm::vec3 &src, const glm::vec3 &dest, float radius, float height, EQPhysicsRayHit &hit, int flag) const {
+	btCapsuleShape shape(radius, height);
+	return CastSweep(imp->Caster(true), shape, src, dest, flag, hit);
+}
+
+void EQPhysics::SweepBatch(const std::vector<EQPhysicsSweep> &sweeps, std::vector<EQPhysicsRayHit> &hits, int flag) const {
+	hits.resize(sweeps.size());
+	RayCaster caster = imp->Caster(false);
+	RunBatch(imp->thread_pool, sweeps.size(), [&](size_t begin, size_t end) {
+		EQPhysicsStatsBatch stats(caster.stats);
+		RayCaster range_caster = caster;
+		range_caster.batch_stats = &stats;
+		for (size_t i = begin; i < end; ++i) {
+			auto &sweep = sweeps[i];
+			if (sweep.height > 0.0f) {
+				btCapsuleShape shape(sweep.radius, sweep.height);
+				CastSweep(range_caster, shape, sweep.src, sweep.dest, flag, hits[i]);
+			}
+			else {
+				btSphereShape shape(sweep.radius);
+				CastSweep(range_caster, shape, sweep.src, sweep.dest, flag, hits[i]);
+			}
+		}
+	});
 }
 
 WaterRegionType EQPhysics::ReturnRegionType(const glm::vec3 &pos) const {
+	EQPhysicsStatsScope stat(&imp->stats, QueryTypeRegionType);
 	if(!imp->water_map) {
 		return RegionTypeNormal;
 	}
 
-	return imp->water_map->ReturnRegionType(pos.x, pos.z, pos.y);
+	WaterRegionType type = imp->water_map->ReturnRegionType(pos.x, pos.z, pos.y);
+	stat.SetHit(type != RegionTypeNormal);
+	return type;
+}
+
+void EQPhysics::ReturnRegionTypeBatch(const std::vector<glm::vec3> &positions, std::vector<WaterRegionType> &types) const {
+	types.resize(positions.size());
+	WaterMap *water_map = imp->water_map.get();
+	RunBatch(imp->thread_pool, positions.size(), [&](size_t begin, size_t end) {
+		EQPhysicsStatsBatch stats(&imp->stats);
+		if (!water_map) {
+			std::fill(types.begin() + begin, types.begin() + end, RegionTypeNormal);
+			stats.RecordGroup(QueryTypeRegionType, (uint32_t)(end - begin), 0, 0);
+			return;
+		}
+
+		//into the water map's own axes, as the single query passes them
+		std::vector<glm::vec3> points(end - begin);
+		for (size_t i = begin; i < end; ++i) {
+			points[i - begin] = glm::vec3(positions[i].z, positions[i].x, positions[i].y);
+		}
+
+		std::chrono::steady_clock::time_point start;
+		if (EQPhysicsStats::Enabled()) {
+			start = std::chrono::steady_clock::now();
+		}
+
+		water_map->ReturnRegionTypes(&points[0], points.size(), &types[begin]);
+		if (EQPhysicsStats::Enabled()) {
+			uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+			uint32_t hits = (uint32_t)(end - begin - std::count(types.begin() + begin, types.begin() + end, RegionTypeNormal));
+			stats.RecordGroup(QueryTypeRegionType, (uint32_t)(end - begin), hits, ns);
+		}
+	});
 }
 
 bool EQPhysics::InWater(const glm::vec3 &pos) const {
+	EQPhysicsStatsScope stat(&imp->stats, QueryTypeRegionType);
 	if(!imp->water_map) {
 		return false;
 	}
 
-	return imp->water_map->InWater(pos.x, pos.z, pos.y);
+	bool in = imp->water_map->InWater(pos.x, pos.z, pos.y);
+	stat.SetHit(in);
+	return in;
 }
 
 bool EQPhysics::InVWater(const glm::vec3 &pos) const {
+	EQPhysicsStatsScope stat(&imp->stats, QueryTypeRegionType);
 	if(!imp->water_map) {
 		return false;
 	}
 
-	return imp->water_map->InVWater(pos.x, pos.z, pos.y);
+	bool in = imp->water_map->InVWater(pos.x, pos.z, pos.y);
+	stat.SetHit(in);
+	return in;
 }
 
 bool EQPhysics::InLava(const glm::vec3 &pos) const {
+	EQPhysicsStatsScope stat(&imp->stats, QueryTypeRegionType);
 	if(!imp->water_map) {
 		return false;
 	}
 
-	return imp->water_map->InLava(pos.x, pos.z, pos.y);
+	bool in = imp->water_map->InLava(pos.x, pos.z, pos.y);
+	stat.SetHit(in);
+	return in;
 }
 
 bool EQPhysics::InLiquid(const glm::vec3 &pos) const {
+	EQPhysicsStatsScope stat(&imp->stats, QueryTypeRegionType);
 	if(!imp->water_map) {
 		return false;
 	}
 
-	return imp->water_map->InLiquid(pos.x, pos.z, pos.y);
+	bool in = imp->water_map->InLiquid(pos.x, pos.z, pos.y);
+	stat.SetHit(in);
+	return in;
 }
 
 bool EQPhysics::IsUnderworld(const glm::vec3 &point) const {
-	btVector3 from(point.x, point.y + 1.0f, point.z);
-	btVector3 to(point.x, -FLT_MAX, point.z);
+	//a hit for this query is being under the world
+	EQPhysicsStatsScope stat(&imp->stats, QueryTypeUnderworld);
+	stat.SetHit(true);
+	if (imp->collision_world->getNumCollisionObjects() == 0) {
+		return true;
+	}
 
-	btCollisionWorld::AllHitsRayResultCallback hit_below(from, to);
-	hit_below.m_collisionFilterGroup = (short)CollidableWorld;
-	hit_below.m_collisionFilterMask = (short)CollidableWorld;
-	hit_below.m_flags |= 1;
+	//nothing can be hit past the bounds of everything registered so the ray stops there instead of at -FLT_MAX
+	btVector3 world_min;
+	btVector3 world_max;
+	imp->collision_world->getBroadphase()->getBroadphaseAabb(world_min, world_max);
+	if (point.x < world_min.x() || point.x > world_max.x() || point.z < world_min.z() || point.z > world_max.z() || point.y + 1.0f < world_min.y()) {
+		return true;
+	}
 
-	imp->collision_world->rayTest(from, to, hit_below);
+	btVector3 from(point.x, point.y + 1.0f, point.z);
+	btVector3 to(point.x, world_min.y() - 1.0f, point.z);
+
+	WorldRayCallback hit_below;
+	ResetRayCallback(hit_below, from, to, CollidableWorld, 1, true);
+	CastRay(imp->Caster(true), hit_below);
 
 	if(hit_below.hasHit()) {
+		stat.SetHit(false);
 		return false;
 	}
 
@@ -321,13 +1661,11 @@ void EQPhysics::GetEntityHit(const btCollisionObject *obj, std::string &out_iden
 		return;
 	}
 
-	const btRigidBody* body = btRigidBody::upcast(obj);
-
-	out_ident.clear();
-	for (auto iter = imp->entity_info->begin(); iter != imp->entity_info->end(); ++iter) {
-		if (iter->second.rb.get() == body) {
-			out_ident = iter->first;
-			return;
-		}
+	const btMeshInfo *info = (const btMeshInfo*)obj->getUserPointer();
+	if (info) {
+		out_ident = info->ident;
+	}
+	else {
+		out_ident.clear();
 	}
 }
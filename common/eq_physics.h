@@ -14,7 +14,60 @@ enum EQPhysicsFlags
 	NotSelectable = 8,
 };
 
+enum EQPhysicsQueryEngine
+{
+	QueryEngineBullet,
+	//zone collision from RegisterZoneMap goes through our own bvh, the rest through Bullet
+	QueryEngineStaticBvh,
+};
+
+//stays unique to one registration, a stale handle never matches a later one
+typedef uint32_t EQPhysicsHandle;
+const EQPhysicsHandle EQPhysicsInvalidHandle = 0;
+
+//one ray for the batched queries
+struct EQPhysicsRay
+{
+	glm::vec3 src;
+	glm::vec3 dest;
+};
+
+//one sweep for SweepBatch, a height of 0 is a sphere
+struct EQPhysicsSweep
+{
+	glm::vec3 src;
+	glm::vec3 dest;
+	float radius;
+	float height;
+};
+
+//fraction is how far along src -> dest the first contact is, 1 with nothing hit
+struct EQPhysicsRayHit
+{
+	bool hit;
+	glm::vec3 point;
+	glm::vec3 normal;
+	float fraction;
+	//EQPhysicsInvalidHandle with nothing hit
+	EQPhysicsHandle handle;
+};
+
+namespace EQEmu
+{
+	class ThreadPool;
+}
+
 class btCollisionObject;
+class btCollisionShape;
+class btTransform;
+class btTriangleIndexVertexArray;
+struct btMeshInfo;
+struct ZoneMapMeshView;
+class ZoneMap;
+class FloorMap;
+class EQPhysicsSnapshotRef;
+class EQPhysicsStats;
+struct LOSCacheStats;
 class EQPhysics
 {
 public:
@@ -24,25 +77,89 @@ public:
 	//manipulation
 	void SetWaterMap(WaterMap *w);
 	WaterMap *GetWaterMap();
-	void RegisterMesh(const std::string &ident, const std::vector<glm::vec3>& verts, const std::vector<unsigned int>& inds, const glm::vec3 &pos, EQPhysicsFlags flag);
+	//opt in, bakes a v1 water map into cell_size columns over the map's bounds; false if nothing was baked
+	bool BakeWaterColumns(const ZoneMap &map, float cell_size);
+	//takes ownership, with verify a short ray still confirms each baked floor
+	void SetFloorMap(FloorMap *f, bool verify = true);
+	//not owned, batches run on the calling thread without one
+	void SetThreadPool(EQEmu::ThreadPool *pool);
+	//can be changed at any time between queries
+	void SetQueryEngine(EQPhysicsQueryEngine engine);
+	EQPhysicsQueryEngine GetQueryEngine() const;
+	//bvh_filename is an optional file from WriteBvhFile
+	EQPhysicsHandle RegisterMesh(const std::string &ident, const std::vector<glm::vec3>& verts, const std::vector<unsigned int>& inds, const glm::vec3 &pos, EQPhysicsFlags flag,
+		const std::string &bvh_filename = "");
+	//no copy, view's buffers must outlive the registration
+	EQPhysicsHandle RegisterMeshView(const std::string &ident, const ZoneMapMeshView &view, const glm::vec3 &pos, EQPhysicsFlags flag,
+		const std::string &bvh_filename = "");
 	void UnregisterMesh(const std::string &ident);
+	void UnregisterMesh(EQPhysicsHandle handle);
+	//re-registering an ident replaces it and stales the old handle
+	EQPhysicsHandle GetHandle(const std::string &ident) const;
+	std::string GetIdent(EQPhysicsHandle handle) const;
+
+	//instancing, a model's view must outlive it like RegisterMeshView's; a model with instances can't be replaced
+	bool RegisterModel(const std::string &model, const ZoneMapMeshView &view, const std::string &bvh_filename = "");
+	EQPhysicsHandle RegisterInstance(const std::string &ident, const std::string &model, const glm::mat4 &transform, EQPhysicsFlags flag);
+
+	//CollideWorldMesh and NonCollideWorldMesh, plus CollideWorldMesh:n and NonCollideWorldMesh:n per placed model
+	void RegisterZoneMap(const ZoneMap &map, const std::string &bvh_filename = "");
 	void MoveMesh(const std::string &ident, const glm::vec3 &pos);
+	void MoveMesh(EQPhysicsHandle handle, const glm::vec3 &pos);
 	void Step();
 
+	//lock free queries from other threads, see eq_physics_snapshot.h
+	void PublishSnapshot();
+	EQPhysicsSnapshotRef AcquireSnapshot() const;
+
+	//all zeros unless built with EQEMU_ENABLE_PHYSICS_STATS
+	const EQPhysicsStats &GetStats() const;
+	void ResetStats();
+
+	//answers CheckLOS per pair of cell_size cells, any change to the world invalidates it
+	void EnableLOSCache(float cell_size, uint32_t entries);
+	void DisableLOSCache();
+	//false while the cache is off
+	bool GetLOSCacheStats(LOSCacheStats &out) const;
+	void ResetLOSCacheStats();
+	uint64_t GetGeometryVersion() const;
+
+	//saves every registered mesh's BVH for later RegisterMesh calls
+	bool WriteBvhFile(const std::string &filename) const;
+
 	//collision stuff
 	bool CheckLOS(const glm::vec3 &src, const glm::vec3 &dest) const;
 	bool GetRaycastClosestHit(const glm::vec3 &src, const glm::vec3 &dest, glm::vec3 &hit, std::string *name, int flag = CollidableWorld) const;
 	float FindBestFloor(const glm::vec3 &start, glm::vec3 *result, glm::vec3 *normal) const;
+
+	//batched forms of the above, the world must not change while one runs
+	void CheckLOSBatch(const std::vector<EQPhysicsRay> &rays, std::vector<uint8_t> &los) const;
+	void GetRaycastClosestHitBatch(const std::vector<EQPhysicsRay> &rays, std::vector<EQPhysicsRayHit> &hits, int flag = CollidableWorld) const;
+	void FindBestFloorBatch(const std::vector<glm::vec3> &starts, std::vector<float> &floors, std::vector<glm::vec3> *results, std::vector<glm::vec3> *normals) const;
 	bool IsUnderworld(const glm::vec3 &point) const;
+
+	//sweeps, height is between the capsule's end sphere centres; always through Bullet
+	bool SweepSphere(const glm::vec3 &src, const glm::vec3 &dest, float radius, EQPhysicsRayHit &hit, int flag = CollidableWorld) const;
+	bool SweepCapsule(const glm::vec3 &src, const glm::vec3 &dest, float radius, float height, EQPhysicsRayHit &hit, int flag = CollidableWorld) const;
+	void SweepBatch(const std::vector<EQPhysicsSweep> &sweeps, std::vector<EQPhysicsRayHit> &hits, int flag = CollidableWorld) const;
 	
 	//Volume stuff
 	WaterRegionType ReturnRegionType(const glm::vec3 &pos) const;
+	//types[i] is ReturnRegionType(positions[i])
+	void ReturnRegionTypeBatch(const std::vector<glm::vec3> &positions, std::vector<WaterRegionType> &types) const;
 	bool InWater(const glm::vec3 &pos) const;
 	bool InVWater(const glm::vec3 &pos) const;
 	bool InLava(const glm::vec3 &pos) const;
 	bool InLiquid(const glm::vec3 &pos) const;
 	
 private:
+	EQPhysicsHandle AddMeshShape(const std::string &ident, btTriangleIndexVertexArray *mesh, uint64_t fingerprint, const glm::vec3 &pos, EQPhysicsFlags flag,
+		const std::string &bvh_filename);
+	void CreateMeshShape(const std::string &ident, btTriangleIndexVertexArray *mesh, uint64_t fingerprint, const std::string &bvh_filename, btMeshInfo *info);
+	void MarkStaticWorld(const std::string &ident);
+	void DropStaticBvh(btMeshInfo &info);
+	void BuildStaticBvh();
+	void AddBody(btMeshInfo &info, btCollisionShape *shape, const btTransform &transform, EQPhysicsFlags flag);
 	void GetEntityHit(const btCollisionObject *obj, std::string &out_ident) const;
 
 	struct impl;
@@ -0,0 +1,252 @@
+#include "eq_physics_snapshot.h"
+#include "static_bvh.h"
+#include <float.h>
+#include <thread>
+#include <functional>
+#include <algorithm>
+
+EQPhysicsSnapshot::EQPhysicsSnapshot(uint64_t version, std::shared_ptr<const StaticBvh> world, EQPhysicsHandle world_handle,
+	std::vector<EQPhysicsHandle> &world_handles, std::vector<EQPhysicsSnapshotEntity> &entities)
+	: version(version), world(world), world_handle(world_handle) {
+	this->world_handles.swap(world_handles);
+	this->entities.swap(entities);
+}
+
+EQPhysicsSnapshot::~EQPhysicsSnapshot() {
+}
+
+//Slab test of the segment against a box, only passes if it's entered before max_fraction
+static bool SegmentHitsBox(const glm::vec3 &from, const glm::vec3 &dir, const glm::vec3 &min, const glm::vec3 &max, float max_fraction) {
+	float enter = 0.0f;
+	float exit = max_fraction;
+	for (int a = 0; a < 3; ++a) {
+		if (dir[a] == 0.0f) {
+			if (from[a] < min[a] || from[a] > max[a]) {
+				return false;
+			}
+			continue;
+		}
+
+		float t0 = (min[a] - from[a]) / dir[a];
+		float t1 = (max[a] - from[a]) / dir[a];
+		if (t0 > t1) {
+			std::swap(t0, t1);
+		}
+
+		enter = std::max(enter, t0);
+		exit = std::min(exit, t1);
+		if (enter > exit) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+EQPhysicsHandle EQPhysicsSnapshot::WorldHandle(uint32_t triangle) const {
+	uint32_t range = world->GetRange(triangle);
+	if (range < world_handles.size() && world_handles[range] != EQPhysicsInvalidHandle) {
+		return world_handles[range];
+	}
+
+	return world_handle;
+}
+
+//Fractions carry over between spaces since the transforms are affine; culling does too as instances never mirror
+bool EQPhysicsSnapshot::Cast(const glm::vec3 &src, const glm::vec3 &dest, int flag, bool cull_back_faces, bool any_hit, EQPhysicsRayHit &hit) const {
+	hit.hit = false;
+	hit.fraction = 1.0f;
+	hit.handle = EQPhysicsInvalidHandle;
+
+	StaticBvhHit bvh_hit;
+	glm::vec3 normal;
+	if (world && (flag & CollidableWorld) != 0) {
+		if (any_hit) {
+			if (world->Occluded(src, dest, cull_back_faces)) {
+				hit.hit = true;
+				hit.fraction = 0.0f;
+				hit.handle = world_handle;
+				return true;
+			}
+		}
+		else if (world->Raycast(src, dest, cull_back_faces, hit.fraction, bvh_hit)) {
+			hit.hit = true;
+			hit.fraction = bvh_hit.fraction;
+			hit.handle = WorldHandle(bvh_hit.triangle);
+			normal = bvh_hit.normal;
+		}
+	}
+
+	glm::vec3 dir = dest - src;
+	for (auto &e : entities) {
+		if ((e.flag & flag) == 0 || !SegmentHitsBox(src, dir, e.min, e.max, hit.fraction)) {
+			continue;
+		}
+
+		glm::vec3 local_src = glm::vec3(e.to_local * glm::vec4(src, 1.0f));
+		glm::vec3 local_dest = glm::vec3(e.to_local * glm::vec4(dest, 1.0f));
+		if (any_hit) {
+			if (e.bvh->Occluded(local_src, local_dest, cull_back_faces)) {
+				hit.hit = true;
+				hit.fraction = 0.0f;
+				hit.handle = e.handle;
+				return true;
+			}
+		}
+		else if (e.bvh->Raycast(local_src, local_dest, cull_back_faces, hit.fraction, bvh_hit)) {
+			hit.hit = true;
+			hit.fraction = bvh_hit.fraction;
+			hit.handle = e.handle;
+			//normals go back through the inverse transpose
+			normal = glm::normalize(glm::vec3(glm::transpose(e.to_local) * glm::vec4(bvh_hit.normal, 0.0f)));
+		}
+	}
+
+	if (hit.hit) {
+		hit.point = src + dir * hit.fraction;
+		hit.normal = normal;
+	}
+	else {
+		hit.point = glm::vec3(0.0f);
+		hit.normal = glm::vec3(0.0f);
+	}
+
+	return hit.hit;
+}
+
+bool EQPhysicsSnapshot::CheckLOS(const glm::vec3 &src, const glm::vec3 &dest) const {
+	EQPhysicsRayHit hit;
+	return !Cast(src, dest, CollidableWorld, false, true, hit);
+}
+
+bool EQPhysicsSnapshot::GetRaycastClosestHit(const glm::vec3 &src, const glm::vec3 &dest, EQPhysicsRayHit &hit, int flag) const {
+	return Cast(src, dest, flag, true, false, hit);
+}
+
+float EQPhysicsSnapshot::FindBestFloor(const glm::vec3 &start, glm::vec3 *result, glm::vec3 *normal) const {
+	glm::vec3 from(start.x, start.y + 1.0f, start.z);
+	EQPhysicsRayHit hit;
+	if (!Cast(from, glm::vec3(start.x, start.y - 3000.0f, start.z), CollidableWorld, true, false, hit) &&
+		!Cast(from, glm::vec3(start.x, start.y + 3000.0f, start.z), CollidableWorld, false, false, hit)) {
+		return -FLT_MAX;
+	}
+
+	if (result) {
+		*result = hit.point;
+	}
+
+	if (normal) {
+		*normal = hit.normal;
+	}
+
+	return hit.point.y;
+}
+
+EQPhysicsSnapshotRef::EQPhysicsSnapshotRef(EQPhysicsSnapshotRef &&o) : domain(o.domain), slot(o.slot), snapshot(o.snapshot) {
+	o.domain = nullptr;
+	o.snapshot = nullptr;
+}
+
+EQPhysicsSnapshotRef &EQPhysicsSnapshotRef::operator=(EQPhysicsSnapshotRef &&o) {
+	if (this != &o) {
+		Release();
+		domain = o.domain;
+		slot = o.slot;
+		snapshot = o.snapshot;
+		o.domain = nullptr;
+		o.snapshot = nullptr;
+	}
+
+	return *this;
+}
+
+EQPhysicsSnapshotRef::~EQPhysicsSnapshotRef() {
+	Release();
+}
+
+void EQPhysicsSnapshotRef::Release() {
+	if (domain) {
+		domain->Leave(slot);
+		domain = nullptr;
+	}
+
+	snapshot = nullptr;
+}
+
+EQPhysicsSnapshotDomain::EQPhysicsSnapshotDomain() : current(nullptr), epoch(1) {
+	for (uint32_t i = 0; i < MaxReaders; ++i) {
+		readers[i].epoch.store(0);
+		readers[i].claimed.store(false);
+	}
+}
+
+EQPhysicsSnapshotDomain::~EQPhysicsSnapshotDomain() {
+	for (auto &r : retired) {
+		delete r.snapshot;
+	}
+
+	delete current.load();
+}
+
+void EQPhysicsSnapshotDomain::Publish(const EQPhysicsSnapshot *snapshot) {
+	const EQPhysicsSnapshot *old = current.exchange(snapshot);
+	if (old) {
+		//anyone who got old announced an epoch no later than this before loading it
+		Retired r;
+		r.snapshot = old;
+		r.epoch = epoch.fetch_add(1);
+		retired.push_back(r);
+	}
+
+	Reclaim();
+}
+
+void EQPhysicsSnapshotDomain::Reclaim() {
+	if (retired.empty()) {
+		return;
+	}
+
+	uint64_t oldest = UINT64_MAX;
+	for (uint32_t i = 0; i < MaxReaders; ++i) {
+		uint64_t e = readers[i].epoch.load();
+		if (e != 0) {
+			oldest = std::min(oldest, e);
+		}
+	}
+
+	auto keep = std::partition(retired.begin(), retired.end(), [oldest](const Retired &r) { return r.epoch >= oldest; });
+	for (auto iter = keep; iter != retired.end(); ++iter) {
+		delete iter->snapshot;
+	}
+
+	retired.erase(keep, retired.end());
+}
+
+EQPhysicsSnapshotRef EQPhysicsSnapshotDomain::Acquire() {
+	//start somewhere different per thread so readers don't all race for slot 0
+	uint32_t slot = (uint32_t)(std::hash<std::thread::id>()(std::this_thread::get_id()) % MaxReaders);
+	for (;;) {
+		bool expected = false;
+		if (!readers[slot].claimed.load(std::memory_order_relaxed) && readers[slot].claimed.compare_exchange_strong(expected, true)) {
+			break;
+		}
+
+		slot = (slot + 1) % MaxReaders;
+		if (slot == 0) {
+			std::this_thread::yield();
+		}
+	}
+
+	readers[slot].epoch.store(epoch.load());
+
+	EQPhysicsSnapshotRef ref;
+	ref.domain = this;
+	ref.slot = slot;
+	ref.snapshot = current.load();
+	return ref;
+}
+
+void EQPhysicsSnapshotDomain::Leave(uint32_t slot) {
+	readers[slot].epoch.store(0);
+	readers[slot].claimed.store(false);
+}
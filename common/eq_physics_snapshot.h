@@ -0,0 +1,122 @@
+#ifndef EQEMU_COMMON_EQ_PHYSICS_SNAPSHOT_H
+#define EQEMU_COMMON_EQ_PHYSICS_SNAPSHOT_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "eq_physics.h"
+
+class StaticBvh;
+
+//One registered mesh or instance as it was when the snapshot was taken, bvh is in the mesh's own space
+struct EQPhysicsSnapshotEntity
+{
+	EQPhysicsHandle handle;
+	int flag;
+	glm::mat4 to_world;
+	glm::mat4 to_local;
+	glm::vec3 min;
+	glm::vec3 max;
+	std::shared_ptr<const StaticBvh> bvh;
+};
+
+//Read only copy of what EQPhysics' queries run against: the zone's static collision plus every other registered
+//body at the position it had when published. Nothing in it changes after construction so any number of threads can
+//query one at once. Answers match EQPhysics' own queries, except that FindBestFloor never uses a floor map.
+class EQPhysicsSnapshot
+{
+public:
+	//world_handles is the mesh behind each of world's ranges, world_handle what any-hit queries report
+	EQPhysicsSnapshot(uint64_t version, std::shared_ptr<const StaticBvh> world, EQPhysicsHandle world_handle,
+		std::vector<EQPhysicsHandle> &world_handles, std::vector<EQPhysicsSnapshotEntity> &entities);
+	~EQPhysicsSnapshot();
+
+	bool CheckLOS(const glm::vec3 &src, const glm::vec3 &dest) const;
+	bool GetRaycastClosestHit(const glm::vec3 &src, const glm::vec3 &dest, EQPhysicsRayHit &hit, int flag = CollidableWorld) const;
+	float FindBestFloor(const glm::vec3 &start, glm::vec3 *result, glm::vec3 *normal) const;
+
+	uint64_t GetVersion() const { return version; }
+	uint32_t GetEntityCount() const { return (uint32_t)entities.size(); }
+private:
+	bool Cast(const glm::vec3 &src, const glm::vec3 &dest, int flag, bool cull_back_faces, bool any_hit, EQPhysicsRayHit &hit) const;
+	EQPhysicsHandle WorldHandle(uint32_t triangle) const;
+
+	uint64_t version;
+	std::shared_ptr<const StaticBvh> world;
+	EQPhysicsHandle world_handle;
+	std::vector<EQPhysicsHandle> world_handles;
+	std::vector<EQPhysicsSnapshotEntity> entities;
+};
+
+class EQPhysicsSnapshotDomain;
+
+//Keeps the snapshot it was acquired with alive until it goes out of scope. Hold one per batch of queries rather than
+//for long stretches, retired snapshots can't be freed while any reader that might still see them holds a ref.
+class EQPhysicsSnapshotRef
+{
+public:
+	EQPhysicsSnapshotRef() : domain(nullptr), slot(0), snapshot(nullptr) { }
+	EQPhysicsSnapshotRef(EQPhysicsSnapshotRef &&o);
+	EQPhysicsSnapshotRef &operator=(EQPhysicsSnapshotRef &&o);
+	~EQPhysicsSnapshotRef();
+
+	const EQPhysicsSnapshot *get() const { return snapshot; }
+	const EQPhysicsSnapshot *operator->() const { return snapshot; }
+	explicit operator bool() const { return snapshot != nullptr; }
+	void Release();
+private:
+	friend class EQPhysicsSnapshotDomain;
+	EQPhysicsSnapshotRef(const EQPhysicsSnapshotRef&);
+	EQPhysicsSnapshotRef &operator=(const EQPhysicsSnapshotRef&);
+
+	EQPhysicsSnapshotDomain *domain;
+	uint32_t slot;
+	const EQPhysicsSnapshot *snapshot;
+};
+
+//Epoch based publication: the one writer swaps in a new snapshot and retires the old one, which is freed once every
+//reader that could have loaded it has left. Readers never lock or wait on the writer, each claims one of a fixed set
+//of slots, writes the current epoch there and loads the snapshot pointer. A snapshot retired at epoch e is only
+//freed when no claimed slot holds an epoch of e or older.
+class EQPhysicsSnapshotDomain
+{
+public:
+	static const uint32_t MaxReaders = 64;
+
+	EQPhysicsSnapshotDomain();
+	//No ref may outlive the domain
+	~EQPhysicsSnapshotDomain();
+
+	//Writer side, only ever from one thread at a time; takes ownership of snapshot
+	void Publish(const EQPhysicsSnapshot *snapshot);
+	void Reclaim();
+
+	//Reader side, any thread. Spins if more than MaxReaders refs are held at once.
+	EQPhysicsSnapshotRef Acquire();
+private:
+	friend class EQPhysicsSnapshotRef;
+	void Leave(uint32_t slot);
+
+	struct ReaderSlot
+	{
+		std::atomic<uint64_t> epoch;
+		std::atomic<bool> claimed;
+		//one cache line per reader so they don't fight over the same line
+		char pad[64 - sizeof(std::atomic<uint64_t>) - sizeof(std::atomic<bool>)];
+	};
+
+	struct Retired
+	{
+		const EQPhysicsSnapshot *snapshot;
+		uint64_t epoch;
+	};
+
+	std::atomic<const EQPhysicsSnapshot*> current;
+	std::atomic<uint64_t> epoch;
+	ReaderSlot readers[MaxReaders];
+	std::vector<Retired> retired;
+};
+
+#endif
@@ -0,0 +1,283 @@
+#include "eq_physics_stats.h"
+#include "static_bvh.h"
+#include <string.h>
+#include <json.hpp>
+
+using json = nlohmann::json;
+
+uint64_t EQPhysicsQueryStats::Percentile(double p) const {
+	if (count == 0) {
+		return 0;
+	}
+
+	uint64_t target = (uint64_t)(p * (double)count);
+	if (target >= count) {
+		target = count - 1;
+	}
+
+	uint64_t seen = 0;
+	for (uint32_t i = 0; i < PhysicsStatsBuckets; ++i) {
+		seen += latency[i];
+		if (seen > target) {
+			uint64_t upper = i + 1 < PhysicsStatsBuckets ? EQPhysicsStats::GetBucketLowerBound(i + 1) - 1 : max_ns;
+			return upper < max_ns ? upper : max_ns;
+		}
+	}
+
+	return max_ns;
+}
+
+EQPhysicsStats::EQPhysicsStats() {
+	Reset();
+}
+
+bool EQPhysicsStats::Enabled() {
+#ifdef EQEMU_ENABLE_PHYSICS_STATS
+	return true;
+#else
+	return false;
+#endif
+}
+
+const char *EQPhysicsStats::GetQueryTypeName(EQPhysicsQueryType type) {
+	switch (type) {
+	case QueryTypeLOS:
+		return "los";
+	case QueryTypeClosestHit:
+		return "closest_hit";
+	case QueryTypeBestFloor:
+		return "best_floor";
+	case QueryTypeUnderworld:
+		return "underworld";
+	case QueryTypeRegionType:
+		return "region_type";
+	case QueryTypeSweep:
+		return "sweep";
+	default:
+		return "unknown";
+	}
+}
+
+static uint32_t HighestBit(uint64_t v) {
+	uint32_t r = 0;
+	if (v >> 32) { v >>= 32; r += 32; }
+	if (v >> 16) { v >>= 16; r += 16; }
+	if (v >> 8) { v >>= 8; r += 8; }
+	if (v >> 4) { v >>= 4; r += 4; }
+	if (v >> 2) { v >>= 2; r += 2; }
+	if (v >> 1) { r += 1; }
+	return r;
+}
+
+uint32_t EQPhysicsStats::GetBucket(uint64_t ns) {
+	if (ns < PhysicsStatsSubBuckets) {
+		return (uint32_t)ns;
+	}
+
+	uint32_t bit = HighestBit(ns);
+	if (bit >= 48) {
+		return PhysicsStatsBuckets - 1;
+	}
+
+	//the three bits under the top one pick the sub bucket
+	uint32_t sub = (uint32_t)(ns >> (bit - 3)) & (PhysicsStatsSubBuckets - 1);
+	return PhysicsStatsSubBuckets + (bit - 3) * PhysicsStatsSubBuckets + sub;
+}
+
+uint64_t EQPhysicsStats::GetBucketLowerBound(uint32_t bucket) {
+	if (bucket < PhysicsStatsSubBuckets) {
+		return bucket;
+	}
+
+	uint32_t bit = (bucket - PhysicsStatsSubBuckets) / PhysicsStatsSubBuckets + 3;
+	uint64_t sub = (bucket - PhysicsStatsSubBuckets) % PhysicsStatsSubBuckets;
+	return (PhysicsStatsSubBuckets + sub) << (bit - 3);
+}
+
+void EQPhysicsStats::Snapshot(EQPhysicsQueryStats out[QueryTypeCount]) const {
+	memset(out, 0, sizeof(EQPhysicsQueryStats) * QueryTypeCount);
+#ifdef EQEMU_ENABLE_PHYSICS_STATS
+	for (int t = 0; t < QueryTypeCount; ++t) {
+		auto &c = counters[t];
+		auto &o = out[t];
+		o.count = c.count.load(std::memory_order_relaxed);
+		o.hits = c.hits.load(std::memory_order_relaxed);
+		o.nodes = c.nodes.load(std::memory_order_relaxed);
+		o.total_ns = c.total_ns.load(std::memory_order_relaxed);
+		o.max_ns = c.max_ns.load(std::memory_order_relaxed);
+		for (uint32_t i = 0; i < PhysicsStatsBuckets; ++i) {
+			o.latency[i] = c.latency[i].load(std::memory_order_relaxed);
+		}
+	}
+#endif
+}
+
+std::string EQPhysicsStats::ToJson() const {
+	json out;
+	out["enabled"] = Enabled();
+	if (!Enabled()) {
+		return out.dump();
+	}
+
+	EQPhysicsQueryStats stats[QueryTypeCount];
+	Snapshot(stats);
+
+	json queries = json::object();
+	for (int t = 0; t < QueryTypeCount; ++t) {
+		auto &s = stats[t];
+		json q;
+		q["count"] = s.count;
+		q["hits"] = s.hits;
+		q["hit_rate"] = s.count ? (double)s.hits / (double)s.count : 0.0;
+		q["nodes"] = s.nodes;
+		q["nodes_per_query"] = s.count ? (double)s.nodes / (double)s.count : 0.0;
+		q["mean_ns"] = s.count ? (double)s.total_ns / (double)s.count : 0.0;
+		q["max_ns"] = s.max_ns;
+		q["p50_ns"] = s.Percentile(0.5);
+		q["p90_ns"] = s.Percentile(0.9);
+		q["p99_ns"] = s.Percentile(0.99);
+		q["p999_ns"] = s.Percentile(0.999);
+
+		//only the buckets that have anything in them, as [lower bound ns, count]
+		json histogram = json::array();
+		for (uint32_t i = 0; i < PhysicsStatsBuckets; ++i) {
+			if (s.latency[i] > 0) {
+				histogram.push_back(json::array({ GetBucketLowerBound(i), s.latency[i] }));
+			}
+		}
+
+		q["histogram"] = histogram;
+		queries[GetQueryTypeName((EQPhysicsQueryType)t)] = q;
+	}
+
+	out["queries"] = queries;
+	return out.dump();
+}
+
+void EQPhysicsStats::Reset() {
+#ifdef EQEMU_ENABLE_PHYSICS_STATS
+	for (int t = 0; t < QueryTypeCount; ++t) {
+		auto &c = counters[t];
+		c.count.store(0, std::memory_order_relaxed);
+		c.hits.store(0, std::memory_order_relaxed);
+		c.nodes.store(0, std::memory_order_relaxed);
+		c.total_ns.store(0, std::memory_order_relaxed);
+		c.max_ns.store(0, std::memory_order_relaxed);
+		for (uint32_t i = 0; i < PhysicsStatsBuckets; ++i) {
+			c.latency[i].store(0, std::memory_order_relaxed);
+		}
+	}
+#endif
+}
+
+#ifdef EQEMU_ENABLE_PHYSICS_STATS
+void EQPhysicsStats::Record(EQPhysicsQueryType type, bool hit, uint32_t nodes, uint64_t ns) {
+	auto &c = counters[type];
+	c.count.fetch_add(1, std::memory_order_relaxed);
+	if (hit) {
+		c.hits.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	if (nodes) {
+		c.nodes.fetch_add(nodes, std::memory_order_relaxed);
+	}
+
+	c.total_ns.fetch_add(ns, std::memory_order_relaxed);
+	c.latency[GetBucket(ns)].fetch_add(1, std::memory_order_relaxed);
+
+	uint64_t max = c.max_ns.load(std::memory_order_relaxed);
+	while (ns > max && !c.max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+	}
+}
+
+void EQPhysicsStats::Merge(EQPhysicsQueryType type, const EQPhysicsQueryStats &stats) {
+	if (stats.count == 0) {
+		return;
+	}
+
+	auto &c = counters[type];
+	c.count.fetch_add(stats.count, std::memory_order_relaxed);
+	if (stats.hits) {
+		c.hits.fetch_add(stats.hits, std::memory_order_relaxed);
+	}
+
+	if (stats.nodes) {
+		c.nodes.fetch_add(stats.nodes, std::memory_order_relaxed);
+	}
+
+	c.total_ns.fetch_add(stats.total_ns, std::memory_order_relaxed);
+	for (uint32_t i = 0; i < PhysicsStatsBuckets; ++i) {
+		if (stats.latency[i]) {
+			c.latency[i].fetch_add(stats.latency[i], std::memory_order_relaxed);
+		}
+	}
+
+	uint64_t max = c.max_ns.load(std::memory_order_relaxed);
+	while (stats.max_ns > max && !c.max_ns.compare_exchange_weak(max, stats.max_ns, std::memory_order_relaxed)) {
+	}
+}
+
+EQPhysicsStatsBatch::EQPhysicsStatsBatch(EQPhysicsStats *stats) : stats(stats) {
+	memset(local, 0, sizeof(local));
+}
+
+EQPhysicsStatsBatch::~EQPhysicsStatsBatch() {
+	if (stats) {
+		for (int t = 0; t < QueryTypeCount; ++t) {
+			stats->Merge((EQPhysicsQueryType)t, local[t]);
+		}
+	}
+}
+
+void EQPhysicsStatsBatch::Record(EQPhysicsQueryType type, bool hit, uint32_t nodes, uint64_t ns) {
+	auto &s = local[type];
+	s.count++;
+	s.hits += hit ? 1 : 0;
+	s.nodes += nodes;
+	s.total_ns += ns;
+	s.latency[EQPhysicsStats::GetBucket(ns)]++;
+	s.max_ns = ns > s.max_ns ? ns : s.max_ns;
+}
+
+void EQPhysicsStatsBatch::RecordGroup(EQPhysicsQueryType type, uint32_t count, uint32_t hits, uint64_t ns) {
+	if (count == 0) {
+		return;
+	}
+
+	uint64_t mean = ns / count;
+	auto &s = local[type];
+	s.count += count;
+	s.hits += hits;
+	s.total_ns += ns;
+	s.latency[EQPhysicsStats::GetBucket(mean)] += count;
+	s.max_ns = mean > s.max_ns ? mean : s.max_ns;
+}
+
+EQPhysicsStatsScope::EQPhysicsStatsScope(EQPhysicsStats *stats, EQPhysicsQueryType type) : stats(stats), batch(nullptr), type(type), hit(false) {
+	if (stats) {
+		//drop whatever an earlier untimed query on this thread left behind
+		StaticBvh::TakeVisitCount();
+		start = std::chrono::steady_clock::now();
+	}
+}
+
+EQPhysicsStatsScope::EQPhysicsStatsScope(EQPhysicsStats *stats, EQPhysicsStatsBatch *batch, EQPhysicsQueryType type)
+	: stats(stats), batch(batch), type(type), hit(false) {
+	if (stats || batch) {
+		StaticBvh::TakeVisitCount();
+		start = std::chrono::steady_clock::now();
+	}
+}
+
+EQPhysicsStatsScope::~EQPhysicsStatsScope() {
+	if (stats || batch) {
+		uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		if (batch) {
+			batch->Record(type, hit, StaticBvh::TakeVisitCount(), ns);
+		}
+		else {
+			stats->Record(type, hit, StaticBvh::TakeVisitCount(), ns);
+		}
+	}
+}
+#endif
@@ -0,0 +1,123 @@
+#ifndef EQEMU_COMMON_EQ_PHYSICS_STATS_H
+#define EQEMU_COMMON_EQ_PHYSICS_STATS_H
+
+#include <stdint.h>
+#include <string>
+
+#ifdef EQEMU_ENABLE_PHYSICS_STATS
+#include <atomic>
+#include <chrono>
+#endif
+
+enum EQPhysicsQueryType
+{
+	QueryTypeLOS,
+	QueryTypeClosestHit,
+	QueryTypeBestFloor,
+	QueryTypeUnderworld,
+	QueryTypeRegionType,
+	QueryTypeSweep,
+	QueryTypeCount,
+};
+
+//Latency buckets in nanoseconds, HDR style: one per value under 8, then 8 even steps per power of two up to 2^48
+const uint32_t PhysicsStatsSubBuckets = 8;
+const uint32_t PhysicsStatsBuckets = PhysicsStatsSubBuckets + (48 - 3) * PhysicsStatsSubBuckets;
+
+struct EQPhysicsQueryStats
+{
+	uint64_t count;
+	uint64_t hits;
+	//static bvh nodes walked, Bullet's own traversal isn't visible
+	uint64_t nodes;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t latency[PhysicsStatsBuckets];
+
+	//Upper end of the bucket the p quantile, 0 to 1, falls in
+	uint64_t Percentile(double p) const;
+};
+
+//Per query type counters for EQPhysics. Recording is a handful of relaxed atomic adds so any number of query threads
+//can share one, batches gather into an EQPhysicsStatsBatch per range and merge once, and Snapshot can be taken from
+//any other thread while they run. Everything compiles to nothing unless EQEMU_ENABLE_PHYSICS_STATS is defined,
+//snapshots then read all zeros and the json says it's disabled.
+class EQPhysicsStats
+{
+public:
+	EQPhysicsStats();
+
+	static bool Enabled();
+	static const char *GetQueryTypeName(EQPhysicsQueryType type);
+	static uint32_t GetBucket(uint64_t ns);
+	static uint64_t GetBucketLowerBound(uint32_t bucket);
+
+	void Snapshot(EQPhysicsQueryStats out[QueryTypeCount]) const;
+	std::string ToJson() const;
+	void Reset();
+
+#ifdef EQEMU_ENABLE_PHYSICS_STATS
+	void Record(EQPhysicsQueryType type, bool hit, uint32_t nodes, uint64_t ns);
+	//Adds in counts gathered elsewhere, one atomic add per non zero counter
+	void Merge(EQPhysicsQueryType type, const EQPhysicsQueryStats &stats);
+private:
+	struct Counters
+	{
+		std::atomic<uint64_t> count;
+		std::atomic<uint64_t> hits;
+		std::atomic<uint64_t> nodes;
+		std::atomic<uint64_t> total_ns;
+		std::atomic<uint64_t> max_ns;
+		std::atomic<uint64_t> latency[PhysicsStatsBuckets];
+	};
+
+	Counters counters[QueryTypeCount];
+#else
+	void Record(EQPhysicsQueryType, bool, uint32_t, uint64_t) { }
+#endif
+};
+
+//Plain counters for one thread's share of a batch, so its queries don't all contend on the shared atomics; they're
+//merged into stats, which may be null, once on destruction
+class EQPhysicsStatsBatch
+{
+public:
+#ifdef EQEMU_ENABLE_PHYSICS_STATS
+	EQPhysicsStatsBatch(EQPhysicsStats *stats);
+	~EQPhysicsStatsBatch();
+	void Record(EQPhysicsQueryType type, bool hit, uint32_t nodes, uint64_t ns);
+	//count queries answered together in ns, each recorded at the mean
+	void RecordGroup(EQPhysicsQueryType type, uint32_t count, uint32_t hits, uint64_t ns);
+private:
+	EQPhysicsStats *stats;
+	EQPhysicsQueryStats local[QueryTypeCount];
+#else
+	EQPhysicsStatsBatch(EQPhysicsStats*) { }
+	void Record(EQPhysicsQueryType, bool, uint32_t, uint64_t) { }
+	void RecordGroup(EQPhysicsQueryType, uint32_t, uint32_t, uint64_t) { }
+#endif
+};
+
+//Times one query from construction to destruction and records it into batch if there is one, else stats; both may be null
+class EQPhysicsStatsScope
+{
+public:
+#ifdef EQEMU_ENABLE_PHYSICS_STATS
+	EQPhysicsStatsScope(EQPhysicsStats *stats, EQPhysicsQueryType type);
+	EQPhysicsStatsScope(EQPhysicsStats *stats, EQPhysicsStatsBatch *batch, EQPhysicsQueryType type);
+	~EQPhysicsStatsScope();
+	void SetHit(bool h) { hit = h; }
+private:
+	EQPhysicsStats *stats;
+	EQPhysicsStatsBatch *batch;
+	EQPhysicsQueryType type;
+	bool hit;
+	std::chrono::steady_clock::time_point start;
+#else
+	EQPhysicsStatsScope(EQPhysicsStats*, EQPhysicsQueryType) { }
+	EQPhysicsStatsScope(EQPhysicsStats*, EQPhysicsStatsBatch*, EQPhysicsQueryType) { }
+	void SetHit(bool) { }
+#endif
+};
+
+#endif
@@ -0,0 +1,282 @@
+#include "floor_map.h"
+#include "static_bvh.h"
+#include "thread_pool.h"
+#include "zone_map.h"
+#include "log_macros.h"
+#include "fnv_hash.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+//Sidecar written by Write: a header, one floor count byte per cell row by row, then every cell's heights lowest first.
+const char FloorMapMagic[8] = { 'E', 'Q', 'E', 'M', 'U', 'F', 'L', 'R' };
+const uint32_t FloorMapVersion = 2;
+const uint32_t FloorMapMaxFloorsPerCell = 255;
+//keeps a tiny cell size on a huge zone from trying to allocate the world
+const uint64_t FloorMapMaxCells = 64 * 1024 * 1024;
+
+struct floor_map_header
+{
+	char magic[8];
+	uint32_t version;
+	float cell_size;
+	float origin_x;
+	float origin_z;
+	uint32_t cells_x;
+	uint32_t cells_z;
+	uint32_t floor_count;
+	//of the collidable geometry the floors were sampled from
+	uint64_t fingerprint;
+};
+
+FloorMap::FloorMap() {
+	Clear();
+}
+
+FloorMap::~FloorMap() {
+}
+
+void FloorMap::Clear() {
+	cell_size = 0.0f;
+	origin_x = 0.0f;
+	origin_z = 0.0f;
+	fingerprint = 0;
+	cells_x = 0;
+	cells_z = 0;
+	std::vector<uint32_t>().swap(offsets);
+	std::vector<float>().swap(floors);
+}
+
+//Walks down through every surface under x, z, restarting just below each one; back faces are culled like the
+//FindBestFloor ray so a floor is never hit again from underneath
+static void SampleColumn(const StaticBvh &bvh, float x, float z, float top, float bottom, std::vector<float> &out) {
+	size_t first = out.size();
+	float y = top;
+	while (y > bottom && out.size() - first < FloorMapMaxFloorsPerCell) {
+		StaticBvhHit hit;
+		if (!bvh.Raycast(glm::vec3(x, y, z), glm::vec3(x, bottom, z), true, 1.0f, hit)) {
+			break;
+		}
+
+		float h = y + (bottom - y) * hit.fraction;
+		out.push_back(h);
+		y = h - 0.01f;
+	}
+
+	std::reverse(out.begin() + first, out.end());
+}
+
+static uint64_t HashMeshView(const ZoneMapMeshView &view, uint64_t hash) {
+	uint32_t counts[2] = { view.vert_count, view.tri_count };
+	hash = EQEmu::FNV1a64(counts, sizeof(counts), hash);
+	hash = EQEmu::FNV1a64(view.verts, view.vert_count * sizeof(glm::vec3), hash);
+	const char *tri = (const char*)view.inds;
+	for (uint32_t i = 0; i < view.tri_count; ++i) {
+		hash = EQEmu::FNV1a64(tri, sizeof(uint32_t) * 3, hash);
+		tri += view.index_stride;
+	}
+
+	return hash;
+}
+
+uint64_t FloorMap::Fingerprint(const ZoneMap &map) {
+	//the same pieces StaticBvh::AddCollidable samples, without flattening a v3 map's instances
+	uint64_t hash = HashMeshView(map.GetStaticCollidableMesh(), EQEmu::FNV1a64Offset);
+	uint32_t model_count = map.GetModelCount();
+	for (uint32_t i = 0; i < model_count; ++i) {
+		hash = HashMeshView(map.GetModelMesh(i, true), hash);
+	}
+
+	for (uint32_t i = 0; i < map.GetInstanceCount(); ++i) {
+		uint32_t model;
+		glm::mat4 transform;
+		if (map.GetInstance(i, model, transform)) {
+			hash = EQEmu::FNV1a64(&model, sizeof(model), hash);
+			hash = EQEmu::FNV1a64(&transform[0][0], sizeof(float) * 16, hash);
+		}
+	}
+
+	return hash;
+}
+
+bool FloorMap::Build(const ZoneMap &map, float size, EQEmu::ThreadPool *pool) {
+	Clear();
+	if (size <= 0.0f) {
+		return false;
+	}
+
+	StaticBvh bvh;
+	bvh.AddCollidable(map);
+	bvh.Build();
+
+	glm::vec3 min;
+	glm::vec3 max;
+	if (!bvh.GetBounds(min, max)) {
+		return false;
+	}
+
+	uint32_t nx = std::max(1u, (uint32_t)ceilf((max.x - min.x) / size));
+	uint32_t nz = std::max(1u, (uint32_t)ceilf((max.z - min.z) / size));
+	if ((uint64_t)nx * nz > FloorMapMaxCells) {
+		eqLogMessage(LogError, "Floor map cell size %g is too small for this zone (%u x %u cells).", size, nx, nz);
+		return false;
+	}
+
+	float top = max.y + 1.0f;
+	float bottom = min.y - 1.0f;
+	std::vector<std::vector<float>> row_floors(nz);
+	std::vector<std::vector<uint32_t>> row_counts(nz);
+	auto sample_rows = [&](size_t begin, size_t end) {
+		for (size_t row = begin; row < end; ++row) {
+			float z = min.z + ((float)row + 0.5f) * size;
+			auto &counts = row_counts[row];
+			counts.resize(nx);
+			for (uint32_t col = 0; col < nx; ++col) {
+				size_t before = row_floors[row].size();
+				SampleColumn(bvh, min.x + ((float)col + 0.5f) * size, z, top, bottom, row_floors[row]);
+				counts[col] = (uint32_t)(row_floors[row].size() - before);
+			}
+		}
+	};
+
+	if (pool && pool->Size() > 1) {
+		pool->ParallelFor(nz, sample_rows);
+	}
+	else {
+		sample_rows(0, nz);
+	}
+
+	cell_size = size;
+	origin_x = min.x;
+	origin_z = min.z;
+	fingerprint = Fingerprint(map);
+	cells_x = nx;
+	cells_z = nz;
+	offsets.reserve((size_t)nx * nz + 1);
+	offsets.push_back(0);
+	for (uint32_t row = 0; row < nz; ++row) {
+		for (uint32_t col = 0; col < nx; ++col) {
+			offsets.push_back(offsets.back() + row_counts[row][col]);
+		}
+
+		floors.insert(floors.end(), row_floors[row].begin(), row_floors[row].end());
+		std::vector<float>().swap(row_floors[row]);
+	}
+
+	return true;
+}
+
+bool FloorMap::Write(const std::string &filename) const {
+	if (!IsLoaded()) {
+		return false;
+	}
+
+	FILE *f = fopen(filename.c_str(), "wb");
+	if (!f) {
+		return false;
+	}
+
+	floor_map_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, FloorMapMagic, sizeof(header.magic));
+	header.version = FloorMapVersion;
+	header.cell_size = cell_size;
+	header.origin_x = origin_x;
+	header.origin_z = origin_z;
+	header.cells_x = cells_x;
+	header.cells_z = cells_z;
+	header.floor_count = (uint32_t)floors.size();
+	header.fingerprint = fingerprint;
+
+	std::vector<uint8_t> counts(offsets.size() - 1);
+	for (size_t i = 0; i < counts.size(); ++i) {
+		counts[i] = (uint8_t)(offsets[i + 1] - offsets[i]);
+	}
+
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+		fwrite(&counts[0], counts.size(), 1, f) == 1 &&
+		(floors.empty() || fwrite(&floors[0], sizeof(float), floors.size(), f) == floors.size());
+	ok = fclose(f) == 0 && ok;
+	return ok;
+}
+
+bool FloorMap::Load(const std::string &filename, const ZoneMap &map) {
+	Clear();
+	FILE *f = fopen(filename.c_str(), "rb");
+	if (!f) {
+		return false;
+	}
+
+	floor_map_header header;
+	if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, FloorMapMagic, sizeof(header.magic)) != 0 ||
+		header.version != FloorMapVersion) {
+		eqLogMessage(LogWarn, "%s is not a floor map this build can read, ignoring it.", filename.c_str());
+		fclose(f);
+		return false;
+	}
+
+	if (header.fingerprint != Fingerprint(map)) {
+		eqLogMessage(LogWarn, "Floor map %s was baked from different geometry than this map, ignoring it.", filename.c_str());
+		fclose(f);
+		return false;
+	}
+
+	uint64_t cell_count = (uint64_t)header.cells_x * header.cells_z;
+	if (header.cell_size <= 0.0f || cell_count == 0 || cell_count > FloorMapMaxCells) {
+		fclose(f);
+		return false;
+	}
+
+	std::vector<uint8_t> counts((size_t)cell_count);
+	offsets.resize((size_t)cell_count + 1);
+	floors.resize(header.floor_count);
+	if (fread(&counts[0], counts.size(), 1, f) != 1 ||
+		(header.floor_count > 0 && fread(&floors[0], sizeof(float), floors.size(), f) != floors.size())) {
+		fclose(f);
+		Clear();
+		return false;
+	}
+
+	fclose(f);
+	offsets[0] = 0;
+	for (size_t i = 0; i < counts.size(); ++i) {
+		offsets[i + 1] = offsets[i] + counts[i];
+	}
+
+	if (offsets.back() != header.floor_count) {
+		Clear();
+		return false;
+	}
+
+	cell_size = header.cell_size;
+	origin_x = header.origin_x;
+	origin_z = header.origin_z;
+	cells_x = header.cells_x;
+	cells_z = header.cells_z;
+	fingerprint = header.fingerprint;
+	return true;
+}
+
+bool FloorMap::FindFloor(float x, float y, float z, float &floor) const {
+	if (!IsLoaded()) {
+		return false;
+	}
+
+	float fx = floorf((x - origin_x) / cell_size);
+	float fz = floorf((z - origin_z) / cell_size);
+	if (!(fx >= 0.0f && fx < (float)cells_x && fz >= 0.0f && fz < (float)cells_z)) {
+		return false;
+	}
+
+	size_t cell = (size_t)fz * cells_x + (size_t)fx;
+	auto begin = floors.begin() + offsets[cell];
+	auto end = floors.begin() + offsets[cell + 1];
+	auto above = std::upper_bound(begin, end, y);
+	if (above == begin) {
+		return false;
+	}
+
+	floor = *(above - 1);
+	return true;
+}
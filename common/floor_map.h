@@ -0,0 +1,56 @@
+#ifndef EQEMU_COMMON_FLOOR_MAP_H
+#define EQEMU_COMMON_FLOOR_MAP_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#define GLM_FORCE_RADIANS
+#include <glm.hpp>
+
+namespace EQEmu
+{
+	class ThreadPool;
+}
+
+class ZoneMap;
+
+//Every floor height under the centre of each cell of a regular grid over a zone's collidable geometry, so a best floor
+//query is a lookup instead of a long raycast. The grid is in map space, x by z with y up, and a floor is any surface
+//a downward FindBestFloor ray would stop on, so a cell under a multi story building gets one height per story.
+//Heights are sampled at the cell centre; on a slope the floor under another point of the cell differs by up to the
+//slope times half the cell diagonal.
+class FloorMap
+{
+public:
+	FloorMap();
+	~FloorMap();
+
+	//Samples the map's collidable geometry, rows are spread over pool if there is one
+	bool Build(const ZoneMap &map, float cell_size, EQEmu::ThreadPool *pool = nullptr);
+	bool Write(const std::string &filename) const;
+	//Refuses a file baked from geometry other than map's
+	bool Load(const std::string &filename, const ZoneMap &map);
+	void Clear();
+
+	//Highest floor in the cell holding x, z that is no higher than y, false when there's none or x, z is off the grid
+	bool FindFloor(float x, float y, float z, float &floor) const;
+
+	bool IsLoaded() const { return !offsets.empty(); }
+	float GetCellSize() const { return cell_size; }
+	uint32_t GetFloorCount() const { return (uint32_t)floors.size(); }
+
+	//Hash of the collidable geometry Build samples, kept in the file to catch a floor map older than its map
+	static uint64_t Fingerprint(const ZoneMap &map);
+private:
+	float cell_size;
+	float origin_x;
+	float origin_z;
+	uint64_t fingerprint;
+	uint32_t cells_x;
+	uint32_t cells_z;
+	//floors of cell i are floors[offsets[i]] to floors[offsets[i + 1]], lowest first
+	std::vector<uint32_t> offsets;
+	std::vector<float> floors;
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef EQEMU_COMMON_FNV_HASH_H
+#define EQEMU_COMMON_FNV_HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace EQEmu
+{
+
+const uint64_t FNV1a64Offset = 0xcbf29ce484222325ULL;
+const uint64_t FNV1a64Prime = 0x100000001b3ULL;
+
+//64 bit FNV-1a, pass the previous result back in as hash to continue a running hash
+inline uint64_t FNV1a64(const void *data, size_t len, uint64_t hash = FNV1a64Offset) {
+	const uint8_t *p = (const uint8_t*)data;
+	for (size_t i = 0; i < len; ++i) {
+		hash ^= p[i];
+		hash *= FNV1a64Prime;
+	}
+
+	return hash;
+}
+
+//Hashes a whole file in fixed size reads; returns false if the file can't be opened or read
+inline bool FNV1a64File(const std::string &filename, uint64_t &hash) {
+	FILE *f = fopen(filename.c_str(), "rb");
+	if (!f) {
+		return false;
+	}
+
+	std::vector<char> buffer(1024 * 1024);
+	hash = FNV1a64Offset;
+	for (;;) {
+		size_t read = fread(&buffer[0], 1, buffer.size(), f);
+		hash = FNV1a64(&buffer[0], read, hash);
+		if (read < buffer.size()) {
+			break;
+		}
+	}
+
+	bool ok = ferror(f) == 0;
+	fclose(f);
+	return ok;
+}
+
+}
+
+#endif
@@ -0,0 +1,137 @@
+#include "los_cache.h"
+#include "fnv_hash.h"
+#include <math.h>
+#include <algorithm>
+
+//slot layout, high to low: 32 bit tag, 30 bit version, los, referenced. 0 is an empty slot, no tag is ever 0.
+const uint64_t LOSCacheVersionMask = (1ULL << 30) - 1;
+const uint64_t LOSCacheResultBit = 2;
+const uint64_t LOSCacheReferencedBit = 1;
+
+static uint64_t MakeSlot(uint64_t tag, uint64_t version, bool los) {
+	return (tag << 32) | ((version & LOSCacheVersionMask) << 2) | (los ? LOSCacheResultBit : 0);
+}
+
+//the referenced bit is the only part of a slot that changes in place
+static bool SlotMatches(uint64_t slot, uint64_t tag) {
+	return slot != 0 && (slot >> 32) == tag;
+}
+
+static bool SlotCurrent(uint64_t slot, uint64_t version) {
+	return ((slot >> 2) & LOSCacheVersionMask) == (version & LOSCacheVersionMask);
+}
+
+LOSCache::LOSCache(float cell_size, uint32_t entries) : cell_size(cell_size), inv_cell_size(1.0f / cell_size) {
+	set_count = 1;
+	while (set_count * Ways < entries && set_count < (1u << 24)) {
+		set_count <<= 1;
+	}
+
+	slots.reset(new std::atomic<uint64_t>[set_count * Ways]);
+	for (uint32_t i = 0; i < set_count * Ways; ++i) {
+		slots[i].store(0, std::memory_order_relaxed);
+	}
+
+	ResetStats();
+}
+
+LOSCache::~LOSCache() {
+}
+
+uint64_t LOSCache::Hash(const glm::vec3 &a, const glm::vec3 &b) const {
+	int32_t cells[6] = {
+		(int32_t)floorf(a.x * inv_cell_size), (int32_t)floorf(a.y * inv_cell_size), (int32_t)floorf(a.z * inv_cell_size),
+		(int32_t)floorf(b.x * inv_cell_size), (int32_t)floorf(b.y * inv_cell_size), (int32_t)floorf(b.z * inv_cell_size)
+	};
+
+	//same key whichever way round the ends come
+	if (std::lexicographical_compare(cells + 3, cells + 6, cells, cells + 3)) {
+		std::swap_ranges(cells, cells + 3, cells + 3);
+	}
+
+	uint64_t h = EQEmu::FNV1a64(cells, sizeof(cells));
+	//FNV's low bits are weak, fold the top in before they pick the set
+	h ^= h >> 29;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 32;
+	return h;
+}
+
+bool LOSCache::Lookup(const glm::vec3 &a, const glm::vec3 &b, uint64_t version, bool &los) {
+	uint64_t h = Hash(a, b);
+	uint64_t tag = std::max<uint64_t>(h >> 32, 1);
+	std::atomic<uint64_t> *set = &slots[(h & (set_count - 1)) * Ways];
+	for (uint32_t i = 0; i < Ways; ++i) {
+		uint64_t slot = set[i].load(std::memory_order_relaxed);
+		if (!SlotMatches(slot, tag)) {
+			continue;
+		}
+
+		if (!SlotCurrent(slot, version)) {
+			stale.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		if ((slot & LOSCacheReferencedBit) == 0) {
+			set[i].fetch_or(LOSCacheReferencedBit, std::memory_order_relaxed);
+		}
+
+		hits.fetch_add(1, std::memory_order_relaxed);
+		los = (slot & LOSCacheResultBit) != 0;
+		return true;
+	}
+
+	misses.fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
+
+void LOSCache::Insert(const glm::vec3 &a, const glm::vec3 &b, uint64_t version, bool los) {
+	uint64_t h = Hash(a, b);
+	uint64_t tag = std::max<uint64_t>(h >> 32, 1);
+	std::atomic<uint64_t> *set = &slots[(h & (set_count - 1)) * Ways];
+
+	//reuse this key's old slot, then an empty or stale one, then clock: clear referenced bits until an unreferenced
+	//slot turns up, the first cleared one if they all were
+	int victim = -1;
+	for (uint32_t i = 0; i < Ways; ++i) {
+		uint64_t slot = set[i].load(std::memory_order_relaxed);
+		if (SlotMatches(slot, tag) || slot == 0 || !SlotCurrent(slot, version)) {
+			victim = (int)i;
+			break;
+		}
+	}
+
+	if (victim == -1) {
+		for (uint32_t i = 0; i < Ways; ++i) {
+			uint64_t slot = set[i].fetch_and(~LOSCacheReferencedBit, std::memory_order_relaxed);
+			if ((slot & LOSCacheReferencedBit) == 0) {
+				victim = (int)i;
+				break;
+			}
+		}
+
+		if (victim == -1) {
+			victim = 0;
+		}
+
+		evictions.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	set[victim].store(MakeSlot(tag, version, los), std::memory_order_relaxed);
+}
+
+LOSCacheStats LOSCache::GetStats() const {
+	LOSCacheStats s;
+	s.hits = hits.load(std::memory_order_relaxed);
+	s.misses = misses.load(std::memory_order_relaxed);
+	s.stale = stale.load(std::memory_order_relaxed);
+	s.evictions = evictions.load(std::memory_order_relaxed);
+	return s;
+}
+
+void LOSCache::ResetStats() {
+	hits.store(0, std::memory_order_relaxed);
+	misses.store(0, std::memory_order_relaxed);
+	stale.store(0, std::memory_order_relaxed);
+	evictions.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,53 @@
+#ifndef EQEMU_COMMON_LOS_CACHE_H
+#define EQEMU_COMMON_LOS_CACHE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#define GLM_FORCE_RADIANS
+#include <glm.hpp>
+
+struct LOSCacheStats
+{
+	uint64_t hits;
+	//not found at all, stale lookups aren't counted here
+	uint64_t misses;
+	//found, but from before the geometry last changed
+	uint64_t stale;
+	uint64_t evictions;
+};
+
+//Bounded cache of line of sight results keyed on the pair of cells the two ends fall in, so every check between the
+//same two cells gets the answer of whichever one was cached first. Ends are unordered, a -> b and b -> a share an
+//entry. Each entry is one 64 bit word, a tag from the key hash, the geometry version it was computed at, the result
+//and a clock reference bit, held in 4 way sets; lookups and inserts are plain atomic loads, stores and bit ops so any
+//number of threads can use it without locking. A racing insert can overwrite another, which only loses an entry.
+class LOSCache
+{
+public:
+	LOSCache(float cell_size, uint32_t entries);
+	~LOSCache();
+
+	bool Lookup(const glm::vec3 &a, const glm::vec3 &b, uint64_t version, bool &los);
+	void Insert(const glm::vec3 &a, const glm::vec3 &b, uint64_t version, bool los);
+
+	float GetCellSize() const { return cell_size; }
+	uint32_t GetCapacity() const { return set_count * Ways; }
+	LOSCacheStats GetStats() const;
+	void ResetStats();
+private:
+	static const uint32_t Ways = 4;
+
+	uint64_t Hash(const glm::vec3 &a, const glm::vec3 &b) const;
+
+	float cell_size;
+	float inv_cell_size;
+	uint32_t set_count;
+	std::unique_ptr<std::atomic<uint64_t>[]> slots;
+	std::atomic<uint64_t> hits;
+	std::atomic<uint64_t> misses;
+	std::atomic<uint64_t> stale;
+	std::atomic<uint64_t> evictions;
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include "memory_mapped_file.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MemoryMappedFile::MemoryMappedFile() {
+	data = nullptr;
+	size = 0;
+#ifdef _WIN32
+	file_handle = INVALID_HANDLE_VALUE;
+	mapping_handle = nullptr;
+#endif
+}
+
+MemoryMappedFile::~MemoryMappedFile() {
+	Close();
+}
+
+#ifdef _WIN32
+bool MemoryMappedFile::Open(const std::string &filename) {
+	Close();
+
+	file_handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file_handle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0) {
+		Close();
+		return false;
+	}
+
+	mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping_handle) {
+		Close();
+		return false;
+	}
+
+	data = (const char*)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+	if (!data) {
+		Close();
+		return false;
+	}
+
+	size = (size_t)file_size.QuadPart;
+	return true;
+}
+
+void MemoryMappedFile::Close() {
+	if (data) {
+		UnmapViewOfFile(data);
+		data = nullptr;
+	}
+
+	if (mapping_handle) {
+		CloseHandle(mapping_handle);
+		mapping_handle = nullptr;
+	}
+
+	if (file_handle != INVALID_HANDLE_VALUE) {
+		CloseHandle(file_handle);
+		file_handle = INVALID_HANDLE_VALUE;
+	}
+
+	size = 0;
+}
+#else
+bool MemoryMappedFile::Open(const std::string &filename) {
+	Close();
+
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+
+	void *mapped = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (mapped == MAP_FAILED) {
+		return false;
+	}
+
+	data = (const char*)mapped;
+	size = (size_t)st.st_size;
+	return true;
+}
+
+void MemoryMappedFile::Close() {
+	if (data) {
+		munmap((void*)data, size);
+		data = nullptr;
+	}
+
+	size = 0;
+}
+#endif
@@ -0,0 +1,34 @@
+#ifndef EQEMU_COMMON_MEMORY_MAPPED_FILE_H
+#define EQEMU_COMMON_MEMORY_MAPPED_FILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+//Read only view of a whole file mapped into memory.
+//Pages are shared with every other process mapping the same file.
+class MemoryMappedFile
+{
+public:
+	MemoryMappedFile();
+	~MemoryMappedFile();
+
+	bool Open(const std::string &filename);
+	void Close();
+
+	const char *GetData() const { return data; }
+	size_t GetSize() const { return size; }
+	bool IsOpen() const { return data != nullptr; }
+private:
+	MemoryMappedFile(const MemoryMappedFile &s);
+	const MemoryMappedFile &operator=(const MemoryMappedFile &s);
+
+	const char *data;
+	size_t size;
+#ifdef _WIN32
+	void *file_handle;
+	void *mapping_handle;
+#endif
+};
+
+#endif
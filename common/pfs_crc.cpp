@@ -22,7 +22,7 @@ void EQEmu::PFS::CRC::GenerateCRCTable() {
 	}
 }
 
-int32_t EQEmu::PFS::CRC::Update(int32_t crc, int8_t *data, int32_t length) {
+int32_t EQEmu::PFS::CRC::Update(int32_t crc, const int8_t *data, int32_t length) const {
 	int32_t i;
 	while(length > 0) {
 		i = ((crc >> 24) ^ *data) & 0xFF;
@@ -34,16 +34,10 @@ int32_t EQEmu::PFS::CRC::Update(int32_t crc, int8_t *data, int32_t length) {
 	return crc;
 }
 
-int32_t EQEmu::PFS::CRC::Get(std::string s) {
+int32_t EQEmu::PFS::CRC::Get(const std::string &s) const {
 	if(s.length() == 0)
 		return 0;
 
-	int8_t *buf = new int8_t[s.length() + 1];
-	memset(buf, 0, s.length() + 1);
-	memcpy(buf, s.c_str(), s.length());
-	
-	int32_t result = Update(0, buf, (int32_t)(s.length() + 1));
-	delete[] buf;
-
-	return result;
+	//the terminating null is part of the hashed name
+	return Update(0, (const int8_t*)s.c_str(), (int32_t)(s.length() + 1));
 }
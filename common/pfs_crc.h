@@ -35,8 +35,9 @@ public:
 	~CRC() { }
 	static CRC &Instance();
 	
-	int32_t Update(int32_t crc, int8_t *data, int32_t length);
-	int32_t Get(std::string s);
+	//the table is filled once when the instance is created and only read afterwards, so both are safe to call from any thread
+	int32_t Update(int32_t crc, const int8_t *data, int32_t length) const;
+	int32_t Get(const std::string &s) const;
 private:
 	CRC() { GenerateCRCTable(); }
 	CRC(const CRC &s);
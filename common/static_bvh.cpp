@@ -0,0 +1,526 @@
+#include "static_bvh.h"
+#include "zone_map.h"
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define EQEMU_STATIC_BVH_SSE
+#include <emmintrin.h>
+#endif
+
+const uint32_t StaticBvhMaxLeafSize = 4;
+const uint32_t StaticBvhBins = 16;
+//keeps the wide tree under 64 levels so a fixed traversal stack can't overflow
+const uint32_t StaticBvhMaxDepth = 48;
+const uint32_t StaticBvhNoChild = 0xFFFFFFFF;
+
+#ifdef EQEMU_ENABLE_PHYSICS_STATS
+static thread_local uint32_t static_bvh_visits = 0;
+#endif
+
+struct StaticBvh::Ray
+{
+	glm::vec3 from;
+	glm::vec3 dir;
+	glm::vec3 inv_dir;
+};
+
+static float HalfArea(const glm::vec3 &min, const glm::vec3 &max) {
+	glm::vec3 d = max - min;
+	return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+StaticBvh::StaticBvh() {
+}
+
+StaticBvh::~StaticBvh() {
+}
+
+void StaticBvh::AddTriangles(const glm::vec3 *verts, const uint32_t *inds, uint32_t tri_count, uint32_t index_stride, const glm::mat4 &transform) {
+	source.reserve(source.size() + tri_count * 3);
+	range_ends.push_back((uint32_t)(source.size() / 3) + tri_count);
+	const char *tri = (const char*)inds;
+	for (uint32_t i = 0; i < tri_count; ++i) {
+		const uint32_t *idx = (const uint32_t*)tri;
+		for (int k = 0; k < 3; ++k) {
+			source.push_back(glm::vec3(transform * glm::vec4(verts[idx[k]], 1.0f)));
+		}
+		tri += index_stride;
+	}
+}
+
+void StaticBvh::AddCollidable(const ZoneMap &map) {
+	ZoneMapMeshView view = map.GetStaticCollidableMesh();
+	AddTriangles(view.verts, view.inds, view.tri_count, view.index_stride, glm::mat4(1.0f));
+	for (uint32_t i = 0; i < map.GetInstanceCount(); ++i) {
+		uint32_t model;
+		glm::mat4 transform;
+		view = ZoneMapMeshView();
+		if (map.GetInstance(i, model, transform)) {
+			view = map.GetModelMesh(model, true);
+		}
+
+		AddTriangles(view.verts, view.inds, view.tri_count, view.index_stride, transform);
+	}
+}
+
+uint32_t StaticBvh::GetRange(uint32_t triangle) const {
+	return (uint32_t)(std::upper_bound(range_ends.begin(), range_ends.end(), triangle) - range_ends.begin());
+}
+
+void StaticBvh::Build() {
+	nodes.clear();
+	triangles.clear();
+
+	uint32_t tri_count = (uint32_t)(source.size() / 3);
+	if (tri_count == 0) {
+		return;
+	}
+
+	build_refs.resize(tri_count);
+	build_min.resize(tri_count);
+	build_max.resize(tri_count);
+	build_center.resize(tri_count);
+	for (uint32_t i = 0; i < tri_count; ++i) {
+		const glm::vec3 &v0 = source[i * 3 + 0];
+		const glm::vec3 &v1 = source[i * 3 + 1];
+		const glm::vec3 &v2 = source[i * 3 + 2];
+		build_refs[i] = i;
+		build_min[i] = glm::min(v0, glm::min(v1, v2));
+		build_max[i] = glm::max(v0, glm::max(v1, v2));
+		build_center[i] = (build_min[i] + build_max[i]) * 0.5f;
+	}
+
+	build_nodes.reserve(tri_count * 2);
+	BuildBinary(0, tri_count, 0);
+
+	triangles.resize(tri_count);
+	for (uint32_t i = 0; i < tri_count; ++i) {
+		uint32_t ref = build_refs[i];
+		Triangle &t = triangles[i];
+		t.v0 = source[ref * 3 + 0];
+		t.e1 = source[ref * 3 + 1] - t.v0;
+		t.e2 = source[ref * 3 + 2] - t.v0;
+		t.index = ref;
+	}
+
+	nodes.reserve(build_nodes.size() / 2 + 1);
+	Collapse(0);
+
+	std::vector<glm::vec3>().swap(source);
+	std::vector<BuildNode>().swap(build_nodes);
+	std::vector<uint32_t>().swap(build_refs);
+	std::vector<glm::vec3>().swap(build_min);
+	std::vector<glm::vec3>().swap(build_max);
+	std::vector<glm::vec3>().swap(build_center);
+}
+
+void StaticBvh::Clear() {
+	std::vector<glm::vec3>().swap(source);
+	std::vector<uint32_t>().swap(range_ends);
+	std::vector<Node>().swap(nodes);
+	std::vector<Triangle>().swap(triangles);
+}
+
+uint32_t StaticBvh::TakeVisitCount() {
+#ifdef EQEMU_ENABLE_PHYSICS_STATS
+	uint32_t visits = static_bvh_visits;
+	static_bvh_visits = 0;
+	return visits;
+#else
+	return 0;
+#endif
+}
+
+bool StaticBvh::GetBounds(glm::vec3 &min, glm::vec3 &max) const {
+	if (nodes.empty()) {
+		return false;
+	}
+
+	min = glm::vec3(FLT_MAX);
+	max = glm::vec3(-FLT_MAX);
+	const Node &root = nodes[0];
+	for (int i = 0; i < 4; ++i) {
+		if (root.child[i] == -1 && root.count[i] == 0) {
+			continue;
+		}
+
+		min = glm::min(min, glm::vec3(root.bounds[0][i], root.bounds[1][i], root.bounds[2][i]));
+		max = glm::max(max, glm::vec3(root.bounds[3][i], root.bounds[4][i], root.bounds[5][i]));
+	}
+
+	return true;
+}
+
+uint32_t StaticBvh::BuildBinary(uint32_t first, uint32_t count, uint32_t depth) {
+	uint32_t idx = (uint32_t)build_nodes.size();
+	build_nodes.push_back(BuildNode());
+
+	glm::vec3 min(FLT_MAX);
+	glm::vec3 max(-FLT_MAX);
+	glm::vec3 cmin(FLT_MAX);
+	glm::vec3 cmax(-FLT_MAX);
+	for (uint32_t i = first; i < first + count; ++i) {
+		uint32_t ref = build_refs[i];
+		min = glm::min(min, build_min[ref]);
+		max = glm::max(max, build_max[ref]);
+		cmin = glm::min(cmin, build_center[ref]);
+		cmax = glm::max(cmax, build_center[ref]);
+	}
+
+	BuildNode &node = build_nodes[idx];
+	node.min = min;
+	node.max = max;
+	node.left = StaticBvhNoChild;
+	node.right = StaticBvhNoChild;
+	node.first = first;
+	node.count = count;
+	if (count <= StaticBvhMaxLeafSize || depth >= StaticBvhMaxDepth) {
+		return idx;
+	}
+
+	//binned SAH over all three axes
+	int best_axis = -1;
+	uint32_t best_split = 0;
+	float best_cost = FLT_MAX;
+	for (int axis = 0; axis < 3; ++axis) {
+		float extent = cmax[axis] - cmin[axis];
+		if (extent <= 0.0f) {
+			continue;
+		}
+
+		uint32_t bin_count[StaticBvhBins] = { 0 };
+		glm::vec3 bin_min[StaticBvhBins];
+		glm::vec3 bin_max[StaticBvhBins];
+		for (uint32_t b = 0; b < StaticBvhBins; ++b) {
+			bin_min[b] = glm::vec3(FLT_MAX);
+			bin_max[b] = glm::vec3(-FLT_MAX);
+		}
+
+		float scale = StaticBvhBins / extent;
+		for (uint32_t i = first; i < first + count; ++i) {
+			uint32_t ref = build_refs[i];
+			uint32_t b = std::min(StaticBvhBins - 1, (uint32_t)((build_center[ref][axis] - cmin[axis]) * scale));
+			bin_count[b]++;
+			bin_min[b] = glm::min(bin_min[b], build_min[ref]);
+			bin_max[b] = glm::max(bin_max[b], build_max[ref]);
+		}
+
+		float right_area[StaticBvhBins];
+		uint32_t right_count[StaticBvhBins];
+		glm::vec3 rmin(FLT_MAX);
+		glm::vec3 rmax(-FLT_MAX);
+		uint32_t rcount = 0;
+		for (uint32_t b = StaticBvhBins - 1; b > 0; --b) {
+			rmin = glm::min(rmin, bin_min[b]);
+			rmax = glm::max(rmax, bin_max[b]);
+			rcount += bin_count[b];
+			right_area[b] = rcount > 0 ? HalfArea(rmin, rmax) : 0.0f;
+			right_count[b] = rcount;
+		}
+
+		glm::vec3 lmin(FLT_MAX);
+		glm::vec3 lmax(-FLT_MAX);
+		uint32_t lcount = 0;
+		for (uint32_t b = 1; b < StaticBvhBins; ++b) {
+			lmin = glm::min(lmin, bin_min[b - 1]);
+			lmax = glm::max(lmax, bin_max[b - 1]);
+			lcount += bin_count[b - 1];
+			if (lcount == 0 || right_count[b] == 0) {
+				continue;
+			}
+
+			float cost = HalfArea(lmin, lmax) * lcount + right_area[b] * right_count[b];
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_axis = axis;
+				best_split = b;
+			}
+		}
+	}
+
+	if (best_axis == -1 || best_cost >= HalfArea(min, max) * count) {
+		if (count <= StaticBvhMaxLeafSize * 4) {
+			return idx;
+		}
+	}
+
+	uint32_t mid = first + count / 2;
+	if (best_axis != -1) {
+		float split_scale = StaticBvhBins / (cmax[best_axis] - cmin[best_axis]);
+		float split_min = cmin[best_axis];
+		auto split = std::partition(build_refs.begin() + first, build_refs.begin() + first + count, [&](uint32_t ref) {
+			uint32_t b = std::min(StaticBvhBins - 1, (uint32_t)((build_center[ref][best_axis] - split_min) * split_scale));
+			return b < best_split;
+		});
+		mid = (uint32_t)(split - build_refs.begin());
+	}
+
+	if (mid == first || mid == first + count) {
+		mid = first + count / 2;
+	}
+
+	uint32_t left = BuildBinary(first, mid - first, depth + 1);
+	uint32_t right = BuildBinary(mid, first + count - mid, depth + 1);
+	build_nodes[idx].left = left;
+	build_nodes[idx].right = right;
+	return idx;
+}
+
+int32_t StaticBvh::Collapse(uint32_t binary) {
+	int32_t idx = (int32_t)nodes.size();
+	nodes.push_back(Node());
+
+	uint32_t slots[4];
+	uint32_t slot_count = 0;
+	if (build_nodes[binary].left == StaticBvhNoChild) {
+		slots[slot_count++] = binary;
+	}
+	else {
+		slots[slot_count++] = build_nodes[binary].left;
+		slots[slot_count++] = build_nodes[binary].right;
+	}
+
+	//open the biggest inner child until all four slots are used
+	while (slot_count < 4) {
+		int best = -1;
+		float best_area = -1.0f;
+		for (uint32_t i = 0; i < slot_count; ++i) {
+			const BuildNode &bn = build_nodes[slots[i]];
+			if (bn.left == StaticBvhNoChild) {
+				continue;
+			}
+
+			float area = HalfArea(bn.min, bn.max);
+			if (area > best_area) {
+				best_area = area;
+				best = (int)i;
+			}
+		}
+
+		if (best == -1) {
+			break;
+		}
+
+		uint32_t opened = slots[best];
+		slots[best] = build_nodes[opened].left;
+		slots[slot_count++] = build_nodes[opened].right;
+	}
+
+	Node node;
+	for (uint32_t i = 0; i < 4; ++i) {
+		if (i >= slot_count) {
+			//a point at FLT_MAX can't be reached by any finite ray
+			for (int a = 0; a < 6; ++a) {
+				node.bounds[a][i] = FLT_MAX;
+			}
+			node.child[i] = -1;
+			node.count[i] = 0;
+			continue;
+		}
+
+		const BuildNode &bn = build_nodes[slots[i]];
+		node.bounds[0][i] = bn.min.x;
+		node.bounds[1][i] = bn.min.y;
+		node.bounds[2][i] = bn.min.z;
+		node.bounds[3][i] = bn.max.x;
+		node.bounds[4][i] = bn.max.y;
+		node.bounds[5][i] = bn.max.z;
+		if (bn.left == StaticBvhNoChild) {
+			node.child[i] = (int32_t)bn.first;
+			node.count[i] = bn.count;
+		}
+		else {
+			node.child[i] = Collapse(slots[i]);
+			node.count[i] = 0;
+		}
+	}
+
+	nodes[idx] = node;
+	return idx;
+}
+
+int StaticBvh::IntersectNode(const Node &node, const Ray &ray, float max_fraction, float *entry) const {
+#ifdef EQEMU_STATIC_BVH_SSE
+	__m128 ox = _mm_set1_ps(ray.from.x);
+	__m128 oy = _mm_set1_ps(ray.from.y);
+	__m128 oz = _mm_set1_ps(ray.from.z);
+	__m128 ix = _mm_set1_ps(ray.inv_dir.x);
+	__m128 iy = _mm_set1_ps(ray.inv_dir.y);
+	__m128 iz = _mm_set1_ps(ray.inv_dir.z);
+
+	__m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bounds[0]), ox), ix);
+	__m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bounds[1]), oy), iy);
+	__m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bounds[2]), oz), iz);
+	__m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bounds[3]), ox), ix);
+	__m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bounds[4]), oy), iy);
+	__m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bounds[5]), oz), iz);
+
+	__m128 tmin = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)), _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_setzero_ps()));
+	__m128 tmax = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)), _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_set1_ps(max_fraction)));
+	_mm_storeu_ps(entry, tmin);
+	return _mm_movemask_ps(_mm_cmple_ps(tmin, tmax));
+#else
+	int mask = 0;
+	for (int i = 0; i < 4; ++i) {
+		float tmin = 0.0f;
+		float tmax = max_fraction;
+		for (int a = 0; a < 3; ++a) {
+			float t0 = (node.bounds[a][i] - ray.from[a]) * ray.inv_dir[a];
+			float t1 = (node.bounds[a + 3][i] - ray.from[a]) * ray.inv_dir[a];
+			tmin = std::max(tmin, std::min(t0, t1));
+			tmax = std::min(tmax, std::max(t0, t1));
+		}
+
+		entry[i] = tmin;
+		if (tmin <= tmax) {
+			mask |= 1 << i;
+		}
+	}
+
+	return mask;
+#endif
+}
+
+bool StaticBvh::IntersectTriangle(const Triangle &tri, const Ray &ray, bool cull_back_faces, float max_fraction, float &fraction) const {
+	//same plane crossing and edge tests as btTriangleRaycastCallback so edge cases land the same way
+	glm::vec3 normal = glm::cross(tri.e1, tri.e2);
+	float dist_a = glm::dot(normal, ray.from - tri.v0);
+	float dist_b = dist_a + glm::dot(normal, ray.dir);
+	if (dist_a * dist_b >= 0.0f) {
+		return false;
+	}
+
+	if (cull_back_faces && dist_a <= 0.0f) {
+		return false;
+	}
+
+	float distance = dist_a / (dist_a - dist_b);
+	if (distance >= max_fraction) {
+		return false;
+	}
+
+	float edge_tolerance = glm::dot(normal, normal) * -0.0001f;
+	glm::vec3 point = ray.from + ray.dir * distance;
+	glm::vec3 v0p = tri.v0 - point;
+	glm::vec3 v1p = tri.v0 + tri.e1 - point;
+	if (glm::dot(glm::cross(v0p, v1p), normal) < edge_tolerance) {
+		return false;
+	}
+
+	glm::vec3 v2p = tri.v0 + tri.e2 - point;
+	if (glm::dot(glm::cross(v1p, v2p), normal) < edge_tolerance) {
+		return false;
+	}
+
+	if (glm::dot(glm::cross(v2p, v0p), normal) < edge_tolerance) {
+		return false;
+	}
+
+	fraction = distance;
+	return true;
+}
+
+template<bool AnyHit>
+bool StaticBvh::Traverse(const glm::vec3 &from, const glm::vec3 &to, bool cull_back_faces, float max_fraction, StaticBvhHit *hit) const {
+	if (nodes.empty()) {
+		return false;
+	}
+
+	Ray ray;
+	ray.from = from;
+	ray.dir = to - from;
+	for (int a = 0; a < 3; ++a) {
+		float d = ray.dir[a];
+		if (fabs(d) < 1e-20f) {
+			d = d < 0.0f ? -1e-20f : 1e-20f;
+		}
+		ray.inv_dir[a] = 1.0f / d;
+	}
+
+	float closest = max_fraction;
+	uint32_t closest_tri = StaticBvhNoChild;
+
+	int32_t stack[256];
+	int sp = 0;
+	stack[sp++] = 0;
+	while (sp > 0) {
+		const Node &node = nodes[stack[--sp]];
+#ifdef EQEMU_ENABLE_PHYSICS_STATS
+		++static_bvh_visits;
+#endif
+		float entry[4];
+		int mask = IntersectNode(node, ray, closest, entry);
+		if (mask == 0) {
+			continue;
+		}
+
+		//nearest child last so it comes off the stack first
+		int order[4];
+		int order_count = 0;
+		for (int i = 0; i < 4; ++i) {
+			if (mask & (1 << i)) {
+				int j = order_count++;
+				if (!AnyHit) {
+					while (j > 0 && entry[order[j - 1]] < entry[i]) {
+						order[j] = order[j - 1];
+						--j;
+					}
+				}
+				order[j] = i;
+			}
+		}
+
+		for (int o = 0; o < order_count; ++o) {
+			int i = order[o];
+			if (node.count[i] == 0) {
+				stack[sp++] = node.child[i];
+				continue;
+			}
+
+			if (!AnyHit && entry[i] > closest) {
+				continue;
+			}
+
+			for (uint32_t t = 0; t < node.count[i]; ++t) {
+				uint32_t tri_idx = (uint32_t)node.child[i] + t;
+				float fraction;
+				if (IntersectTriangle(triangles[tri_idx], ray, cull_back_faces, closest, fraction)) {
+					if (AnyHit) {
+						return true;
+					}
+
+					closest = fraction;
+					closest_tri = tri_idx;
+				}
+			}
+		}
+	}
+
+	if (closest_tri == StaticBvhNoChild) {
+		return false;
+	}
+
+	if (hit) {
+		const Triangle &tri = triangles[closest_tri];
+		glm::vec3 normal = glm::normalize(glm::cross(tri.e1, tri.e2));
+		if (glm::dot(normal, from - tri.v0) <= 0.0f) {
+			normal = -normal;
+		}
+
+		hit->fraction = closest;
+		hit->normal = normal;
+		hit->triangle = tri.index;
+	}
+
+	return true;
+}
+
+bool StaticBvh::Raycast(const glm::vec3 &from, const glm::vec3 &to, bool cull_back_faces, float max_fraction, StaticBvhHit &hit) const {
+	return Traverse<false>(from, to, cull_back_faces, max_fraction, &hit);
+}
+
+bool StaticBvh::Occluded(const glm::vec3 &from, const glm::vec3 &to, bool cull_back_faces) const {
+	return Traverse<true>(from, to, cull_back_faces, 1.0f, nullptr);
+}
@@ -0,0 +1,103 @@
+#ifndef EQEMU_COMMON_STATIC_BVH_H
+#define EQEMU_COMMON_STATIC_BVH_H
+
+#include <stdint.h>
+#include <vector>
+#define GLM_FORCE_RADIANS
+#include <glm.hpp>
+
+class ZoneMap;
+
+struct StaticBvhHit
+{
+	float fraction;
+	glm::vec3 normal;
+	uint32_t triangle;
+};
+
+//4 wide BVH over triangles that never move, for raycasts against a zone's static collision.
+//Nodes hold the bounds of their four children side by side so one SSE pass tests a ray against all of them,
+//there's a plain scalar path for targets without SSE2.
+//Hits follow Bullet's triangle raycast so results line up with EQPhysics' Bullet path: rays are segments, fractions
+//are along from -> to, a back face is one whose (v1 - v0) x (v2 - v0) normal points away from the ray start and the
+//reported normal is unit length and faces the ray start.
+class StaticBvh
+{
+public:
+	StaticBvh();
+	~StaticBvh();
+
+	//Adds an indexed mesh, index_stride is the byte distance between triangles. Takes effect on the next Build, which
+	//copies what it needs and drops the added triangles.
+	void AddTriangles(const glm::vec3 *verts, const uint32_t *inds, uint32_t tri_count, uint32_t index_stride, const glm::mat4 &transform);
+	//Adds a map's collidable geometry, the static mesh plus every placed instance, same as RegisterZoneMap puts in the world.
+	//Range 0 is the static mesh and range i + 1 is instance i, empty if the instance can't be read.
+	void AddCollidable(const ZoneMap &map);
+	void Build();
+	void Clear();
+
+	//Closest hit with a fraction below max_fraction
+	bool Raycast(const glm::vec3 &from, const glm::vec3 &to, bool cull_back_faces, float max_fraction, StaticBvhHit &hit) const;
+	//Whether anything is hit at all, stops at the first triangle found
+	bool Occluded(const glm::vec3 &from, const glm::vec3 &to, bool cull_back_faces) const;
+
+	//Nodes this thread's queries have visited since the last call, always 0 unless EQEMU_ENABLE_PHYSICS_STATS is defined
+	static uint32_t TakeVisitCount();
+
+	//Bounds of everything built, false when empty
+	bool GetBounds(glm::vec3 &min, glm::vec3 &max) const;
+	uint32_t GetTriangleCount() const { return (uint32_t)triangles.size(); }
+	uint32_t GetNodeCount() const { return (uint32_t)nodes.size(); }
+	//Which AddTriangles call, counting from 0, added a hit's triangle
+	uint32_t GetRange(uint32_t triangle) const;
+private:
+	//bounds are min x, y, z then max x, y, z, four children each; a slot with count > 0 is a leaf of count triangles
+	//starting at child, otherwise child is a node index or -1 for an unused slot
+	struct Node
+	{
+		float bounds[6][4];
+		int32_t child[4];
+		uint32_t count[4];
+	};
+
+	struct Triangle
+	{
+		glm::vec3 v0;
+		glm::vec3 e1;
+		glm::vec3 e2;
+		uint32_t index;
+	};
+
+	struct BuildNode
+	{
+		glm::vec3 min;
+		glm::vec3 max;
+		uint32_t left;
+		uint32_t right;
+		uint32_t first;
+		uint32_t count;
+	};
+
+	struct Ray;
+
+	uint32_t BuildBinary(uint32_t first, uint32_t count, uint32_t depth);
+	int32_t Collapse(uint32_t binary);
+	int IntersectNode(const Node &node, const Ray &ray, float max_fraction, float *entry) const;
+	bool IntersectTriangle(const Triangle &tri, const Ray &ray, bool cull_back_faces, float max_fraction, float &fraction) const;
+	template<bool AnyHit>
+	bool Traverse(const glm::vec3 &from, const glm::vec3 &to, bool cull_back_faces, float max_fraction, StaticBvhHit *hit) const;
+
+	std::vector<glm::vec3> source;
+	//triangle count after each AddTriangles call
+	std::vector<uint32_t> range_ends;
+	std::vector<Node> nodes;
+	std::vector<Triangle> triangles;
+
+	std::vector<BuildNode> build_nodes;
+	std::vector<uint32_t> build_refs;
+	std::vector<glm::vec3> build_min;
+	std::vector<glm::vec3> build_max;
+	std::vector<glm::vec3> build_center;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+EQEmu::ThreadPool::ThreadPool(size_t threads) {
+	stopping = false;
+
+	if (threads == 0) {
+		threads = 1;
+	}
+
+	for (size_t i = 0; i < threads; ++i) {
+		workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+	}
+}
+
+EQEmu::ThreadPool::~ThreadPool() {
+	{
+		std::unique_lock<std::mutex> lock(queue_lock);
+		stopping = true;
+	}
+
+	queue_cv.notify_all();
+	for (auto &worker : workers) {
+		worker.join();
+	}
+}
+
+void EQEmu::ThreadPool::ParallelFor(size_t count, const std::function<void(size_t, size_t)> &fn) {
+	if (count == 0) {
+		return;
+	}
+
+	size_t ranges = std::min(count, workers.size());
+	size_t per_range = (count + ranges - 1) / ranges;
+
+	std::vector<std::future<void>> pending;
+	for (size_t begin = 0; begin < count; begin += per_range) {
+		size_t end = std::min(count, begin + per_range);
+		pending.push_back(Enqueue([&fn, begin, end]() { fn(begin, end); }));
+	}
+
+	for (auto &p : pending) {
+		p.get();
+	}
+}
+
+size_t EQEmu::ThreadPool::DefaultThreadCount() {
+	size_t threads = std::thread::hardware_concurrency();
+	if (threads == 0) {
+		threads = 1;
+	}
+
+	return threads;
+}
+
+void EQEmu::ThreadPool::WorkerLoop() {
+	for (;;) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(queue_lock);
+			queue_cv.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+			if (stopping && tasks.empty()) {
+				return;
+			}
+
+			task = std::move(tasks.front());
+			tasks.pop();
+		}
+
+		task();
+	}
+}
@@ -0,0 +1,58 @@
+#ifndef EQEMU_COMMON_THREAD_POOL_H
+#define EQEMU_COMMON_THREAD_POOL_H
+
+#include <stdint.h>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+namespace EQEmu
+{
+
+class ThreadPool
+{
+public:
+	ThreadPool(size_t threads);
+	~ThreadPool();
+
+	template<typename Fn>
+	std::future<typename std::result_of<Fn()>::type> Enqueue(Fn fn) {
+		typedef typename std::result_of<Fn()>::type ReturnType;
+
+		auto task = std::make_shared<std::packaged_task<ReturnType()>>(fn);
+		std::future<ReturnType> ret = task->get_future();
+		{
+			std::unique_lock<std::mutex> lock(queue_lock);
+			tasks.push([task]() { (*task)(); });
+		}
+
+		queue_cv.notify_one();
+		return ret;
+	}
+
+	//Splits [0, count) into roughly equal ranges and runs fn(begin, end) for each range on the pool, blocking until all are done.
+	void ParallelFor(size_t count, const std::function<void(size_t, size_t)> &fn);
+
+	size_t Size() const { return workers.size(); }
+	static size_t DefaultThreadCount();
+private:
+	ThreadPool(const ThreadPool &s);
+	const ThreadPool &operator=(const ThreadPool &s);
+
+	void WorkerLoop();
+
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> tasks;
+	std::mutex queue_lock;
+	std::condition_variable queue_cv;
+	bool stopping;
+};
+
+}
+
+#endif
@@ -33,14 +33,24 @@ class WaterMap
 {
 public:
 	WaterMap() { }
-	~WaterMap() { }
+	virtual ~WaterMap() { }
 	
 	static WaterMap* LoadWaterMapfile(std::string dir, std::string zone_name);
 	virtual WaterRegionType ReturnRegionType(float y, float x, float z) const { return RegionTypeNormal; }
+	//out[i] is ReturnRegionType for points[i], which are (x, y, z) as ReturnRegionType names them rather than in its
+	//argument order; the maps loop inside with no virtual call per point
+	virtual void ReturnRegionTypes(const glm::vec3 *points, size_t count, WaterRegionType *out) const {
+		for (size_t i = 0; i < count; ++i) {
+			out[i] = ReturnRegionType(points[i].y, points[i].x, points[i].z);
+		}
+	}
 	virtual bool InWater(float y, float x, float z) const { return false; }
 	virtual bool InVWater(float y, float x, float z) const { return false; }
 	virtual bool InLava(float y, float x, float z) const { return false; }
 	virtual bool InLiquid(float y, float x, float z) const { return false; }
+	//True when every point of the box, x, y and z as ReturnRegionType names them, is the one region type put in type.
+	//False means mixed or can't tell, so it's always safe to answer false.
+	virtual bool BoxRegionType(const glm::vec3 &min, const glm::vec3 &max, WaterRegionType &type) const { return false; }
 	virtual void CreateMeshFrom(std::vector<glm::vec3> &verts, std::vector<unsigned int> &inds) { }
 	virtual void GetRegionDetails(std::vector<RegionDetails> &details) { };
 protected:
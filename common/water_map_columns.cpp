@@ -0,0 +1,324 @@
+#include "water_map_columns.h"
+#include "thread_pool.h"
+#include "log_macros.h"
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <random>
+
+const uint32_t WaterMapColumnsTileBits = 4;
+const uint32_t WaterMapColumnsTileSize = 1 << WaterMapColumnsTileBits;
+const uint32_t WaterMapColumnsTileCells = WaterMapColumnsTileSize * WaterMapColumnsTileSize;
+const uint32_t WaterMapColumnsEmptyTile = 0xFFFFFFFF;
+//a span the bake couldn't prove is one type, its points go to the exact map
+const int32_t WaterMapColumnsMixed = INT32_MIN;
+const int WaterMapColumnsMaxDepth = 10;
+const uint64_t WaterMapColumnsMaxCells = 64 * 1024 * 1024;
+const uint32_t WaterMapColumnsVerifySamples = 200000;
+
+WaterMapColumns::WaterMapColumns(WaterMap *exact) : exact(exact) {
+	Clear();
+}
+
+WaterMapColumns::~WaterMapColumns() {
+}
+
+void WaterMapColumns::Clear() {
+	bake_min = glm::vec3(0.0f);
+	bake_max = glm::vec3(0.0f);
+	cell_size = 0.0f;
+	inv_cell_size = 0.0f;
+	cells_x = 0;
+	cells_y = 0;
+	tiles_x = 0;
+	tiles_y = 0;
+	max_depth = 0;
+	std::vector<uint32_t>().swap(tile_slots);
+	std::vector<uint32_t>().swap(cell_offsets);
+	std::vector<Span>().swap(spans);
+}
+
+//Adds z0 to z1 after whatever the column has so far, merged into the last span when it's the same type
+void WaterMapColumns::AddSpan(std::vector<Span> &out, float z0, float z1, int32_t type) {
+	if (!out.empty() && out.back().type == type && out.back().max_z == z0) {
+		out.back().max_z = z1;
+		return;
+	}
+
+	Span s;
+	s.min_z = z0;
+	s.max_z = z1;
+	s.type = type;
+	out.push_back(s);
+}
+
+void WaterMapColumns::BakeColumn(float x0, float y0, float x1, float y1, float z0, float z1, int depth, std::vector<Span> &out) const {
+	WaterRegionType type;
+	if (exact->BoxRegionType(glm::vec3(x0, y0, z0), glm::vec3(x1, y1, z1), type)) {
+		AddSpan(out, z0, z1, type);
+		return;
+	}
+
+	if (depth >= max_depth) {
+		AddSpan(out, z0, z1, WaterMapColumnsMixed);
+		return;
+	}
+
+	float mid = z0 + (z1 - z0) * 0.5f;
+	BakeColumn(x0, y0, x1, y1, z0, mid, depth + 1, out);
+	BakeColumn(x0, y0, x1, y1, mid, z1, depth + 1, out);
+}
+
+bool WaterMapColumns::Build(const glm::vec3 &min, const glm::vec3 &max, float size, EQEmu::ThreadPool *pool) {
+	Clear();
+	if (!exact || size <= 0.0f || !(min.x < max.x && min.y < max.y && min.z < max.z)) {
+		return false;
+	}
+
+	uint32_t nx = std::max(1u, (uint32_t)ceilf((max.x - min.x) / size));
+	uint32_t ny = std::max(1u, (uint32_t)ceilf((max.y - min.y) / size));
+	if ((uint64_t)nx * ny > WaterMapColumnsMaxCells) {
+		eqLogMessage(LogError, "Water column cell size %g is too small for this zone (%u x %u cells).", size, nx, ny);
+		return false;
+	}
+
+	bake_min = min;
+	bake_max = glm::vec3(min.x + nx * size, min.y + ny * size, max.z);
+	cell_size = size;
+	inv_cell_size = 1.0f / size;
+	cells_x = nx;
+	cells_y = ny;
+	tiles_x = (nx + WaterMapColumnsTileSize - 1) >> WaterMapColumnsTileBits;
+	tiles_y = (ny + WaterMapColumnsTileSize - 1) >> WaterMapColumnsTileBits;
+
+	max_depth = 0;
+	while (max_depth < WaterMapColumnsMaxDepth && (max.z - min.z) / (float)(1 << max_depth) > size) {
+		++max_depth;
+	}
+
+	//each tile bakes on its own, normal spans are dropped since a miss in a cell already means normal
+	uint32_t tile_count = tiles_x * tiles_y;
+	std::vector<std::vector<Span>> tile_spans(tile_count);
+	std::vector<std::vector<uint32_t>> tile_counts(tile_count);
+	auto bake_tiles = [&](size_t begin, size_t end) {
+		std::vector<Span> column;
+		for (size_t t = begin; t < end; ++t) {
+			uint32_t tx = (uint32_t)(t % tiles_x) << WaterMapColumnsTileBits;
+			uint32_t ty = (uint32_t)(t / tiles_x) << WaterMapColumnsTileBits;
+			auto &counts = tile_counts[t];
+			counts.resize(WaterMapColumnsTileCells, 0);
+			for (uint32_t c = 0; c < WaterMapColumnsTileCells; ++c) {
+				uint32_t cx = tx + (c & (WaterMapColumnsTileSize - 1));
+				uint32_t cy = ty + (c >> WaterMapColumnsTileBits);
+				if (cx >= cells_x || cy >= cells_y) {
+					continue;
+				}
+
+				//a little over the cell so a point that rounds onto the wrong side of a cell edge is still covered
+				float pad = cell_size * 0.01f;
+				float x0 = bake_min.x + (float)cx * cell_size - pad;
+				float y0 = bake_min.y + (float)cy * cell_size - pad;
+				column.clear();
+				BakeColumn(x0, y0, x0 + cell_size + pad * 2.0f, y0 + cell_size + pad * 2.0f, bake_min.z, bake_max.z, 0, column);
+				for (auto &s : column) {
+					if (s.type != RegionTypeNormal) {
+						tile_spans[t].push_back(s);
+						counts[c]++;
+					}
+				}
+			}
+		}
+	};
+
+	if (pool && pool->Size() > 1) {
+		pool->ParallelFor(tile_count, bake_tiles);
+	}
+	else {
+		bake_tiles(0, tile_count);
+	}
+
+	tile_slots.resize(tile_count, WaterMapColumnsEmptyTile);
+	uint32_t slot = 0;
+	for (uint32_t t = 0; t < tile_count; ++t) {
+		if (tile_spans[t].empty()) {
+			continue;
+		}
+
+		tile_slots[t] = slot++;
+		uint32_t first = (uint32_t)spans.size();
+		for (uint32_t c = 0; c < WaterMapColumnsTileCells; ++c) {
+			cell_offsets.push_back(first);
+			first += tile_counts[t][c];
+		}
+
+		spans.insert(spans.end(), tile_spans[t].begin(), tile_spans[t].end());
+		std::vector<Span>().swap(tile_spans[t]);
+	}
+
+	cell_offsets.push_back((uint32_t)spans.size());
+
+	if (!Verify(WaterMapColumnsVerifySamples)) {
+		Clear();
+		return false;
+	}
+
+	eqLogMessage(LogDebug, "Baked water columns: %u x %u cells, %u of %u tiles stored, %u spans.", cells_x, cells_y, slot, tile_count,
+		(uint32_t)spans.size());
+	return true;
+}
+
+//Half the samples anywhere in the area, half in cells that kept spans, on their edges and inside them, where a bad bake
+//would show
+bool WaterMapColumns::Verify(uint32_t samples) const {
+	std::vector<uint32_t> stored_tiles;
+	for (uint32_t t = 0; t < (uint32_t)tile_slots.size(); ++t) {
+		if (tile_slots[t] != WaterMapColumnsEmptyTile) {
+			stored_tiles.push_back(t);
+		}
+	}
+
+	std::mt19937 rng(0x57415452);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	uint32_t mismatches = 0;
+	uint32_t tested = 0;
+	for (uint32_t i = 0; i < samples; ++i) {
+		float x = bake_min.x + (bake_max.x - bake_min.x) * unit(rng);
+		float y = bake_min.y + (bake_max.y - bake_min.y) * unit(rng);
+		float z = bake_min.z + (bake_max.z - bake_min.z) * unit(rng);
+		if ((i & 1) && !stored_tiles.empty()) {
+			uint32_t t = stored_tiles[rng() % stored_tiles.size()];
+			uint32_t c = rng() % WaterMapColumnsTileCells;
+			uint32_t cx = std::min(((t % tiles_x) << WaterMapColumnsTileBits) + (c & (WaterMapColumnsTileSize - 1)), cells_x - 1);
+			uint32_t cy = std::min(((t / tiles_x) << WaterMapColumnsTileBits) + (c >> WaterMapColumnsTileBits), cells_y - 1);
+			x = std::min(bake_min.x + ((float)cx + unit(rng)) * cell_size, bake_max.x);
+			y = std::min(bake_min.y + ((float)cy + unit(rng)) * cell_size, bake_max.y);
+
+			uint32_t cell = tile_slots[t] * WaterMapColumnsTileCells + c;
+			uint32_t count = cell_offsets[cell + 1] - cell_offsets[cell];
+			if (count > 0) {
+				const Span &s = spans[cell_offsets[cell] + rng() % count];
+				uint32_t where = rng() % 3;
+				z = where == 0 ? s.min_z : where == 1 ? s.max_z : s.min_z + (s.max_z - s.min_z) * unit(rng);
+			}
+		}
+
+		WaterRegionType baked;
+		if (!Lookup(x, y, z, baked)) {
+			continue;
+		}
+
+		++tested;
+		if (baked != exact->ReturnRegionType(y, x, z)) {
+			++mismatches;
+		}
+	}
+
+	if (mismatches > 0) {
+		eqLogMessage(LogError, "Water column bake disagreed with the water map at %u of %u sampled points, not using it.", mismatches, tested);
+		return false;
+	}
+
+	return true;
+}
+
+bool WaterMapColumns::Lookup(float x, float y, float z, WaterRegionType &type) const {
+	//written so NaN fails too
+	if (tile_slots.empty() || !(x >= bake_min.x && y >= bake_min.y && z >= bake_min.z && x <= bake_max.x && y <= bake_max.y && z <= bake_max.z)) {
+		return false;
+	}
+
+	uint32_t cx = std::min((uint32_t)((x - bake_min.x) * inv_cell_size), cells_x - 1);
+	uint32_t cy = std::min((uint32_t)((y - bake_min.y) * inv_cell_size), cells_y - 1);
+	uint32_t slot = tile_slots[(cy >> WaterMapColumnsTileBits) * tiles_x + (cx >> WaterMapColumnsTileBits)];
+	if (slot == WaterMapColumnsEmptyTile) {
+		type = RegionTypeNormal;
+		return true;
+	}
+
+	uint32_t cell = slot * WaterMapColumnsTileCells + ((cy & (WaterMapColumnsTileSize - 1)) << WaterMapColumnsTileBits) + (cx & (WaterMapColumnsTileSize - 1));
+	for (uint32_t i = cell_offsets[cell]; i < cell_offsets[cell + 1]; ++i) {
+		const Span &s = spans[i];
+		if (z < s.min_z) {
+			break;
+		}
+
+		if (z <= s.max_z) {
+			if (s.type == WaterMapColumnsMixed) {
+				return false;
+			}
+
+			type = (WaterRegionType)s.type;
+			return true;
+		}
+	}
+
+	type = RegionTypeNormal;
+	return true;
+}
+
+WaterRegionType WaterMapColumns::ReturnRegionType(float y, float x, float z) const {
+	WaterRegionType type;
+	if (Lookup(x, y, z, type)) {
+		return type;
+	}
+
+	return exact ? exact->ReturnRegionType(y, x, z) : RegionTypeNormal;
+}
+
+//Whatever the bake can't answer is handed to the exact map as one batch
+void WaterMapColumns::ReturnRegionTypes(const glm::vec3 *points, size_t count, WaterRegionType *out) const {
+	std::vector<glm::vec3> misses;
+	std::vector<size_t> miss_index;
+	for (size_t i = 0; i < count; ++i) {
+		if (!Lookup(points[i].x, points[i].y, points[i].z, out[i])) {
+			misses.push_back(points[i]);
+			miss_index.push_back(i);
+		}
+	}
+
+	if (misses.empty()) {
+		return;
+	}
+
+	std::vector<WaterRegionType> types(misses.size(), RegionTypeNormal);
+	if (exact) {
+		exact->ReturnRegionTypes(&misses[0], misses.size(), &types[0]);
+	}
+
+	for (size_t i = 0; i < misses.size(); ++i) {
+		out[miss_index[i]] = types[i];
+	}
+}
+
+bool WaterMapColumns::InWater(float y, float x, float z) const {
+	return ReturnRegionType(y, x, z) == RegionTypeWater;
+}
+
+bool WaterMapColumns::InVWater(float y, float x, float z) const {
+	return ReturnRegionType(y, x, z) == RegionTypeVWater;
+}
+
+bool WaterMapColumns::InLava(float y, float x, float z) const {
+	return ReturnRegionType(y, x, z) == RegionTypeLava;
+}
+
+bool WaterMapColumns::InLiquid(float y, float x, float z) const {
+	WaterRegionType type = ReturnRegionType(y, x, z);
+	return type == RegionTypeWater || type == RegionTypeLava;
+}
+
+bool WaterMapColumns::BoxRegionType(const glm::vec3 &min, const glm::vec3 &max, WaterRegionType &type) const {
+	return exact ? exact->BoxRegionType(min, max, type) : false;
+}
+
+void WaterMapColumns::CreateMeshFrom(std::vector<glm::vec3> &verts, std::vector<unsigned int> &inds) {
+	if (exact) {
+		exact->CreateMeshFrom(verts, inds);
+	}
+}
+
+void WaterMapColumns::GetRegionDetails(std::vector<RegionDetails> &details) {
+	if (exact) {
+		exact->GetRegionDetails(details);
+	}
+}
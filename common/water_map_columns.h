@@ -0,0 +1,72 @@
+#ifndef EQEMU_COMMON_WATER_MAP_COLUMNS_H
+#define EQEMU_COMMON_WATER_MAP_COLUMNS_H
+
+#include "water_map.h"
+#include <memory>
+
+namespace EQEmu
+{
+	class ThreadPool;
+}
+
+//Region types baked into a 2.5D grid in front of another water map. Each x, y cell of the baked area keeps a short list
+//of z spans, lowest first, that the map it wraps proved to be one type all through with BoxRegionType; a query in such
+//a span is a cell fetch and a few compares, anything else, outside the area or in a span the bake couldn't prove,
+//still goes to the wrapped map so every answer is the same as its own. Cells are grouped in 16 x 16 tiles and a tile
+//that's normal all the way up takes no space. Until Build succeeds everything goes straight through.
+class WaterMapColumns : public WaterMap
+{
+public:
+	//Takes ownership of exact
+	WaterMapColumns(WaterMap *exact);
+	~WaterMapColumns();
+
+	//Bakes the box min to max, in the same x, y and z as ReturnRegionType, in cell_size squares. Columns are split
+	//in half in z until each part is one type or no taller than cell_size. Afterwards samples random points of the
+	//area against the wrapped map and throws the bake away on any disagreement.
+	bool Build(const glm::vec3 &min, const glm::vec3 &max, float cell_size, EQEmu::ThreadPool *pool = nullptr);
+	void Clear();
+	bool IsBuilt() const { return !tile_slots.empty(); }
+	WaterMap *GetExact() const { return exact.get(); }
+
+	virtual WaterRegionType ReturnRegionType(float y, float x, float z) const;
+	virtual void ReturnRegionTypes(const glm::vec3 *points, size_t count, WaterRegionType *out) const;
+	virtual bool InWater(float y, float x, float z) const;
+	virtual bool InVWater(float y, float x, float z) const;
+	virtual bool InLava(float y, float x, float z) const;
+	virtual bool InLiquid(float y, float x, float z) const;
+	virtual bool BoxRegionType(const glm::vec3 &min, const glm::vec3 &max, WaterRegionType &type) const;
+	virtual void CreateMeshFrom(std::vector<glm::vec3> &verts, std::vector<unsigned int> &inds);
+	virtual void GetRegionDetails(std::vector<RegionDetails> &details);
+private:
+	struct Span
+	{
+		float min_z;
+		float max_z;
+		int32_t type;
+	};
+
+	static void AddSpan(std::vector<Span> &out, float z0, float z1, int32_t type);
+	//false when the point has to be asked of the exact map
+	bool Lookup(float x, float y, float z, WaterRegionType &type) const;
+	void BakeColumn(float x0, float y0, float x1, float y1, float z0, float z1, int depth, std::vector<Span> &out) const;
+	bool Verify(uint32_t samples) const;
+
+	std::unique_ptr<WaterMap> exact;
+	glm::vec3 bake_min;
+	glm::vec3 bake_max;
+	float cell_size;
+	float inv_cell_size;
+	uint32_t cells_x;
+	uint32_t cells_y;
+	uint32_t tiles_x;
+	uint32_t tiles_y;
+	int max_depth;
+	//per tile an index into cell_offsets, or WaterMapColumnsEmptyTile for a tile with no spans at all
+	std::vector<uint32_t> tile_slots;
+	//spans of cell c of a stored tile are spans[cell_offsets[slot * 256 + c]] to the next cell's offset
+	std::vector<uint32_t> cell_offsets;
+	std::vector<Span> spans;
+};
+
+#endif
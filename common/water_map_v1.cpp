@@ -1,19 +1,19 @@
 #include "water_map_v1.h"
+#include <vector>
+#include <string.h>
+#include <math.h>
 
 WaterMapV1::WaterMapV1() {
-	BSP_Root = nullptr;
+	nodes = nullptr;
+	node_count = 0;
 }
 
 WaterMapV1::~WaterMapV1() {
-	if (BSP_Root) {
-		delete[] BSP_Root;
-	}
 }
 
 WaterRegionType WaterMapV1::ReturnRegionType(float y, float x, float z) const {
-	return BSPReturnRegionType(1, y, x, z);
+	return BSPReturnRegionType(y, x, z);
 }
-
 bool WaterMapV1::InWater(float y, float x, float z) const {
 	return ReturnRegionType(y, x, z) == RegionTypeWater;
 }
@@ -30,53 +30,174 @@ bool WaterMapV1::InLiquid(float y, float x, float z) const {
 	return InWater(y, x, z) || InLava(y, x, z);
 }
 
+//Every leaf the box reaches has to agree. Where the box touches or crosses a plane, with room to spare for the
+//rounding of a single point's plane test, it goes down both sides and, since a point on a plane is normal, the answer
+//can only be normal. Gives up as mixed after a fixed number of nodes.
+bool WaterMapV1::BoxRegionType(const glm::vec3 &min, const glm::vec3 &max, WaterRegionType &type) const {
+	if (!nodes) {
+		type = RegionTypeNormal;
+		return true;
+	}
+
+	glm::vec3 center = (min + max) * 0.5f;
+	glm::vec3 half = (max - min) * 0.5f;
+	glm::vec3 reach = glm::abs(center) + half;
+
+	const int max_stack = 64;
+	uint32_t stack[max_stack];
+	int top = 0;
+	int budget = 256;
+	bool found = false;
+	stack[top++] = node_count > 0 ? 1 : 0;
+	auto agree = [&](WaterRegionType t) {
+		if (!found) {
+			type = t;
+			found = true;
+		}
+
+		return type == t;
+	};
+
+	while (top > 0) {
+		if (--budget < 0) {
+			return false;
+		}
+
+		const WaterMapV1Node &node = nodes[stack[--top]];
+		if (node.leaf) {
+			if (!agree((WaterRegionType)node.special)) {
+				return false;
+			}
+			continue;
+		}
+
+		glm::vec3 n(node.normal[0], node.normal[1], node.normal[2]);
+		glm::vec3 abs_n = glm::abs(n);
+		float distance = glm::dot(center, n) + node.splitdistance;
+		float radius = glm::dot(half, abs_n);
+		float slack = (glm::dot(reach, abs_n) + fabsf(node.splitdistance)) * 1e-5f + 1e-4f;
+
+		if (distance - radius > slack) {
+			stack[top++] = node.child[0];
+		}
+		else if (distance + radius < -slack) {
+			stack[top++] = node.child[1];
+		}
+		else if (distance == distance && agree(RegionTypeNormal) && top + 2 <= max_stack) {
+			stack[top++] = node.child[0];
+			stack[top++] = node.child[1];
+		}
+		else {
+			return false;
+		}
+	}
+
+	return true;
+}
+
 bool WaterMapV1::Load(FILE *fp) {
 	uint32_t bsp_tree_size;
 	if (fread(&bsp_tree_size, sizeof(bsp_tree_size), 1, fp) != 1) {
 		return false;
 	}
 
-	BSP_Root = new ZBSP_Node[bsp_tree_size];
-	if (!BSP_Root) {
+	std::vector<ZBSP_Node> file_nodes(bsp_tree_size);
+	if (bsp_tree_size > 0 && fread(&file_nodes[0], sizeof(ZBSP_Node), bsp_tree_size, fp) != bsp_tree_size) {
 		return false;
 	}
 
-	if (fread(BSP_Root, sizeof(ZBSP_Node), bsp_tree_size, fp) != bsp_tree_size) {
-		return false;
+	//one extra for the normal leaf at 0, and room to start the array on a cache line
+	node_storage.reset(new char[(bsp_tree_size + 1) * sizeof(WaterMapV1Node) + 63]);
+	WaterMapV1Node *flat = (WaterMapV1Node*)(((uintptr_t)node_storage.get() + 63) & ~(uintptr_t)63);
+	memset(&flat[0], 0, sizeof(WaterMapV1Node));
+	flat[0].special = RegionTypeNormal;
+	flat[0].leaf = 1;
+
+	for (uint32_t i = 0; i < bsp_tree_size; ++i) {
+		auto &in = file_nodes[i];
+		auto &out = flat[i + 1];
+		out.normal[0] = in.normal[0];
+		out.normal[1] = in.normal[1];
+		out.normal[2] = in.normal[2];
+		out.splitdistance = in.splitdistance;
+		out.special = in.special;
+		out.leaf = in.left == 0 && in.right == 0 ? 1 : 0;
+
+		//children that don't exist end up on the normal leaf like a missing one
+		out.child[0] = in.left > 0 && (uint32_t)in.left <= bsp_tree_size ? in.left : 0;
+		out.child[1] = in.right > 0 && (uint32_t)in.right <= bsp_tree_size ? in.right : 0;
 	}
 
-	return true;
-}
+	//a walk has to end at a leaf, any child that leads back up its own path goes to the normal leaf instead
+	std::vector<uint8_t> state(bsp_tree_size + 1, 0);
+	std::vector<std::pair<uint32_t, int>> stack;
+	if (bsp_tree_size > 0) {
+		stack.push_back(std::make_pair(1u, 0));
+		state[1] = 1;
+	}
 
-WaterRegionType WaterMapV1::BSPReturnRegionType(int32_t node_number, float y, float x, float z) const {
-	float distance;
+	while (!stack.empty()) {
+		auto &top = stack.back();
+		WaterMapV1Node &node = flat[top.first];
+		if (node.leaf || top.second == 2) {
+			state[top.first] = 2;
+			stack.pop_back();
+			continue;
+		}
 
-	const ZBSP_Node *current_node = &BSP_Root[node_number - 1];
+		int32_t &child = node.child[top.second++];
+		if (child == 0 || state[child] == 2) {
+			continue;
+		}
 
-	if ((current_node->left == 0) &&
-		(current_node->right == 0)) {
-		return (WaterRegionType)current_node->special;
+		if (state[child] == 1) {
+			child = 0;
+			continue;
+		}
+
+		state[child] = 1;
+		stack.push_back(std::make_pair((uint32_t)child, 0));
 	}
 
-	distance = (x * current_node->normal[0]) +
-		(y * current_node->normal[1]) +
-		(z * current_node->normal[2]) +
-		current_node->splitdistance;
+	nodes = flat;
+	node_count = bsp_tree_size;
+	return true;
+}
 
-	if (distance == 0.0f) {
-		return(RegionTypeNormal);
+//A point exactly on a plane is normal, as is anything that runs off a missing child
+WaterRegionType WaterMapV1::BSPReturnRegionType(float y, float x, float z) const {
+	if (!nodes) {
+		return RegionTypeNormal;
 	}
 
-	if (distance >0.0f) {
-		if (current_node->left == 0) {
-			return(RegionTypeNormal);
+	uint32_t index = node_count > 0 ? 1 : 0;
+	for (;;) {
+		const WaterMapV1Node &node = nodes[index];
+		if (node.leaf) {
+			return (WaterRegionType)node.special;
+		}
+
+		float distance = (x * node.normal[0]) +
+			(y * node.normal[1]) +
+			(z * node.normal[2]) +
+			node.splitdistance;
+
+		if (distance == 0.0f) {
+			return RegionTypeNormal;
 		}
-		return BSPReturnRegionType(current_node->left, y, x, z);
-	}
 
-	if (current_node->right == 0) {
-		return(RegionTypeNormal);
+		//a real branch rather than a select, predicting it lets the next node load before the plane test finishes
+		if (distance > 0.0f) {
+			index = node.child[0];
+		}
+		else {
+			index = node.child[1];
+		}
 	}
+}
 
-	return BSPReturnRegionType(current_node->right, y, x, z);
+void WaterMapV1::ReturnRegionTypes(const glm::vec3 *points, size_t count, WaterRegionType *out) const {
+	for (size_t i = 0; i < count; ++i) {
+		out[i] = BSPReturnRegionType(points[i].y, points[i].x, points[i].z);
+	}
 }
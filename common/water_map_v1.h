@@ -2,6 +2,7 @@
 #define EQEMU_WATER_MAP_V1_H
 
 #include "water_map.h"
+#include <memory>
 
 #pragma pack(1)
 typedef struct ZBSP_Node {
@@ -13,6 +14,16 @@ typedef struct ZBSP_Node {
 } ZBSP_Node;
 #pragma pack()
 
+//ZBSP_Node as it's walked, two to a cache line. Index 0 is a leaf of RegionTypeNormal that every missing child
+//points at; file node n is index n. child[0] is taken in front of the plane, child[1] behind it or for NaN.
+struct WaterMapV1Node {
+	float normal[3];
+	float splitdistance;
+	int32_t child[2];
+	int32_t special;
+	int32_t leaf;
+};
+
 class WaterMapV1 : public WaterMap
 {
 public:
@@ -24,12 +35,16 @@ public:
 	virtual bool InVWater(float y, float x, float z) const;
 	virtual bool InLava(float y, float x, float z) const;
 	virtual bool InLiquid(float y, float x, float z) const;
+	virtual bool BoxRegionType(const glm::vec3 &min, const glm::vec3 &max, WaterRegionType &type) const;
+	virtual void ReturnRegionTypes(const glm::vec3 *points, size_t count, WaterRegionType *out) const;
 protected:
 	virtual bool Load(FILE *fp);
 
 private:
-	WaterRegionType BSPReturnRegionType(int32_t node_number, float y, float x, float z) const;
-	ZBSP_Node* BSP_Root;
+	WaterRegionType BSPReturnRegionType(float y, float x, float z) const;
+	std::unique_ptr<char[]> node_storage;
+	const WaterMapV1Node *nodes;
+	uint32_t node_count;
 
 	friend class WaterMap;
 };
@@ -1,22 +1,103 @@
 #include "water_map_v2.h"
+#include <math.h>
+#include <algorithm>
+#include <functional>
+#include <float.h>
 
-WaterMapV2::WaterMapV2() {
+WaterMapV2::WaterMapV2() : grid_inv_cell_size(0.0f), grid_cells_x(0), grid_cells_y(0) {
 }
 
 WaterMapV2::~WaterMapV2() {
 }
 
 WaterRegionType WaterMapV2::ReturnRegionType(float y, float x, float z) const {
-	size_t sz = regions.size();
-	for(size_t i = 0; i < sz; ++i) {
-		auto const &region = regions[i];
-		if (region.second.ContainsPoint(glm::vec3(x, y, z))) {
+	//written so NaN fails too
+	if (grid_offsets.empty() || !(x >= grid_min.x && y >= grid_min.y && z >= grid_min.z && x <= grid_max.x && y <= grid_max.y && z <= grid_max.z)) {
+		return RegionTypeNormal;
+	}
+
+	uint32_t cx = std::min((uint32_t)((x - grid_min.x) * grid_inv_cell_size), grid_cells_x - 1);
+	uint32_t cy = std::min((uint32_t)((y - grid_min.y) * grid_inv_cell_size), grid_cells_y - 1);
+	uint32_t cell = cy * grid_cells_x + cx;
+
+	glm::vec3 p(x, y, z);
+	for (uint32_t i = grid_offsets[cell]; i < grid_offsets[cell + 1]; ++i) {
+		uint32_t r = grid_regions[i];
+		const glm::vec3 &min = region_min[r];
+		const glm::vec3 &max = region_max[r];
+		if (p.x < min.x || p.y < min.y || p.z < min.z || p.x > max.x || p.y > max.y || p.z > max.z) {
+			continue;
+		}
+
+		auto const &region = regions[r];
+		if (region.second.ContainsPoint(p)) {
 			return region.first;
 		}
 	}
 	return RegionTypeNormal;
 }
 
+void WaterMapV2::ReturnRegionTypes(const glm::vec3 *points, size_t count, WaterRegionType *out) const {
+	for (size_t i = 0; i < count; ++i) {
+		out[i] = WaterMapV2::ReturnRegionType(points[i].y, points[i].x, points[i].z);
+	}
+}
+
+//First region in file order to reach into the box decides it: mixed unless the box, grown a little to cover the
+//rounding of ContainsPoint, has every corner inside that region, which being convex then holds all of it
+bool WaterMapV2::BoxRegionType(const glm::vec3 &min, const glm::vec3 &max, WaterRegionType &type) const {
+	if (!(min.x <= max.x && min.y <= max.y && min.z <= max.z)) {
+		return false;
+	}
+
+	type = RegionTypeNormal;
+	if (grid_offsets.empty() || min.x > grid_max.x || min.y > grid_max.y || min.z > grid_max.z ||
+		max.x < grid_min.x || max.y < grid_min.y || max.z < grid_min.z) {
+		return true;
+	}
+
+	glm::vec3 pad = (glm::abs(min) + glm::abs(max)) * 1e-5f + glm::vec3(0.01f);
+	glm::vec3 outer_min = min - pad;
+	glm::vec3 outer_max = max + pad;
+
+	//a box inside one grid cell only needs that cell's list, anything bigger looks at every region
+	uint32_t first = 0;
+	uint32_t last = (uint32_t)regions.size();
+	const uint32_t *list = nullptr;
+	uint32_t x0 = std::min((uint32_t)std::max((outer_min.x - grid_min.x) * grid_inv_cell_size, 0.0f), grid_cells_x - 1);
+	uint32_t y0 = std::min((uint32_t)std::max((outer_min.y - grid_min.y) * grid_inv_cell_size, 0.0f), grid_cells_y - 1);
+	uint32_t x1 = std::min((uint32_t)std::max((outer_max.x - grid_min.x) * grid_inv_cell_size, 0.0f), grid_cells_x - 1);
+	uint32_t y1 = std::min((uint32_t)std::max((outer_max.y - grid_min.y) * grid_inv_cell_size, 0.0f), grid_cells_y - 1);
+	if (x0 == x1 && y0 == y1) {
+		uint32_t cell = y0 * grid_cells_x + x0;
+		first = grid_offsets[cell];
+		last = grid_offsets[cell + 1];
+		list = &grid_regions[0];
+	}
+
+	for (uint32_t i = first; i < last; ++i) {
+		uint32_t r = list ? list[i] : i;
+		const glm::vec3 &rmin = region_min[r];
+		const glm::vec3 &rmax = region_max[r];
+		if (outer_min.x > rmax.x || outer_min.y > rmax.y || outer_min.z > rmax.z ||
+			outer_max.x < rmin.x || outer_max.y < rmin.y || outer_max.z < rmin.z) {
+			continue;
+		}
+
+		for (int c = 0; c < 8; ++c) {
+			glm::vec3 corner((c & 1) ? outer_max.x : outer_min.x, (c & 2) ? outer_max.y : outer_min.y, (c & 4) ? outer_max.z : outer_min.z);
+			if (!regions[r].second.ContainsPoint(corner)) {
+				return false;
+			}
+		}
+
+		type = regions[r].first;
+		return true;
+	}
+
+	return true;
+}
+
 bool WaterMapV2::InWater(float y, float x, float z) const {
 	return ReturnRegionType(y, x, z) == RegionTypeWater;
 }
@@ -30,7 +111,8 @@ bool WaterMapV2::InLava(float y, float x, float z) const {
 }
 
 bool WaterMapV2::InLiquid(float y, float x, float z) const {
-	return InWater(y, x, z) || InLava(y, x, z);
+	WaterRegionType type = ReturnRegionType(y, x, z);
+	return type == RegionTypeWater || type == RegionTypeLava;
 }
 
 bool WaterMapV2::Load(FILE *fp) {
@@ -110,9 +192,86 @@ bool WaterMapV2::Load(FILE *fp) {
 			OrientedBoundingBox(glm::vec3(x, y, z), glm::vec3(x_rot, y_rot, z_rot), glm::vec3(x_scale, y_scale, z_scale), glm::vec3(x_extent, y_extent, z_extent))));
 	}
 
+	BuildIndex();
 	return true;
 }
 
+void WaterMapV2::BuildIndex() {
+	region_min.clear();
+	region_max.clear();
+	grid_offsets.clear();
+	grid_regions.clear();
+	grid_cells_x = 0;
+	grid_cells_y = 0;
+	if (regions.empty()) {
+		return;
+	}
+
+	grid_min = glm::vec3(FLT_MAX);
+	grid_max = glm::vec3(-FLT_MAX);
+	for (auto &region : regions) {
+		auto &box = region.second;
+		glm::vec3 min(FLT_MAX);
+		glm::vec3 max(-FLT_MAX);
+		for (int c = 0; c < 8; ++c) {
+			glm::vec4 corner((c & 1) ? box.GetMaxX() : box.GetMinX(), (c & 2) ? box.GetMaxY() : box.GetMinY(), (c & 4) ? box.GetMaxZ() : box.GetMinZ(), 1.0f);
+			glm::vec3 v(box.GetTransformation() * corner);
+			min = glm::min(min, v);
+			max = glm::max(max, v);
+		}
+
+		//ContainsPoint goes through the inverse so its edges can land a hair outside these
+		glm::vec3 pad = (max - min) * 0.001f + glm::vec3(0.01f);
+		min -= pad;
+		max += pad;
+
+		region_min.push_back(min);
+		region_max.push_back(max);
+		grid_min = glm::min(grid_min, min);
+		grid_max = glm::max(grid_max, max);
+	}
+
+	//about one cell per region over the covered area, square cells
+	float width = std::max(grid_max.x - grid_min.x, 1.0f);
+	float height = std::max(grid_max.y - grid_min.y, 1.0f);
+	float cell_size = sqrtf(width * height / (float)regions.size());
+	cell_size = std::max(cell_size, std::max(width, height) / 256.0f);
+	grid_inv_cell_size = 1.0f / cell_size;
+	grid_cells_x = std::max(std::min((uint32_t)ceilf(width * grid_inv_cell_size), 256u), 1u);
+	grid_cells_y = std::max(std::min((uint32_t)ceilf(height * grid_inv_cell_size), 256u), 1u);
+
+	uint32_t cell_count = grid_cells_x * grid_cells_y;
+	std::vector<uint32_t> counts(cell_count + 1, 0);
+	auto for_cells = [&](uint32_t r, const std::function<void(uint32_t)> &fn) {
+		uint32_t x0 = std::min((uint32_t)((region_min[r].x - grid_min.x) * grid_inv_cell_size), grid_cells_x - 1);
+		uint32_t y0 = std::min((uint32_t)((region_min[r].y - grid_min.y) * grid_inv_cell_size), grid_cells_y - 1);
+		uint32_t x1 = std::min((uint32_t)((region_max[r].x - grid_min.x) * grid_inv_cell_size), grid_cells_x - 1);
+		uint32_t y1 = std::min((uint32_t)((region_max[r].y - grid_min.y) * grid_inv_cell_size), grid_cells_y - 1);
+		for (uint32_t cy = y0; cy <= y1; ++cy) {
+			for (uint32_t cx = x0; cx <= x1; ++cx) {
+				fn(cy * grid_cells_x + cx);
+			}
+		}
+	};
+
+	for (uint32_t r = 0; r < (uint32_t)regions.size(); ++r) {
+		for_cells(r, [&](uint32_t cell) { counts[cell + 1]++; });
+	}
+
+	grid_offsets.resize(cell_count + 1);
+	grid_offsets[0] = 0;
+	for (uint32_t i = 0; i < cell_count; ++i) {
+		grid_offsets[i + 1] = grid_offsets[i] + counts[i + 1];
+	}
+
+	//regions go in in file order so every cell's list stays sorted
+	grid_regions.resize(grid_offsets[cell_count]);
+	std::vector<uint32_t> fill(grid_offsets.begin(), grid_offsets.end() - 1);
+	for (uint32_t r = 0; r < (uint32_t)regions.size(); ++r) {
+		for_cells(r, [&](uint32_t cell) { grid_regions[fill[cell]++] = r; });
+	}
+}
+
 void WaterMapV2::CreateMeshFrom(std::vector<glm::vec3> &verts, std::vector<unsigned int> &inds) {
 	verts.clear();
 	inds.clear();
@@ -13,17 +13,32 @@ public:
 	~WaterMapV2();
 
 	virtual WaterRegionType ReturnRegionType(float y, float x, float z) const;
+	virtual void ReturnRegionTypes(const glm::vec3 *points, size_t count, WaterRegionType *out) const;
 	virtual bool InWater(float y, float x, float z) const;
 	virtual bool InVWater(float y, float x, float z) const;
 	virtual bool InLava(float y, float x, float z) const;
 	virtual bool InLiquid(float y, float x, float z) const;
+	virtual bool BoxRegionType(const glm::vec3 &min, const glm::vec3 &max, WaterRegionType &type) const;
 	virtual int Version() const { return 2; }
 	virtual void CreateMeshFrom(std::vector<glm::vec3> &verts, std::vector<unsigned int> &inds);
 	virtual void GetRegionDetails(std::vector<RegionDetails> &details);
 protected:
 	virtual bool Load(FILE *fp);
+	void BuildIndex();
 
 	std::vector<std::pair<WaterRegionType, OrientedBoundingBox>> regions;
+
+	//Uniform grid over x and y of the regions' world space bounds, each cell lists the regions overlapping it in file
+	//order so the first one containing a point is still the one returned
+	std::vector<glm::vec3> region_min;
+	std::vector<glm::vec3> region_max;
+	glm::vec3 grid_min;
+	glm::vec3 grid_max;
+	float grid_inv_cell_size;
+	uint32_t grid_cells_x;
+	uint32_t grid_cells_y;
+	std::vector<uint32_t> grid_offsets;
+	std::vector<uint32_t> grid_regions;
 	friend class WaterMap;
 };
 
@@ -3,10 +3,13 @@
 #include <map>
 #include <locale>
 #include <algorithm>
+#include <mutex>
+#include <string.h>
 
 #include <zlib.h>
 
 #include "zone_map.h"
+#include "memory_mapped_file.h"
 #include "config.h"
 
 uint32_t InflateData(const char* buffer, uint32_t len, char* out_buffer, uint32_t out_len_max) {
@@ -54,6 +57,36 @@ struct ZoneMap::impl
 	std::vector<unsigned int> nc_inds;
 	glm::vec3 nc_min;
 	glm::vec3 nc_max;
+
+	uint32_t version;
+	std::string filename;
+
+	//v3 maps are used in place, everything below points into the mapping
+	MemoryMappedFile mapping;
+	const EQEmu::map_v3_header *header;
+	const glm::vec3 *v3_verts;
+	uint32_t v3_vert_count;
+	const uint32_t *v3_inds;
+	uint32_t v3_ind_count;
+	const glm::vec3 *v3_nc_verts;
+	uint32_t v3_nc_vert_count;
+	const uint32_t *v3_nc_inds;
+	uint32_t v3_nc_ind_count;
+	const EQEmu::map_v3_tile *v3_tiles;
+	uint32_t v3_tile_count;
+	const EQEmu::map_v3_model *v3_models;
+	uint32_t v3_model_count;
+	const glm::vec3 *v3_model_verts;
+	uint32_t v3_model_vert_count;
+	const EQEmu::map_v3_poly *v3_model_polys;
+	uint32_t v3_model_poly_count;
+	const EQEmu::map_v3_instance *v3_instances;
+	uint32_t v3_instance_count;
+	const char *v3_strings;
+	uint32_t v3_string_size;
+
+	//the vector accessors need the instances expanded, that's only done if someone asks for them
+	std::once_flag flatten_once;
 };
 
 ZoneMap::ZoneMap() {
@@ -63,6 +96,28 @@ ZoneMap::ZoneMap() {
 	imp->max = glm::vec3(0.0f);
 	imp->nc_min = glm::vec3(0.0f);
 	imp->nc_max = glm::vec3(0.0f);
+	imp->version = 0;
+	imp->header = nullptr;
+	imp->v3_verts = nullptr;
+	imp->v3_vert_count = 0;
+	imp->v3_inds = nullptr;
+	imp->v3_ind_count = 0;
+	imp->v3_nc_verts = nullptr;
+	imp->v3_nc_vert_count = 0;
+	imp->v3_nc_inds = nullptr;
+	imp->v3_nc_ind_count = 0;
+	imp->v3_tiles = nullptr;
+	imp->v3_tile_count = 0;
+	imp->v3_models = nullptr;
+	imp->v3_model_count = 0;
+	imp->v3_model_verts = nullptr;
+	imp->v3_model_vert_count = 0;
+	imp->v3_model_polys = nullptr;
+	imp->v3_model_poly_count = 0;
+	imp->v3_instances = nullptr;
+	imp->v3_instance_count = 0;
+	imp->v3_strings = nullptr;
+	imp->v3_string_size = 0;
 }
 
 ZoneMap::~ZoneMap() {
@@ -85,6 +140,7 @@ ZoneMap *ZoneMap::LoadMapFile(std::string file) {
 }
 
 bool ZoneMap::Load(std::string filename) {
+	imp->filename = filename;
 	FILE *f = fopen(filename.c_str(), "rb");
 	if(f) {
 		uint32_t version;
@@ -96,10 +152,17 @@ bool ZoneMap::Load(std::string filename) {
 		if(version == 0x01000000) {
 			bool v = LoadV1(f);
 			fclose(f);
+			imp->version = 1;
 			return v;
 		} else if(version == 0x02000000) {
 			bool v = LoadV2(f);
 			fclose(f);
+			imp->version = 2;
+			return v;
+		} else if(version == EQEmu::MapV3Version) {
+			fclose(f);
+			bool v = LoadV3(filename);
+			imp->version = 3;
 			return v;
 		} else {
 			fclose(f);
@@ -831,11 +894,227 @@ bool ZoneMap::LoadV2(FILE *f) {
 	return true;
 }
 
+static bool ValidateMapV3Indices(const uint32_t *inds, uint32_t ind_count, uint32_t vert_count) {
+	if (ind_count % 3 != 0) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < ind_count; ++i) {
+		if (inds[i] >= vert_count) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool ZoneMap::LoadV3(const std::string &filename) {
+	if (!imp->mapping.Open(filename)) {
+		return false;
+	}
+
+	const char *data = imp->mapping.GetData();
+	uint64_t size = imp->mapping.GetSize();
+	if (size < sizeof(EQEmu::map_v3_header)) {
+		return false;
+	}
+
+	auto header = (const EQEmu::map_v3_header*)data;
+	if (memcmp(header->magic, MAP_V3_MAGIC, sizeof(header->magic)) != 0 ||
+		header->header_size != sizeof(EQEmu::map_v3_header) ||
+		header->file_size != size) {
+		return false;
+	}
+
+	if (header->section_table_offset > size ||
+		(size - header->section_table_offset) / sizeof(EQEmu::map_v3_section) < header->section_count) {
+		return false;
+	}
+
+	auto sections = (const EQEmu::map_v3_section*)(data + header->section_table_offset);
+	for (uint32_t i = 0; i < header->section_count; ++i) {
+		auto &section = sections[i];
+		if (section.offset % EQEmu::MapV3Alignment != 0 || section.offset > size || section.size > size - section.offset) {
+			return false;
+		}
+
+		if (section.element_size == 0 || section.size / section.element_size != section.count || section.size % section.element_size != 0 || section.count > 0xFFFFFFFFULL) {
+			return false;
+		}
+
+		uint32_t expected_size = 0;
+		switch (section.type) {
+		case EQEmu::MapV3SectionCollideVerts:
+		case EQEmu::MapV3SectionNonCollideVerts:
+		case EQEmu::MapV3SectionModelVerts:
+			expected_size = sizeof(glm::vec3);
+			break;
+		case EQEmu::MapV3SectionCollideIndices:
+		case EQEmu::MapV3SectionNonCollideIndices:
+			expected_size = sizeof(uint32_t);
+			break;
+		case EQEmu::MapV3SectionTiles:
+			expected_size = sizeof(EQEmu::map_v3_tile);
+			break;
+		case EQEmu::MapV3SectionModels:
+			expected_size = sizeof(EQEmu::map_v3_model);
+			break;
+		case EQEmu::MapV3SectionModelPolys:
+			expected_size = sizeof(EQEmu::map_v3_poly);
+			break;
+		case EQEmu::MapV3SectionInstances:
+			expected_size = sizeof(EQEmu::map_v3_instance);
+			break;
+		case EQEmu::MapV3SectionStrings:
+			expected_size = sizeof(char);
+			break;
+		default:
+			//sections this reader doesn't know about are skipped
+			continue;
+		}
+
+		if (section.element_size != expected_size) {
+			return false;
+		}
+
+		const void *ptr = section.count > 0 ? data + section.offset : nullptr;
+		uint32_t count = (uint32_t)section.count;
+		switch (section.type) {
+		case EQEmu::MapV3SectionCollideVerts:
+			imp->v3_verts = (const glm::vec3*)ptr;
+			imp->v3_vert_count = count;
+			break;
+		case EQEmu::MapV3SectionCollideIndices:
+			imp->v3_inds = (const uint32_t*)ptr;
+			imp->v3_ind_count = count;
+			break;
+		case EQEmu::MapV3SectionNonCollideVerts:
+			imp->v3_nc_verts = (const glm::vec3*)ptr;
+			imp->v3_nc_vert_count = count;
+			break;
+		case EQEmu::MapV3SectionNonCollideIndices:
+			imp->v3_nc_inds = (const uint32_t*)ptr;
+			imp->v3_nc_ind_count = count;
+			break;
+		case EQEmu::MapV3SectionTiles:
+			imp->v3_tiles = (const EQEmu::map_v3_tile*)ptr;
+			imp->v3_tile_count = count;
+			break;
+		case EQEmu::MapV3SectionModels:
+			imp->v3_models = (const EQEmu::map_v3_model*)ptr;
+			imp->v3_model_count = count;
+			break;
+		case EQEmu::MapV3SectionModelVerts:
+			imp->v3_model_verts = (const glm::vec3*)ptr;
+			imp->v3_model_vert_count = count;
+			break;
+		case EQEmu::MapV3SectionModelPolys:
+			imp->v3_model_polys = (const EQEmu::map_v3_poly*)ptr;
+			imp->v3_model_poly_count = count;
+			break;
+		case EQEmu::MapV3SectionInstances:
+			imp->v3_instances = (const EQEmu::map_v3_instance*)ptr;
+			imp->v3_instance_count = count;
+			break;
+		case EQEmu::MapV3SectionStrings:
+			imp->v3_strings = (const char*)ptr;
+			imp->v3_string_size = count;
+			break;
+		}
+	}
+
+	if (!ValidateMapV3Indices(imp->v3_inds, imp->v3_ind_count, imp->v3_vert_count) ||
+		!ValidateMapV3Indices(imp->v3_nc_inds, imp->v3_nc_ind_count, imp->v3_nc_vert_count)) {
+		return false;
+	}
+
+	if ((uint64_t)header->tile_count_x * header->tile_count_z != imp->v3_tile_count) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < imp->v3_tile_count; ++i) {
+		auto &tile = imp->v3_tiles[i];
+		if (tile.first_index % 3 != 0 || tile.index_count % 3 != 0 || tile.first_index > imp->v3_ind_count ||
+			tile.index_count > imp->v3_ind_count - tile.first_index) {
+			return false;
+		}
+	}
+
+	for (uint32_t i = 0; i < imp->v3_model_count; ++i) {
+		auto &model = imp->v3_models[i];
+		if (model.name_offset > imp->v3_string_size || model.name_length >= imp->v3_string_size - model.name_offset ||
+			imp->v3_strings[model.name_offset + model.name_length] != 0) {
+			return false;
+		}
+
+		if (model.first_vert > imp->v3_model_vert_count || model.vert_count > imp->v3_model_vert_count - model.first_vert ||
+			model.first_poly > imp->v3_model_poly_count || model.poly_count > imp->v3_model_poly_count - model.first_poly ||
+			model.collide_poly_count > model.poly_count) {
+			return false;
+		}
+
+		for (uint32_t j = 0; j < model.poly_count; ++j) {
+			auto &poly = imp->v3_model_polys[model.first_poly + j];
+			if (poly.v1 >= model.vert_count || poly.v2 >= model.vert_count || poly.v3 >= model.vert_count) {
+				return false;
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < imp->v3_instance_count; ++i) {
+		if (imp->v3_instances[i].model >= imp->v3_model_count) {
+			return false;
+		}
+	}
+
+	imp->header = header;
+	imp->min = glm::vec3(header->collide_min[0], header->collide_min[1], header->collide_min[2]);
+	imp->max = glm::vec3(header->collide_max[0], header->collide_max[1], header->collide_max[2]);
+	imp->nc_min = glm::vec3(header->non_collide_min[0], header->non_collide_min[1], header->non_collide_min[2]);
+	imp->nc_max = glm::vec3(header->non_collide_max[0], header->non_collide_max[1], header->non_collide_max[2]);
+	return true;
+}
+
+void ZoneMap::FlattenV3() const {
+	if (imp->version != 3) {
+		return;
+	}
+
+	std::call_once(imp->flatten_once, [this]() {
+		imp->verts.assign(imp->v3_verts, imp->v3_verts + imp->v3_vert_count);
+		imp->inds.assign(imp->v3_inds, imp->v3_inds + imp->v3_ind_count);
+		imp->nc_verts.assign(imp->v3_nc_verts, imp->v3_nc_verts + imp->v3_nc_vert_count);
+		imp->nc_inds.assign(imp->v3_nc_inds, imp->v3_nc_inds + imp->v3_nc_ind_count);
+
+		for (uint32_t i = 0; i < imp->v3_instance_count; ++i) {
+			auto &inst = imp->v3_instances[i];
+			auto &model = imp->v3_models[inst.model];
+			const float *t = inst.transform;
+			for (uint32_t j = 0; j < model.poly_count; ++j) {
+				auto &poly = imp->v3_model_polys[model.first_poly + j];
+				auto &verts = j < model.collide_poly_count ? imp->verts : imp->nc_verts;
+				auto &inds = j < model.collide_poly_count ? imp->inds : imp->nc_inds;
+
+				uint32_t poly_verts[3] = { poly.v1, poly.v2, poly.v3 };
+				for (int k = 0; k < 3; ++k) {
+					const glm::vec3 &m = imp->v3_model_verts[model.first_vert + poly_verts[k]];
+					inds.push_back((uint32_t)verts.size());
+					verts.push_back(glm::vec3(t[0] * m.x + t[1] * m.y + t[2] * m.z + t[3],
+						t[4] * m.x + t[5] * m.y + t[6] * m.z + t[7],
+						t[8] * m.x + t[9] * m.y + t[10] * m.z + t[11]));
+				}
+			}
+		}
+	});
+}
+
 const std::vector<glm::vec3>& ZoneMap::GetCollidableVerts() const {
+	FlattenV3();
 	return imp->verts;
 }
 
 const std::vector<unsigned int>& ZoneMap::GetCollidableInds() const {
+	FlattenV3();
 	return imp->inds;
 }
 
@@ -848,10 +1127,12 @@ const glm::vec3& ZoneMap::GetCollidableMin() const {
 }
 
 const std::vector<glm::vec3>& ZoneMap::GetNonCollidableVerts() const {
+	FlattenV3();
 	return imp->nc_verts;
 }
 
 const std::vector<unsigned int>& ZoneMap::GetNonCollidableInds() const {
+	FlattenV3();
 	return imp->nc_inds;
 }
 
@@ -863,6 +1144,159 @@ const glm::vec3& ZoneMap::GetNonCollidableMin() const {
 	return imp->nc_min;
 }
 
+//The map filename with its extension swapped for ext
+static std::string SidecarFilename(const std::string &filename, const char *ext) {
+	if (filename.empty()) {
+		return "";
+	}
+
+	size_t dot = filename.find_last_of('.');
+	size_t slash = filename.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+		return filename + ext;
+	}
+
+	return filename.substr(0, dot) + ext;
+}
+
+std::string ZoneMap::GetBvhFilename() const {
+	return SidecarFilename(imp->filename, ".bvh");
+}
+
+std::string ZoneMap::GetFloorMapFilename() const {
+	return SidecarFilename(imp->filename, ".flr");
+}
+
+uint32_t ZoneMap::GetVersion() const {
+	return imp->version;
+}
+
+ZoneMapMeshView ZoneMap::GetCollidableMesh() const {
+	if (imp->version == 3 && imp->v3_instance_count == 0) {
+		return GetStaticCollidableMesh();
+	}
+
+	FlattenV3();
+	ZoneMapMeshView view;
+	view.verts = imp->verts.data();
+	view.vert_count = (uint32_t)imp->verts.size();
+	view.inds = imp->inds.data();
+	view.tri_count = (uint32_t)imp->inds.size() / 3;
+	return view;
+}
+
+ZoneMapMeshView ZoneMap::GetNonCollidableMesh() const {
+	if (imp->version == 3 && imp->v3_instance_count == 0) {
+		return GetStaticNonCollidableMesh();
+	}
+
+	FlattenV3();
+	ZoneMapMeshView view;
+	view.verts = imp->nc_verts.data();
+	view.vert_count = (uint32_t)imp->nc_verts.size();
+	view.inds = imp->nc_inds.data();
+	view.tri_count = (uint32_t)imp->nc_inds.size() / 3;
+	return view;
+}
+
+ZoneMapMeshView ZoneMap::GetStaticCollidableMesh() const {
+	ZoneMapMeshView view;
+	if (imp->version == 3) {
+		view.verts = imp->v3_verts;
+		view.vert_count = imp->v3_vert_count;
+		view.inds = imp->v3_inds;
+		view.tri_count = imp->v3_ind_count / 3;
+	}
+	else {
+		view.verts = imp->verts.data();
+		view.vert_count = (uint32_t)imp->verts.size();
+		view.inds = imp->inds.data();
+		view.tri_count = (uint32_t)imp->inds.size() / 3;
+	}
+
+	return view;
+}
+
+ZoneMapMeshView ZoneMap::GetStaticNonCollidableMesh() const {
+	ZoneMapMeshView view;
+	if (imp->version == 3) {
+		view.verts = imp->v3_nc_verts;
+		view.vert_count = imp->v3_nc_vert_count;
+		view.inds = imp->v3_nc_inds;
+		view.tri_count = imp->v3_nc_ind_count / 3;
+	}
+	else {
+		view.verts = imp->nc_verts.data();
+		view.vert_count = (uint32_t)imp->nc_verts.size();
+		view.inds = imp->nc_inds.data();
+		view.tri_count = (uint32_t)imp->nc_inds.size() / 3;
+	}
+
+	return view;
+}
+
+uint32_t ZoneMap::GetModelCount() const {
+	return imp->v3_model_count;
+}
+
+std::string ZoneMap::GetModelName(uint32_t model) const {
+	if (model >= imp->v3_model_count) {
+		return "";
+	}
+
+	auto &m = imp->v3_models[model];
+	return std::string(imp->v3_strings + m.name_offset, m.name_length);
+}
+
+ZoneMapMeshView ZoneMap::GetModelMesh(uint32_t model, bool collidable) const {
+	ZoneMapMeshView view;
+	if (model >= imp->v3_model_count) {
+		return view;
+	}
+
+	auto &m = imp->v3_models[model];
+	uint32_t first_poly = collidable ? m.first_poly : m.first_poly + m.collide_poly_count;
+	view.verts = imp->v3_model_verts + m.first_vert;
+	view.vert_count = m.vert_count;
+	view.tri_count = collidable ? m.collide_poly_count : m.poly_count - m.collide_poly_count;
+	view.inds = view.tri_count > 0 ? &imp->v3_model_polys[first_poly].v1 : nullptr;
+	view.index_stride = sizeof(EQEmu::map_v3_poly);
+	return view;
+}
+
+uint32_t ZoneMap::GetInstanceCount() const {
+	return imp->v3_instance_count;
+}
+
+bool ZoneMap::GetInstance(uint32_t instance, uint32_t &model, glm::mat4 &transform) const {
+	if (instance >= imp->v3_instance_count) {
+		return false;
+	}
+
+	auto &inst = imp->v3_instances[instance];
+	model = inst.model;
+	transform = glm::mat4(1.0f);
+	for (int r = 0; r < 3; ++r) {
+		for (int c = 0; c < 4; ++c) {
+			transform[c][r] = inst.transform[r * 4 + c];
+		}
+	}
+
+	return true;
+}
+
+uint32_t ZoneMap::GetTileCount() const {
+	return imp->v3_tile_count;
+}
+
+const EQEmu::map_v3_tile *ZoneMap::GetTiles() const {
+	return imp->v3_tiles;
+}
+
+const EQEmu::map_v3_header *ZoneMap::GetV3Header() const {
+	return imp->header;
+}
+
 void ZoneMap::RotateVertex(glm::vec3 &v, float rx, float ry, float rz) {
 	glm::vec3 nv = v;
 
@@ -2,8 +2,22 @@
 #define EQEMU_COMMON_ZONE_MAP_H
 
 #include <vector>
+#include <string>
 
 #include "eq_physics.h"
+#include "zone_map_structs.h"
+
+//Non owning view of an indexed triangle mesh, index_stride is the byte distance between triangles
+struct ZoneMapMeshView
+{
+	ZoneMapMeshView() : verts(nullptr), vert_count(0), inds(nullptr), tri_count(0), index_stride(sizeof(uint32_t) * 3) { }
+
+	const glm::vec3 *verts;
+	uint32_t vert_count;
+	const uint32_t *inds;
+	uint32_t tri_count;
+	uint32_t index_stride;
+};
 
 class ZoneMap
 {
@@ -23,12 +37,41 @@ public:
 	const std::vector<unsigned int>& GetNonCollidableInds() const;
 	const glm::vec3& GetNonCollidableMax() const;
 	const glm::vec3& GetNonCollidableMin() const;
+
+	uint32_t GetVersion() const;
+
+	//Where azone puts the baked physics BVHs for this map, the map filename with a .bvh extension
+	std::string GetBvhFilename() const;
+	//Where azone puts the baked floor map, the map filename with a .flr extension
+	std::string GetFloorMapFilename() const;
+
+	//All of the geometry in map space, the same triangles as the vector accessors. Points into the mapped file
+	//when a v3 map has nothing to expand, otherwise at the vectors; either way valid as long as the ZoneMap is.
+	ZoneMapMeshView GetCollidableMesh() const;
+	ZoneMapMeshView GetNonCollidableMesh() const;
+
+	//Geometry stored already in map space. For v1 and v2 maps this is everything; v3 maps keep placed
+	//models separate and these views point straight into the mapped file.
+	ZoneMapMeshView GetStaticCollidableMesh() const;
+	ZoneMapMeshView GetStaticNonCollidableMesh() const;
+
+	uint32_t GetModelCount() const;
+	std::string GetModelName(uint32_t model) const;
+	ZoneMapMeshView GetModelMesh(uint32_t model, bool collidable) const;
+	uint32_t GetInstanceCount() const;
+	bool GetInstance(uint32_t instance, uint32_t &model, glm::mat4 &transform) const;
+
+	uint32_t GetTileCount() const;
+	const EQEmu::map_v3_tile *GetTiles() const;
+	const EQEmu::map_v3_header *GetV3Header() const;
 private:
 	void RotateVertex(glm::vec3 &v, float rx, float ry, float rz);
 	void ScaleVertex(glm::vec3 &v, float sx, float sy, float sz);
 	void TranslateVertex(glm::vec3 &v, float tx, float ty, float tz);
 	bool LoadV1(FILE *f);
 	bool LoadV2(FILE *f);
+	bool LoadV3(const std::string &filename);
+	void FlattenV3() const;
 	
 	struct impl;
 	impl *imp;
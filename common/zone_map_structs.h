@@ -0,0 +1,124 @@
+#ifndef EQEMU_COMMON_ZONE_MAP_STRUCTS_H
+#define EQEMU_COMMON_ZONE_MAP_STRUCTS_H
+
+#include <stdint.h>
+
+//Version 3 .map layout.
+//The file is meant to be memory mapped and used in place: a fixed header, a section table and then each
+//section starting on a 64 byte boundary. All geometry is already in the y-up space ZoneMap hands out so
+//nothing needs to be transformed or inflated at load.
+
+#pragma pack(1)
+
+namespace EQEmu
+{
+
+#define MAP_V3_MAGIC "EQEMUMAP"
+const uint32_t MapV3Version = 0x03000000;
+const uint32_t MapV3Alignment = 64;
+
+enum MapV3SectionType
+{
+	MapV3SectionCollideVerts = 1,
+	MapV3SectionCollideIndices = 2,
+	MapV3SectionNonCollideVerts = 3,
+	MapV3SectionNonCollideIndices = 4,
+	MapV3SectionTiles = 5,
+	MapV3SectionModels = 6,
+	MapV3SectionModelVerts = 7,
+	MapV3SectionModelPolys = 8,
+	MapV3SectionInstances = 9,
+	MapV3SectionStrings = 10
+};
+
+enum MapV3PolyFlags
+{
+	MapV3PolyCollidable = 1
+};
+
+//version is first so ZoneMap::Load can dispatch on it the same way as v1 and v2
+struct map_v3_header
+{
+	uint32_t version;
+	char magic[8];
+	uint32_t header_size;
+	uint32_t section_count;
+	uint32_t flags;
+	uint64_t section_table_offset;
+	uint64_t file_size;
+	float collide_min[3];
+	float collide_max[3];
+	float non_collide_min[3];
+	float non_collide_max[3];
+	float tile_size;
+	uint32_t tile_count_x;
+	uint32_t tile_count_z;
+	float tile_origin_x;
+	float tile_origin_z;
+	uint32_t reserved[5];
+};
+
+struct map_v3_section
+{
+	uint32_t type;
+	uint32_t element_size;
+	uint64_t offset;
+	uint64_t count;
+	uint64_t size;
+};
+
+//a tile owns a contiguous range of the collide index section, tiles are stored row major by z then x
+struct map_v3_tile
+{
+	uint32_t first_index;
+	uint32_t index_count;
+	float min[3];
+	float max[3];
+};
+
+//model verts are in model space, polys are sorted so the collidable ones come first
+struct map_v3_model
+{
+	uint32_t name_offset;
+	uint32_t name_length;
+	uint32_t first_vert;
+	uint32_t vert_count;
+	uint32_t first_poly;
+	uint32_t collide_poly_count;
+	uint32_t poly_count;
+	uint32_t reserved0;
+	float min[3];
+	float max[3];
+	uint32_t reserved1[2];
+};
+
+//poly indices are relative to the model's first vert
+struct map_v3_poly
+{
+	uint32_t v1;
+	uint32_t v2;
+	uint32_t v3;
+	uint32_t flags;
+};
+
+//transform is a row major 3x4 matrix taking model space straight to map space
+struct map_v3_instance
+{
+	uint32_t model;
+	uint32_t flags;
+	float transform[12];
+	uint32_t reserved[2];
+};
+
+}
+
+#pragma pack()
+
+static_assert(sizeof(EQEmu::map_v3_header) == 128, "map_v3_header must stay 128 bytes");
+static_assert(sizeof(EQEmu::map_v3_section) == 32, "map_v3_section must stay 32 bytes");
+static_assert(sizeof(EQEmu::map_v3_tile) == 32, "map_v3_tile must stay 32 bytes");
+static_assert(sizeof(EQEmu::map_v3_model) == 64, "map_v3_model must stay 64 bytes");
+static_assert(sizeof(EQEmu::map_v3_poly) == 16, "map_v3_poly must stay 16 bytes");
+static_assert(sizeof(EQEmu::map_v3_instance) == 64, "map_v3_instance must stay 64 bytes");
+
+#endif
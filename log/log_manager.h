@@ -4,6 +4,7 @@
 #include "log_base.h"
 #include <vector>
 #include <memory>
+#include <mutex>
 
 namespace EQEmu
 {
@@ -28,6 +29,7 @@ private:
 	
 	int enabled_logs;
 	std::vector<std::shared_ptr<LogBase>> logs;
+	std::mutex logs_lock;
 };
 
 }
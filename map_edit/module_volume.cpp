@@ -581,69 +581,55 @@ void ModuleVolume::BuildFromWatermap(const glm::vec3 &pos)
 		return;
 	}
 	
-	glm::vec3 new_region_min = pos;
-	glm::vec3 new_region_max = pos;
-	
-	//X+
+	//How far from pos along dir the region type first changes, to within step_size and no further than limit. The
+	//stride doubles until it lands on another type then the gap is halved, so it's a few dozen queries rather than one
+	//per step; a sliver of another type thinner than the stride it was passed over at isn't seen.
 	const float step_size = 0.1f;
-	for (float x = pos.x; x < 30000.0f; x += step_size) {
-		auto temp_region_type = physics->ReturnRegionType(glm::vec3(x, pos.y, pos.z));
-		if (temp_region_type != region_type) {
-			break;
+	auto find_extent = [&](const glm::vec3 &dir, float limit) {
+		if (limit <= 0.0f) {
+			return 0.0f;
 		}
-	
-		new_region_max.x += step_size;
-	}
-	
-	//X-
-	for (float x = pos.x; x > -30000.0f; x -= step_size) {
-		auto temp_region_type = physics->ReturnRegionType(glm::vec3(x, pos.y, pos.z));
-		if (temp_region_type != region_type) {
-			break;
-		}
-	
-		new_region_min.x -= step_size;
-	}
-	
-	//Y+
-	for (float y = pos.y; y < 30000.0f; y += step_size) {
-		auto temp_region_type = physics->ReturnRegionType(glm::vec3(pos.x, y, pos.z));
-		if (temp_region_type != region_type) {
-			break;
-		}
-	
-		new_region_max.y += step_size;
-	}
-	
-	//Y-
-	for (float y = pos.y; y > -30000.0f; y -= step_size) {
-		auto temp_region_type = physics->ReturnRegionType(glm::vec3(pos.x, y, pos.z));
-		if (temp_region_type != region_type) {
-			break;
-		}
-	
-		new_region_min.y -= step_size;
-	}
-	
-	//Z+
-	for (float z = pos.z; z < 30000.0f; z += step_size) {
-		auto temp_region_type = physics->ReturnRegionType(glm::vec3(pos.x, pos.y, z));
-		if (temp_region_type != region_type) {
-			break;
+
+		float lo = 0.0f;
+		float hi = step_size;
+		for (;;) {
+			if (hi >= limit) {
+				hi = limit;
+				if (physics->ReturnRegionType(pos + dir * hi) == region_type) {
+					return limit;
+				}
+				break;
+			}
+
+			if (physics->ReturnRegionType(pos + dir * hi) != region_type) {
+				break;
+			}
+
+			lo = hi;
+			hi *= 2.0f;
 		}
-	
-		new_region_max.z += step_size;
-	}
-	
-	//Z-
-	for (float z = pos.z; z > -30000.0f; z -= step_size) {
-		auto temp_region_type = physics->ReturnRegionType(glm::vec3(pos.x, pos.y, z));
-		if (temp_region_type != region_type) {
-			break;
+
+		while (hi - lo > step_size) {
+			float mid = (lo + hi) * 0.5f;
+			if (physics->ReturnRegionType(pos + dir * mid) == region_type) {
+				lo = mid;
+			}
+			else {
+				hi = mid;
+			}
 		}
-	
-		new_region_min.z -= step_size;
-	}
+
+		return hi;
+	};
+
+	glm::vec3 new_region_min = pos;
+	glm::vec3 new_region_max = pos;
+	new_region_max.x += find_extent(glm::vec3(1.0f, 0.0f, 0.0f), 30000.0f - pos.x);
+	new_region_min.x -= find_extent(glm::vec3(-1.0f, 0.0f, 0.0f), pos.x + 30000.0f);
+	new_region_max.y += find_extent(glm::vec3(0.0f, 1.0f, 0.0f), 30000.0f - pos.y);
+	new_region_min.y -= find_extent(glm::vec3(0.0f, -1.0f, 0.0f), pos.y + 30000.0f);
+	new_region_max.z += find_extent(glm::vec3(0.0f, 0.0f, 1.0f), 30000.0f - pos.z);
+	new_region_min.z -= find_extent(glm::vec3(0.0f, 0.0f, -1.0f), pos.z + 30000.0f);
 	
 	Region t;
 	t.area_type = (uint32_t)region_type;
@@ -4,6 +4,7 @@
 #include <gtc/matrix_transform.hpp>
 
 #include "static_geometry.h"
+#include "floor_map.h"
 #include "config.h"
 
 const char *GetRegionTypeString(WaterRegionType type) {
@@ -138,19 +139,29 @@ void Scene::LoadScene(const char *zone_name) {
 	m_camera_loc.y = 0.0f;
 	m_camera_loc.z = 0.0f;
 
+	//physics references the zone geometry in place so it has to go first
+	m_physics.reset(new EQPhysics());
 	m_zone_geometry.reset(ZoneMap::LoadMapFile(zone_name));
 	if(m_zone_geometry) {
-		m_physics.reset(new EQPhysics());
 
 		auto w_map = WaterMap::LoadWaterMapfile(Config::Instance().GetPath("volume", "maps/volume") + "/", zone_name);
 		if (!w_map) {
 			w_map = WaterMap::LoadWaterMapfile(Config::Instance().GetPath("water", "maps/water") + "/", zone_name);
 		}
-		m_physics->RegisterMesh("CollideWorldMesh", m_zone_geometry->GetCollidableVerts(), m_zone_geometry->GetCollidableInds(), 
-			glm::vec3(0.0f, 0.0f, 0.0f), EQPhysicsFlags::CollidableWorld);
-		m_physics->RegisterMesh("NonCollideWorldMesh", m_zone_geometry->GetNonCollidableVerts(), m_zone_geometry->GetNonCollidableInds(), 
-			glm::vec3(0.0f, 0.0f, 0.0f), EQPhysicsFlags::NonCollidableWorld);
+		m_physics->RegisterZoneMap(*m_zone_geometry, m_zone_geometry->GetBvhFilename());
 		m_physics->SetWaterMap(w_map);
+		float water_column_size = Config::Instance().GetFloat("physics", "water_column_size", 0.0f);
+		if (water_column_size > 0.0f) {
+			m_physics->BakeWaterColumns(*m_zone_geometry, water_column_size);
+		}
+
+		FloorMap *floor_map = new FloorMap();
+		if (floor_map->Load(m_zone_geometry->GetFloorMapFilename(), *m_zone_geometry)) {
+			m_physics->SetFloorMap(floor_map);
+		}
+		else {
+			delete floor_map;
+		}
 
 		//create models from the loaded stuff here...
 		StaticGeometry *m = new StaticGeometry();
@@ -316,6 +327,10 @@ void Scene::RenderUI() {
 		ImGui::Text("Loc: (%.2f, %.2f, %.2f)", m_camera_loc.x, m_camera_loc.y, m_camera_loc.z);
 		ImGui::Text("Best floor: %.2f", m_physics->FindBestFloor(m_camera_loc, nullptr, nullptr));
 		ImGui::Text("Area: %s", GetRegionTypeString(m_physics->ReturnRegionType(m_camera_loc)));
+		bool static_bvh = m_physics->GetQueryEngine() == QueryEngineStaticBvh;
+		if (ImGui::Checkbox("Static BVH Queries", &static_bvh)) {
+			m_physics->SetQueryEngine(static_bvh ? QueryEngineStaticBvh : QueryEngineBullet);
+		}
 		if(GetZoneGeometry()) {
 			auto zone_geo = GetZoneGeometry();
 			ImGui::Text("Min: (%.2f, %.2f, %.2f)", zone_geo->GetCollidableMin().x, zone_geo->GetCollidableMin().y, zone_geo->GetCollidableMin().z);
@@ -597,7 +612,8 @@ void Scene::ProcessSceneInput() {
 			bool did_select_hit = false;
 			Entity *selected_ent = nullptr;
 
-			if (ent_name.compare("CollideWorldMesh") == 0) {
+			//placed models on v3 maps are registered as CollideWorldMesh:n
+			if (ent_name.compare(0, 16, "CollideWorldMesh") == 0) {
 				did_collide_hit = true;
 				collide_hit_loc = hit_loc;
 			}
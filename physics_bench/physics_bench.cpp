@@ -0,0 +1,271 @@
+#include "zone_map.h"
+#include "eq_physics.h"
+#include "thread_pool.h"
+#include "log_macros.h"
+#include "log_stdout.h"
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+
+//Times the single call queries against their batched forms on one zone, with and without a pool, and checks that every
+//batched result is what the single call gave. --Compare instead checks that both query engines give the same hits.
+struct BenchTimer
+{
+	BenchTimer() : start(std::chrono::steady_clock::now()) { }
+
+	double Seconds() const {
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		return elapsed.count();
+	}
+
+	std::chrono::steady_clock::time_point start;
+};
+
+static void Report(const char *name, size_t count, double single, double batch, double pooled, size_t threads, uint32_t mismatches) {
+	eqLogMessage(LogInfo, "%-12s %10.0f/s single %10.0f/s batch %10.0f/s batch on %u threads (%.2fx), %u mismatches", name,
+		count / single, count / batch, count / pooled, (uint32_t)threads, single / pooled, mismatches);
+}
+
+static bool SameHit(const EQPhysicsRayHit &a, const EQPhysicsRayHit &b) {
+	if (a.hit != b.hit) {
+		return false;
+	}
+
+	return !a.hit || (fabs(a.fraction - b.fraction) <= 0.0001f && a.handle == b.handle);
+}
+
+static uint32_t CompareEngines(EQPhysics &physics, const std::vector<EQPhysicsRay> &rays) {
+	std::vector<uint8_t> bullet_los;
+	std::vector<EQPhysicsRayHit> bullet_hits;
+	physics.SetQueryEngine(QueryEngineBullet);
+	physics.CheckLOSBatch(rays, bullet_los);
+	physics.GetRaycastClosestHitBatch(rays, bullet_hits);
+
+	std::vector<uint8_t> bvh_los;
+	std::vector<EQPhysicsRayHit> bvh_hits;
+	physics.SetQueryEngine(QueryEngineStaticBvh);
+	physics.CheckLOSBatch(rays, bvh_los);
+	physics.GetRaycastClosestHitBatch(rays, bvh_hits);
+	physics.SetQueryEngine(QueryEngineBullet);
+
+	uint32_t los_mismatches = 0;
+	uint32_t hit_mismatches = 0;
+	uint32_t handle_mismatches = 0;
+	for (size_t r = 0; r < rays.size(); ++r) {
+		los_mismatches += bullet_los[r] != bvh_los[r] ? 1 : 0;
+		if (!SameHit(bullet_hits[r], bvh_hits[r])) {
+			bool same_spot = bullet_hits[r].hit && bvh_hits[r].hit && fabs(bullet_hits[r].fraction - bvh_hits[r].fraction) <= 0.0001f;
+			if (same_spot) {
+				eqLogMessage(LogInfo, "Ray %u hit %u with bullet but %u with the static bvh", (uint32_t)r, bullet_hits[r].handle,
+					bvh_hits[r].handle);
+				++handle_mismatches;
+			}
+			else {
+				++hit_mismatches;
+			}
+		}
+	}
+
+	eqLogMessage(LogInfo, "Engines: %u LOS mismatches, %u hit mismatches, %u handle mismatches out of %u rays", los_mismatches,
+		hit_mismatches, handle_mismatches, (uint32_t)rays.size());
+	return los_mismatches + hit_mismatches + handle_mismatches;
+}
+
+int main(int argc, char **argv) {
+	eqLogInit(EQEMU_LOG_LEVEL);
+	eqLogRegister(std::shared_ptr<EQEmu::Log::LogBase>(new EQEmu::Log::LogStdOut()));
+
+	int i = 1;
+	size_t count = 100000;
+	size_t jobs = EQEmu::ThreadPool::DefaultThreadCount();
+	uint32_t seed = 1;
+	bool compare = false;
+	for (; i < argc; ++i) {
+		if (strcmp(argv[i], "--Rays") == 0 && i + 1 < argc) {
+			int n = atoi(argv[++i]);
+			count = n > 0 ? (size_t)n : count;
+		}
+		else if (strcmp(argv[i], "--Seed") == 0 && i + 1 < argc) {
+			seed = (uint32_t)atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--Compare") == 0) {
+			compare = true;
+		}
+		else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+			int n = atoi(argv[++i]);
+			jobs = n > 0 ? (size_t)n : EQEmu::ThreadPool::DefaultThreadCount();
+		}
+		else {
+			break;
+		}
+	}
+
+	if (i >= argc) {
+		eqLogMessage(LogError, "Usage: physics_bench [--Rays n] [--Seed n] [--Compare] [-j n] zone");
+		return 1;
+	}
+
+	std::string zone = argv[i];
+	ZoneMap map;
+	if (!map.Load(zone + ".map")) {
+		eqLogMessage(LogError, "Failed to load %s.map", zone.c_str());
+		return 1;
+	}
+
+	EQPhysics physics;
+	physics.RegisterZoneMap(map, zone + ".bvh");
+
+	//ends anywhere in the zone's bounds, so a mix of long and short rays and of hits and misses
+	glm::vec3 min = map.GetCollidableMin();
+	glm::vec3 max = map.GetCollidableMax();
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> dx(min.x, max.x);
+	std::uniform_real_distribution<float> dy(min.y, max.y);
+	std::uniform_real_distribution<float> dz(min.z, max.z);
+	std::uniform_real_distribution<float> step(-50.0f, 50.0f);
+
+	std::vector<EQPhysicsRay> rays(count);
+	std::vector<glm::vec3> starts(count);
+	std::vector<EQPhysicsSweep> sweeps(count);
+	for (size_t r = 0; r < count; ++r) {
+		rays[r].src = glm::vec3(dx(rng), dy(rng), dz(rng));
+		rays[r].dest = glm::vec3(dx(rng), dy(rng), dz(rng));
+		starts[r] = glm::vec3(dx(rng), dy(rng), dz(rng));
+		sweeps[r].src = glm::vec3(dx(rng), dy(rng), dz(rng));
+		sweeps[r].dest = sweeps[r].src + glm::vec3(step(rng), step(rng), step(rng));
+		sweeps[r].radius = 2.0f;
+		sweeps[r].height = r % 2 == 0 ? 0.0f : 4.0f;
+	}
+
+	EQEmu::ThreadPool pool(jobs);
+	if (compare) {
+		physics.SetThreadPool(&pool);
+		return CompareEngines(physics, rays) == 0 ? 0 : 1;
+	}
+
+	eqLogMessage(LogInfo, "%s: %u queries of each kind, %u threads", zone.c_str(), (uint32_t)count, (uint32_t)pool.Size());
+
+	{
+		std::vector<uint8_t> single(count);
+		BenchTimer t;
+		for (size_t r = 0; r < count; ++r) {
+			single[r] = physics.CheckLOS(rays[r].src, rays[r].dest) ? 1 : 0;
+		}
+		double single_time = t.Seconds();
+
+		std::vector<uint8_t> batch;
+		physics.SetThreadPool(nullptr);
+		t = BenchTimer();
+		physics.CheckLOSBatch(rays, batch);
+		double batch_time = t.Seconds();
+
+		std::vector<uint8_t> pooled;
+		physics.SetThreadPool(&pool);
+		t = BenchTimer();
+		physics.CheckLOSBatch(rays, pooled);
+		double pooled_time = t.Seconds();
+
+		uint32_t mismatches = 0;
+		for (size_t r = 0; r < count; ++r) {
+			mismatches += (single[r] != batch[r] || single[r] != pooled[r]) ? 1 : 0;
+		}
+
+		Report("LOS", count, single_time, batch_time, pooled_time, pool.Size(), mismatches);
+	}
+
+	{
+		std::vector<glm::vec3> single(count);
+		std::vector<uint8_t> single_hit(count);
+		BenchTimer t;
+		for (size_t r = 0; r < count; ++r) {
+			single_hit[r] = physics.GetRaycastClosestHit(rays[r].src, rays[r].dest, single[r], nullptr) ? 1 : 0;
+		}
+		double single_time = t.Seconds();
+
+		std::vector<EQPhysicsRayHit> batch;
+		physics.SetThreadPool(nullptr);
+		t = BenchTimer();
+		physics.GetRaycastClosestHitBatch(rays, batch);
+		double batch_time = t.Seconds();
+
+		std::vector<EQPhysicsRayHit> pooled;
+		physics.SetThreadPool(&pool);
+		t = BenchTimer();
+		physics.GetRaycastClosestHitBatch(rays, pooled);
+		double pooled_time = t.Seconds();
+
+		uint32_t mismatches = 0;
+		for (size_t r = 0; r < count; ++r) {
+			bool same = single_hit[r] == (batch[r].hit ? 1 : 0) && SameHit(batch[r], pooled[r]) &&
+				(!batch[r].hit || glm::length(batch[r].point - single[r]) <= 0.01f);
+			mismatches += same ? 0 : 1;
+		}
+
+		Report("ClosestHit", count, single_time, batch_time, pooled_time, pool.Size(), mismatches);
+	}
+
+	{
+		std::vector<float> single(count);
+		BenchTimer t;
+		for (size_t r = 0; r < count; ++r) {
+			single[r] = physics.FindBestFloor(starts[r], nullptr, nullptr);
+		}
+		double single_time = t.Seconds();
+
+		std::vector<float> batch;
+		physics.SetThreadPool(nullptr);
+		t = BenchTimer();
+		physics.FindBestFloorBatch(starts, batch, nullptr, nullptr);
+		double batch_time = t.Seconds();
+
+		std::vector<float> pooled;
+		physics.SetThreadPool(&pool);
+		t = BenchTimer();
+		physics.FindBestFloorBatch(starts, pooled, nullptr, nullptr);
+		double pooled_time = t.Seconds();
+
+		uint32_t mismatches = 0;
+		for (size_t r = 0; r < count; ++r) {
+			mismatches += (single[r] != batch[r] || single[r] != pooled[r]) ? 1 : 0;
+		}
+
+		Report("BestFloor", count, single_time, batch_time, pooled_time, pool.Size(), mismatches);
+	}
+
+	{
+		std::vector<EQPhysicsRayHit> single(count);
+		BenchTimer t;
+		for (size_t r = 0; r < count; ++r) {
+			if (sweeps[r].height > 0.0f) {
+				physics.SweepCapsule(sweeps[r].src, sweeps[r].dest, sweeps[r].radius, sweeps[r].height, single[r]);
+			}
+			else {
+				physics.SweepSphere(sweeps[r].src, sweeps[r].dest, sweeps[r].radius, single[r]);
+			}
+		}
+		double single_time = t.Seconds();
+
+		std::vector<EQPhysicsRayHit> batch;
+		physics.SetThreadPool(nullptr);
+		t = BenchTimer();
+		physics.SweepBatch(sweeps, batch);
+		double batch_time = t.Seconds();
+
+		std::vector<EQPhysicsRayHit> pooled;
+		physics.SetThreadPool(&pool);
+		t = BenchTimer();
+		physics.SweepBatch(sweeps, pooled);
+		double pooled_time = t.Seconds();
+
+		uint32_t mismatches = 0;
+		for (size_t r = 0; r < count; ++r) {
+			mismatches += (SameHit(single[r], batch[r]) && SameHit(single[r], pooled[r])) ? 0 : 1;
+		}
+
+		Report("Sweep", count, single_time, batch_time, pooled_time, pool.Size(), mismatches);
+	}
+
+	return 0;
+}